@@ -0,0 +1,90 @@
+#include "BenchFixtures.hpp"
+#include "CorpusGenerator.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct ScratchDirectory {
+    fs::path path;
+
+    ScratchDirectory() {
+        fs::path base;
+        if (const char* configured = std::getenv("FSF_BENCH_DIR")) {
+            base = configured;
+        } else if (fs::is_directory("/dev/shm") && access("/dev/shm", W_OK) == 0) {
+            base = "/dev/shm";
+        } else {
+            base = fs::temp_directory_path();
+        }
+        path = base / ("fsf_bench_" + std::to_string(getpid()));
+        fs::create_directories(path);
+    }
+
+    ~ScratchDirectory() {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+    }
+};
+
+std::string deterministic_content(uint64_t seed, size_t size) {
+    std::mt19937_64 generator(seed);
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word = generator();
+        for (size_t b = 0; b < sizeof(word) && i + b < size; ++b) {
+            content[i + b] = static_cast<char>(word >> (8 * b));
+        }
+    }
+    return content;
+}
+
+void write_file(const fs::path& path, const std::string& content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+} // namespace
+
+const fs::path& bench_root() {
+    static ScratchDirectory scratch;
+    return scratch.path;
+}
+
+const fs::path& bench_file(size_t size) {
+    static std::map<size_t, fs::path> files;
+    auto it = files.find(size);
+    if (it == files.end()) {
+        fs::path path = bench_root() / ("file_" + std::to_string(size) + ".bin");
+        write_file(path, deterministic_content(size, size));
+        it = files.emplace(size, path).first;
+    }
+    return it->second;
+}
+
+const fs::path& bench_tree(const std::string& name, size_t file_count, size_t file_size) {
+    static std::map<std::string, fs::path> trees;
+    std::string key = name + "_" + std::to_string(file_count) + "_" + std::to_string(file_size);
+    auto it = trees.find(key);
+    if (it != trees.end()) {
+        return it->second;
+    }
+
+    fs::path root = bench_root() / key;
+    CorpusSpec spec;
+    spec.file_count = file_count;
+    spec.depth = 2;
+    spec.fanout = 16;
+    spec.min_size = file_size;
+    spec.max_size = file_size;
+    spec.duplicate_ratio = 0.25;
+    CorpusGenerator(spec).generate(root);
+    return trees.emplace(key, root).first->second;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+// Scratch space for benchmark inputs. Lives on tmpfs (/dev/shm) when
+// available so disk latency does not drown the code being measured;
+// FSF_BENCH_DIR overrides the location. Removed when the process exits.
+const std::filesystem::path& bench_root();
+
+// Writes a file of the given size filled with deterministic bytes and
+// returns its path. Files are cached per size for the life of the process.
+const std::filesystem::path& bench_file(size_t size);
+
+// Builds (once) a CorpusGenerator tree of file_count files of file_size
+// bytes, two levels of 16 directories deep, a quarter of them duplicates.
+// Content depends only on file_count and file_size, so trees built under
+// different names compare equal.
+const std::filesystem::path& bench_tree(const std::string& name, size_t file_count, size_t file_size);
@@ -0,0 +1,130 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BenchFixtures.hpp"
+#include "DuplicateIndex.hpp"
+#include "FileHashMapper.hpp"
+#include "Fingerprint.hpp"
+#include "Instrumentation.hpp"
+#include "TreeHash.hpp"
+
+// Hashing a single cached file; isolates compute_md5 from traversal
+static void BM_ComputeMd5(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    const auto& path = bench_file(size);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(FileHashMapper::compute_md5(path));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_ComputeMd5)->Arg(0)->Arg(1 << 10)->Arg(16 << 10)->Arg(1 << 20)->Arg(64 << 20)
+    ->Unit(benchmark::kMicrosecond);
+
+// The same with operation stats enabled; compare against BM_ComputeMd5 to
+// see what --stats costs
+static void BM_ComputeMd5WithStats(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    const auto& path = bench_file(size);
+    instrumentation::set_stats_enabled(true);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(FileHashMapper::compute_md5(path));
+    }
+    instrumentation::set_stats_enabled(false);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_ComputeMd5WithStats)->Arg(0)->Arg(1 << 10)->Arg(16 << 10)->Arg(1 << 20)
+    ->Unit(benchmark::kMicrosecond);
+
+// The first-pass fingerprint over the same files; the gap to BM_ComputeMd5
+// is what a file without a match saves
+static void BM_FingerprintFile(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    const auto& path = bench_file(size);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Fingerprint64::of_file(path));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_FingerprintFile)->Arg(0)->Arg(1 << 10)->Arg(16 << 10)->Arg(1 << 20)->Arg(64 << 20)
+    ->Unit(benchmark::kMicrosecond);
+
+// One large file tree hashed on 1..n threads, against BM_ComputeMd5 at 64 MiB
+static void BM_TreeHashFile(benchmark::State& state) {
+    size_t size = 64 << 20;
+    const auto& path = bench_file(size);
+    unsigned threads = static_cast<unsigned>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tree_hash_file(path, threads));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * size));
+}
+BENCHMARK(BM_TreeHashFile)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ComputeMd5OfBuffer(benchmark::State& state) {
+    std::string data(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(FileHashMapper::compute_md5_of_buffer(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_ComputeMd5OfBuffer)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+static std::vector<std::pair<std::string, std::string>> synthetic_entries(size_t count) {
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string path = "d" + std::to_string(i % 64) + "/d" + std::to_string(i % 4096) +
+                           "/file_" + std::to_string(i) + ".dat";
+        // One digest in four repeats an earlier one
+        size_t content = i % 4 == 3 ? i / 2 : i;
+        std::string digest = FileHashMapper::compute_md5_of_buffer(&content, sizeof(content));
+        entries.emplace_back(std::move(path), std::move(digest));
+    }
+    return entries;
+}
+
+// Insertion into the path -> digest map FileHashMapper keeps
+static void BM_MapInsertion(benchmark::State& state) {
+    auto entries = synthetic_entries(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::unordered_map<std::string, std::string> file_hashes;
+        for (const auto& [path, digest] : entries) {
+            file_hashes[path] = digest;
+        }
+        benchmark::DoNotOptimize(file_hashes.size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * entries.size()));
+}
+BENCHMARK(BM_MapInsertion)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// Grouping a finished path -> digest map by digest to find duplicates
+static void BM_GroupByDigest(benchmark::State& state) {
+    auto entries = synthetic_entries(static_cast<size_t>(state.range(0)));
+    std::unordered_map<std::string, std::string> file_hashes(entries.begin(), entries.end());
+    for (auto _ : state) {
+        std::unordered_map<std::string, std::vector<const std::string*>> groups;
+        for (const auto& [path, digest] : file_hashes) {
+            groups[digest].push_back(&path);
+        }
+        benchmark::DoNotOptimize(groups.size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * entries.size()));
+}
+BENCHMARK(BM_GroupByDigest)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// Incremental updates as applied by the watcher
+static void BM_DuplicateIndexUpdate(benchmark::State& state) {
+    auto entries = synthetic_entries(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        DuplicateIndex index;
+        for (const auto& [path, digest] : entries) {
+            index.update(path, {digest, 0, 0});
+        }
+        benchmark::DoNotOptimize(index.duplicate_group_count());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * entries.size()));
+}
+BENCHMARK(BM_DuplicateIndexUpdate)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,135 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "BenchFixtures.hpp"
+#include "DirectoryComparer.hpp"
+#include "FileHashMapper.hpp"
+#include "MerkleTree.hpp"
+#include "OverlapMatrix.hpp"
+#include "ScanPipeline.hpp"
+
+namespace fs = std::filesystem;
+
+// Metadata walk alone: the floor for any full scan
+static void BM_Traversal(benchmark::State& state) {
+    const auto& root = bench_tree("walk", static_cast<size_t>(state.range(0)), 64);
+    for (auto _ : state) {
+        size_t files = 0;
+        uintmax_t bytes = 0;
+        for (const auto& entry : fs::recursive_directory_iterator(root)) {
+            if (entry.is_regular_file()) {
+                ++files;
+                bytes += entry.file_size();
+            }
+        }
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+}
+BENCHMARK(BM_Traversal)->Arg(1000)->Arg(20000)->Unit(benchmark::kMillisecond);
+
+static void BM_ProcessDirectory(benchmark::State& state) {
+    size_t file_size = static_cast<size_t>(state.range(1));
+    const auto& root = bench_tree("scan", static_cast<size_t>(state.range(0)), file_size);
+    for (auto _ : state) {
+        FileHashMapper mapper;
+        mapper.process_directory(root);
+        benchmark::DoNotOptimize(mapper.get_file_count());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * state.range(0)) *
+                            static_cast<int64_t>(file_size));
+}
+BENCHMARK(BM_ProcessDirectory)->Args({1000, 4 << 10})->Args({20000, 4 << 10})->Args({20000, 64})->Args({100, 1 << 20})
+    ->Unit(benchmark::kMillisecond);
+
+// The same trees through the coroutine pipeline; range(2) is the thread count
+static void BM_ScanPipeline(benchmark::State& state) {
+    size_t file_size = static_cast<size_t>(state.range(1));
+    const auto& root = bench_tree("scan", static_cast<size_t>(state.range(0)), file_size);
+    PipelineOptions options;
+    options.threads = static_cast<unsigned>(state.range(2));
+    for (auto _ : state) {
+        ScanPipeline pipeline({root}, {}, options);
+        benchmark::DoNotOptimize(pipeline.run().size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * state.range(0)) *
+                            static_cast<int64_t>(file_size));
+}
+BENCHMARK(BM_ScanPipeline)->Args({1000, 4 << 10, 1})->Args({20000, 4 << 10, 1})->Args({20000, 4 << 10, 4})
+    ->Args({100, 1 << 20, 4})->Unit(benchmark::kMillisecond);
+
+static void BM_MerkleBuild(benchmark::State& state) {
+    const auto& root = bench_tree("scan", static_cast<size_t>(state.range(0)), 4 << 10);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(MerkleTree::build(root).digest());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+}
+BENCHMARK(BM_MerkleBuild)->Arg(1000)->Arg(20000)->Unit(benchmark::kMillisecond);
+
+// Two identical trees: the whole comparison collapses into one subtree match
+static void BM_CompareDirectories(benchmark::State& state) {
+    auto mode = static_cast<ComparisonMode>(state.range(0));
+    size_t file_count = static_cast<size_t>(state.range(1));
+    std::vector<fs::path> directories = {
+        bench_tree("left", file_count, 4 << 10),
+        bench_tree("right", file_count, 4 << 10)
+    };
+    for (auto _ : state) {
+        auto result = DirectoryComparer::compare_directories(directories, mode, {});
+        benchmark::DoNotOptimize(result.entries.size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * file_count * directories.size()));
+}
+BENCHMARK(BM_CompareDirectories)
+    ->ArgsProduct({{static_cast<int64_t>(ComparisonMode::All),
+                    static_cast<int64_t>(ComparisonMode::OnlyDifferent),
+                    static_cast<int64_t>(ComparisonMode::OnlySame),
+                    static_cast<int64_t>(ComparisonMode::OnlyUnique)},
+                   {1000, 20000}})
+    ->Unit(benchmark::kMillisecond);
+
+// With manifests in place only the metadata walk remains
+static void BM_CompareDirectoriesWithManifests(benchmark::State& state) {
+    size_t file_count = static_cast<size_t>(state.range(0));
+    std::vector<fs::path> directories = {
+        bench_tree("left", file_count, 4 << 10),
+        bench_tree("right", file_count, 4 << 10)
+    };
+    ComparisonOptions options;
+    options.manifest_dir = bench_root() / "manifests";
+    DirectoryComparer::compare_directories(directories, ComparisonMode::All, {}, options);
+
+    for (auto _ : state) {
+        auto result = DirectoryComparer::compare_directories(directories, ComparisonMode::All, {}, options);
+        benchmark::DoNotOptimize(result.entries.size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * file_count * directories.size()));
+}
+BENCHMARK(BM_CompareDirectoriesWithManifests)->Arg(1000)->Arg(20000)->Unit(benchmark::kMillisecond);
+
+// Building the N x N matrix from already hashed files: 20 roots, each a
+// copy of a shared base with its own share of unique content
+static void BM_OverlapMatrix(benchmark::State& state) {
+    size_t roots = 20;
+    size_t per_root = static_cast<size_t>(state.range(0));
+    std::vector<ScannedFile> files;
+    for (size_t root = 0; root < roots; ++root) {
+        for (size_t i = 0; i < per_root; ++i) {
+            size_t content = i % 2 ? i : root * per_root + i;
+            files.push_back({root, "f" + std::to_string(i), 4096, FileHashMapper::compute_md5_of_buffer(&content, sizeof(content))});
+        }
+    }
+    std::vector<fs::path> names(roots, "root");
+    for (auto _ : state) {
+        OverlapMatrix matrix(names, files);
+        benchmark::DoNotOptimize(matrix.cell(0, 1));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * files.size()));
+}
+BENCHMARK(BM_OverlapMatrix)->Arg(1000)->Arg(50000)->Unit(benchmark::kMillisecond);
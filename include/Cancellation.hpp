@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+// Thrown from inside a scan once its token asks it to stop; the scan's
+// public entry points catch it and return what they had finished
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("Operation cancelled") {}
+};
+
+// Asks a running scan to stop, either explicitly from any thread or once a
+// deadline passes. Scans poll it between directory entries and between the
+// chunks of a file they are hashing, so they stop within one chunk's read
+// and hash, a millisecond or less, rather than when the file ends.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CancellationToken() = default;
+
+    // Stops whatever uses the token once timeout has elapsed from now
+    explicit CancellationToken(Clock::duration timeout) { set_deadline(Clock::now() + timeout); }
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    void set_deadline(Clock::time_point deadline) {
+        deadline_ticks.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    bool stop_requested() const {
+        if (cancelled.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        Clock::rep deadline = deadline_ticks.load(std::memory_order_relaxed);
+        return deadline != no_deadline && Clock::now().time_since_epoch().count() >= deadline;
+    }
+
+    void throw_if_stopped() const {
+        if (stop_requested()) {
+            throw OperationCancelled();
+        }
+    }
+
+private:
+    static constexpr Clock::rep no_deadline = 0;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<Clock::rep> deadline_ticks{no_deadline};
+};
+
+// Polls an optional token; scans take a null pointer to mean "run to the end"
+inline void throw_if_stopped(const CancellationToken* token) {
+    if (token) {
+        token->throw_if_stopped();
+    }
+}
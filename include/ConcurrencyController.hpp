@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Executor;
+
+struct ControllerOptions {
+    unsigned min_limit = 1;
+    unsigned max_limit = 32;
+    unsigned initial_limit = 2;
+    std::chrono::milliseconds interval{250};   // how often each device is re-evaluated
+    double gain_threshold = 0.05;      // an increase must buy this much more throughput
+    double latency_tolerance = 1.5;    // mean latency over the best seen that counts as queueing
+    double drop_threshold = 0.2;       // throughput falling this much is a congestion signal
+    double decrease_factor = 0.7;      // multiplicative decrease on congestion
+    unsigned probe_after = 8;          // intervals to settle below a congested limit before retrying it
+};
+
+// What one device did over one interval
+struct IntervalSample {
+    double bytes_per_second = 0;
+    double mean_latency_ms = 0;
+    unsigned peak_in_flight = 0;   // most operations outstanding at once
+    size_t operations = 0;
+};
+
+struct ControllerDecision {
+    uint64_t device = 0;
+    double seconds = 0;            // since the controller started
+    unsigned old_limit = 0;
+    unsigned new_limit = 0;
+    IntervalSample sample;
+    std::string reason;
+};
+
+// Additive increase, multiplicative decrease on one device's concurrency
+// limit. Each interval at a saturated limit, the limit goes up by one while
+// that keeps buying throughput. Latency rising with no throughput gain, or
+// throughput falling outright, means requests are queueing in the device,
+// so the limit is cut by decrease_factor. The limit that caused the cut
+// becomes a ceiling: the limit climbs back to just below it and settles
+// there for probe_after intervals before trying the ceiling again, so a
+// steady device spends most of its time at its best depth.
+class AimdPolicy {
+public:
+    explicit AimdPolicy(ControllerOptions options = {});
+
+    // The limit for the next interval; reason says why when it changes
+    unsigned next_limit(const IntervalSample& sample, std::string& reason);
+    unsigned limit() const { return current; }
+
+private:
+    ControllerOptions options;
+    unsigned current;
+    unsigned ceiling = 0;          // 0 until a limit has caused congestion
+    unsigned settled = 0;          // intervals spent just below the ceiling
+    bool have_previous = false;
+    IntervalSample previous;
+    unsigned previous_limit = 0;
+    double best_latency_ms = 0;
+};
+
+// Per-device permits for I/O in the scan pipeline. A coroutine awaits
+// acquire() before touching a file and calls release() with what the
+// operation read and how long it took. Every interval the device's
+// AimdPolicy sets a new limit from the measured bytes/s and latency; each
+// change is kept and, when a log is given, written to it as one line.
+class ConcurrencyController {
+public:
+    ConcurrencyController(Executor& executor, ControllerOptions options = {}, std::ostream* log = nullptr);
+
+    class Acquire {
+    public:
+        Acquire(ConcurrencyController& controller, uint64_t device) : controller(controller), device(device) {}
+        bool await_ready() { return false; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        void await_resume() {}
+
+    private:
+        ConcurrencyController& controller;
+        uint64_t device;
+    };
+
+    Acquire acquire(uint64_t device) { return Acquire(*this, device); }
+    void release(uint64_t device, uint64_t bytes, std::chrono::nanoseconds latency);
+
+    unsigned limit(uint64_t device) const;
+    std::vector<ControllerDecision> decisions() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Device {
+        explicit Device(const ControllerOptions& options) : policy(options) {}
+
+        AimdPolicy policy;
+        unsigned in_flight = 0;
+        unsigned peak_in_flight = 0;
+        std::deque<std::coroutine_handle<>> waiters;
+        Clock::time_point interval_start;
+        uint64_t bytes = 0;
+        size_t operations = 0;
+        std::chrono::nanoseconds latency{0};
+    };
+
+    Device& device_locked(uint64_t device);
+    void evaluate_locked(uint64_t id, Device& device, Clock::time_point now);
+
+    Executor& executor;
+    ControllerOptions options;
+    std::ostream* log;
+    Clock::time_point started;
+    mutable std::mutex mutex;
+    std::map<uint64_t, Device> devices;
+    std::vector<ControllerDecision> history;
+};
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+class Executor;
+
+// A detached coroutine. It does nothing until handed to Executor::spawn and
+// frees itself when it finishes; an escaping exception fails the executor.
+class Task {
+public:
+    struct promise_type {
+        Executor* executor = nullptr;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception();
+    };
+
+    Task(Task&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    Task& operator=(Task&&) = delete;
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+private:
+    friend class Executor;
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Resumes ready coroutines on a small fixed set of threads. Coroutines that
+// wait on a channel are parked off the threads entirely, so the number of
+// files in flight is set by channel capacities, not by the thread count.
+class Executor {
+public:
+    explicit Executor(unsigned threads = 0);   // 0 picks one per hardware thread
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void spawn(Task task);
+    void schedule(std::coroutine_handle<> handle);
+
+    // Runs the spawned tasks to completion on the calling thread and
+    // threads - 1 others, then rethrows the first exception a task raised
+    void run();
+
+    // Records an error; the first one is rethrown by run()
+    void fail(std::exception_ptr error);
+    bool failed() const { return has_error; }
+
+    unsigned thread_count() const { return threads; }
+
+private:
+    friend class Task;
+    void task_done();
+    void worker();
+
+    unsigned threads;
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    std::deque<std::coroutine_handle<>> ready;
+    size_t live_tasks = 0;
+    std::exception_ptr error;
+    std::atomic<bool> has_error{false};
+};
+
+// Runs blocking calls, such as file reads, off the executor's threads. A
+// coroutine awaiting run() is parked while the call runs on one of the
+// pool's threads and is then scheduled back on the executor, so a read in
+// progress holds no executor thread. A thread is started only when a call
+// finds every existing one busy, up to max_threads, so the pool grows with
+// the number of calls actually in flight. The destructor joins them all.
+class BlockingPool {
+public:
+    BlockingPool(Executor& executor, unsigned max_threads);
+    ~BlockingPool();
+
+    BlockingPool(const BlockingPool&) = delete;
+    BlockingPool& operator=(const BlockingPool&) = delete;
+
+    class Call {
+    public:
+        Call(BlockingPool& pool, std::function<void()> work) : pool(pool), work(std::move(work)) {}
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> awaiting);
+        // Rethrows whatever the call threw
+        void await_resume();
+
+    private:
+        friend class BlockingPool;
+        BlockingPool& pool;
+        std::function<void()> work;
+        std::exception_ptr error;
+        std::coroutine_handle<> handle;
+    };
+
+    Call run(std::function<void()> work) { return Call(*this, std::move(work)); }
+
+    // Threads started so far
+    size_t thread_count() const;
+
+private:
+    void worker();
+
+    Executor& executor;
+    unsigned max_threads;
+    mutable std::mutex mutex;
+    std::condition_variable work_cv;
+    std::deque<Call*> queue;
+    std::vector<std::thread> threads;
+    size_t idle = 0;
+    bool stopping = false;
+};
+
+// A bounded multi-producer, multi-consumer channel between coroutines.
+// Items go through a lock-free ring (Vyukov's bounded queue); the mutex is
+// only taken when a coroutine has to wait because the ring is full or
+// empty, or to wake one that is waiting. A full channel suspends senders,
+// which is how a slow stage holds back the stages before it.
+//
+// The channel closes when every producer has called producer_done, or at
+// once on close(). Receivers drain what is left and then get nullopt;
+// senders to a closed channel get false.
+template <typename T>
+class Channel {
+public:
+    Channel(Executor& executor, size_t capacity, size_t producers = 1)
+        : executor(executor), producers(producers) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells = std::vector<Cell>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    class SendAwaiter {
+    public:
+        SendAwaiter(Channel& channel, T item) : channel(channel), item(std::move(item)) {}
+
+        bool await_ready() {
+            if (channel.closed.load()) {
+                rejected = true;
+                return true;
+            }
+            if (channel.try_push(item)) {
+                channel.after_transfer();
+                return true;
+            }
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> awaiting) {
+            std::lock_guard<std::mutex> lock(channel.mutex);
+            channel.waiting.fetch_add(1);
+            if (channel.try_push(item)) {
+                channel.waiting.fetch_sub(1);
+                channel.drain_locked();
+                return false;
+            }
+            if (channel.closed.load()) {
+                channel.waiting.fetch_sub(1);
+                rejected = true;
+                return false;
+            }
+            handle = awaiting;
+            channel.senders.push_back(this);
+            return true;
+        }
+
+        // False when the channel was closed and the item dropped
+        bool await_resume() const { return !rejected; }
+
+    private:
+        friend class Channel;
+        Channel& channel;
+        T item;
+        bool rejected = false;
+        std::coroutine_handle<> handle;
+    };
+
+    class ReceiveAwaiter {
+    public:
+        explicit ReceiveAwaiter(Channel& channel) : channel(channel) {}
+
+        bool await_ready() {
+            value = channel.try_pop();
+            if (value) {
+                channel.after_transfer();
+                return true;
+            }
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> awaiting) {
+            std::lock_guard<std::mutex> lock(channel.mutex);
+            channel.waiting.fetch_add(1);
+            value = channel.try_pop();
+            if (value) {
+                channel.waiting.fetch_sub(1);
+                channel.drain_locked();
+                return false;
+            }
+            if (channel.closed.load()) {
+                channel.waiting.fetch_sub(1);
+                return false;
+            }
+            handle = awaiting;
+            channel.receivers.push_back(this);
+            return true;
+        }
+
+        std::optional<T> await_resume() { return std::move(value); }
+
+    private:
+        friend class Channel;
+        Channel& channel;
+        std::optional<T> value;
+        std::coroutine_handle<> handle;
+    };
+
+    SendAwaiter send(T item) { return SendAwaiter(*this, std::move(item)); }
+    ReceiveAwaiter receive() { return ReceiveAwaiter(*this); }
+
+    void producer_done() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (producers > 0 && --producers == 0) {
+            closed.store(true);
+            drain_locked();
+        }
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed.store(true);
+        drain_locked();
+    }
+
+    // Items in the ring right now; approximate while others are using it
+    size_t depth() const {
+        size_t enqueued = enqueue_pos.load(std::memory_order_relaxed);
+        size_t dequeued = dequeue_pos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const { return cells.size(); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        std::optional<T> value;
+    };
+
+    bool try_push(T& item) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value.emplace(std::move(item));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> try_pop() {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        std::optional<T> value(std::move(cell->value));
+        cell->value.reset();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return value;
+    }
+
+    // A push or pop may let a parked coroutine proceed. Waiters raise the
+    // counter before their last try under the mutex; the fence orders this
+    // check after the transfer, so one side always sees the other.
+    void after_transfer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            drain_locked();
+        }
+    }
+
+    // Moves items to parked receivers and from parked senders until neither
+    // can make progress, then releases everyone once the channel is closed
+    void drain_locked() {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            while (!receivers.empty()) {
+                std::optional<T> value = try_pop();
+                if (!value) {
+                    break;
+                }
+                ReceiveAwaiter* receiver = receivers.front();
+                receivers.pop_front();
+                receiver->value = std::move(value);
+                waiting.fetch_sub(1);
+                executor.schedule(receiver->handle);
+                progress = true;
+            }
+            while (!senders.empty() && try_push(senders.front()->item)) {
+                SendAwaiter* sender = senders.front();
+                senders.pop_front();
+                waiting.fetch_sub(1);
+                executor.schedule(sender->handle);
+                progress = true;
+            }
+        }
+        if (closed.load()) {
+            for (ReceiveAwaiter* receiver : receivers) {
+                waiting.fetch_sub(1);
+                executor.schedule(receiver->handle);
+            }
+            receivers.clear();
+            for (SendAwaiter* sender : senders) {
+                sender->rejected = true;
+                waiting.fetch_sub(1);
+                executor.schedule(sender->handle);
+            }
+            senders.clear();
+        }
+    }
+
+    Executor& executor;
+    std::vector<Cell> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+    alignas(64) std::atomic<size_t> waiting{0};
+    std::atomic<bool> closed{false};
+    std::mutex mutex;
+    size_t producers;
+    std::deque<ReceiveAwaiter*> receivers;
+    std::deque<SendAwaiter*> senders;
+};
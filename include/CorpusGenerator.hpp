@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Parameters of a synthetic tree. Every file is a pure function of the seed
+// and its index, so the same spec always produces byte-identical trees no
+// matter how many threads write them.
+struct CorpusSpec {
+    uint64_t seed = 1;
+    size_t file_count = 1000;
+    size_t depth = 3;                 // files sit 0..depth directories deep
+    size_t fanout = 8;                // subdirectories per directory level
+    uintmax_t min_size = 0;           // sizes are log-uniform in [min, max]
+    uintmax_t max_size = 64 * 1024;
+    double huge_ratio = 0.0;          // files of huge_size written in full
+    double sparse_ratio = 0.0;        // files of huge_size with holes
+    uintmax_t huge_size = uintmax_t(1) << 30;
+    double duplicate_ratio = 0.1;     // byte copies of an earlier file
+    double hardlink_ratio = 0.0;      // hardlinks to an earlier file
+    double near_duplicate_ratio = 0.0;  // copies with a few bytes flipped
+    size_t near_duplicate_mutations = 1;
+    unsigned threads = 0;             // 0 means hardware concurrency
+};
+
+struct CorpusStats {
+    size_t files = 0;
+    size_t unique = 0;
+    size_t duplicates = 0;
+    size_t near_duplicates = 0;
+    size_t hardlinks = 0;
+    size_t sparse = 0;
+    size_t huge = 0;
+    uintmax_t logical_bytes = 0;   // sum of file sizes, hardlinks excluded
+    uintmax_t written_bytes = 0;   // bytes actually written
+};
+
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusSpec& spec);
+
+    // Writes the tree below root, creating it if needed
+    CorpusStats generate(const std::filesystem::path& root) const;
+
+private:
+    CorpusSpec spec;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+enum class DedupMethod {
+    Reflink,    // FICLONE: copies share extents but stay separate files
+    Hardlink    // copies become names of the kept file's inode
+};
+
+struct DedupOptions {
+    DedupMethod method = DedupMethod::Reflink;
+    bool dry_run = false;   // verify and report, change nothing
+    unsigned threads = 0;   // 0 picks one per hardware thread
+};
+
+struct DedupReport {
+    size_t groups = 0;
+    size_t replaced = 0;          // copies replaced, or that would be in a dry run
+    size_t already_linked = 0;    // copies that were already the kept file's inode
+    size_t mismatched = 0;        // copies whose bytes differ from the kept file
+    size_t failed = 0;
+    uintmax_t bytes_reclaimed = 0;
+    std::vector<std::string> errors;  // one line per failed copy
+};
+
+// Replaces duplicate files with reflinks or hard links to one kept copy.
+// Each copy is compared byte for byte with the kept file first, so a digest
+// collision or a file changed since the scan is never linked. The new file
+// is built under a temporary name next to the copy and renamed over it, so
+// the copy's path always names either the old file or the new one.
+// Reflinks keep the copy's mode, owner, times and extended attributes; hard
+// links are made only when mode and owner already match, since the copy
+// takes on the kept file's metadata. Groups of empty files are skipped:
+// they are not copies of one another, and linking them reclaims nothing.
+// Groups are processed in parallel.
+class Deduplicator {
+public:
+    explicit Deduplicator(DedupOptions options = {});
+
+    // Each group lists files believed identical; the first regular file is
+    // kept. Symlinks and other members that are not regular files are left
+    // alone and not counted as failures.
+    DedupReport run(const std::vector<std::vector<std::filesystem::path>>& groups) const;
+
+    // Replaces copy with keeper's content by method, both having been
+    // compared equal when their stats were taken. Throws, leaving copy as
+    // it was, if either changed since or the replacement built from keeper
+    // does not match it.
+    static void replace_verified(DedupMethod method,
+                                 const std::filesystem::path& keeper, const struct stat& keeper_stat,
+                                 const std::filesystem::path& copy, const struct stat& copy_stat);
+
+    // Byte-for-byte comparison of two files
+    static bool same_content(const std::filesystem::path& a, const std::filesystem::path& b);
+
+private:
+    DedupOptions options;
+};
@@ -6,6 +6,11 @@
 #include <string>
 #include <atomic>
 
+#include "FileFilter.hpp"
+#include "Instrumentation.hpp"
+#include "MerkleTree.hpp"
+#include "SharedExtents.hpp"
+
 extern std::atomic<size_t> total_files;
 extern std::atomic<size_t> total_bytes;
 
@@ -16,14 +21,75 @@ enum class ComparisonMode {
     OnlyUnique
 };
 
+enum class EntryStatus {
+    Same,
+    Different,
+    Unique
+};
+
+// One line of a comparison. An entry for a directory stands for its whole
+// subtree: identical subtrees are reported once rather than file by file.
+struct ComparisonEntry {
+    std::filesystem::path relative_path;
+    EntryStatus status = EntryStatus::Same;
+    bool is_directory = false;
+    size_t file_count = 0;
+    std::vector<bool> present;  // one flag per compared directory
+
+    // Set when a stopped scan left this path unsettled: a copy is only
+    // partly read, or missing where the scan never got to look. The status
+    // then describes what was seen, not the whole path.
+    bool incomplete = false;
+};
+
+struct ComparisonResult {
+    std::vector<ComparisonEntry> entries;
+    std::vector<DuplicateDirectoryGroup> duplicate_directories;
+    size_t files_hashed = 0;   // files read, as opposed to reused from a manifest
+    size_t files_pruned = 0;   // files settled by a whole-subtree match
+    size_t files_filtered = 0; // files the filter left out unread
+    size_t files_scanned = 0;
+    uintmax_t bytes_scanned = 0;
+    SharedExtentStats shared_extents;
+    std::vector<std::vector<std::filesystem::path>> already_deduplicated;  // files sharing all extents
+    PhaseTimes phase_times;    // where the comparison spent its time
+    PhaseCounters phase_counters;  // filled while perf profiling is enabled
+    bool complete = true;      // false when ComparisonOptions::cancel stopped the scan
+};
+
+struct ComparisonOptions {
+    // When set, one manifest per root is kept here and files whose size and
+    // mtime are unchanged since the last run are not read again.
+    std::filesystem::path manifest_dir;
+
+    // Compare the members of tar archives as if the archives were directories
+    bool expand_archives = false;
+
+    // Ask FIEMAP for each file's extents and skip reading files whose
+    // storage is shared with a file already hashed
+    bool detect_shared_extents = false;
+
+    // Only files passing this are compared; the rest are never opened
+    FileFilter filter;
+
+    // Once the token asks to stop, the scan returns within a chunk's read
+    // with whatever it has compared; see ComparisonEntry::incomplete
+    const CancellationToken* cancel = nullptr;
+};
+
 class DirectoryComparer {
 public:
-    static void compare_directories(
+    static ComparisonResult compare_directories(
         const std::vector<std::filesystem::path>& directories,
         ComparisonMode mode,
-        const std::vector<std::string>& exclude_folders
+        const std::vector<std::string>& exclude_folders,
+        const ComparisonOptions& options = {}
+    );
+
+    static std::filesystem::path manifest_path_for(
+        const std::filesystem::path& manifest_dir,
+        const std::filesystem::path& directory
     );
 };
 
 #endif // DIRECTORY_COMPARER_HPP
-
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct IndexedFile {
+    std::string digest;
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+};
+
+// Path -> digest index with a reverse digest -> paths map, kept current by
+// incremental updates. Readers share a lock; writers hold it only to apply
+// results that were hashed beforehand, so queries never wait on file I/O.
+class DuplicateIndex {
+public:
+    DuplicateIndex();
+
+    void update(const std::string& path, const IndexedFile& file);
+    bool remove(const std::string& path);
+    // Removes every file below directory, e.g. after it was deleted or moved
+    size_t remove_under(const std::string& directory);
+
+    std::optional<IndexedFile> find(const std::string& path) const;
+    std::vector<std::string> paths_with_digest(const std::string& digest) const;
+    std::vector<std::string> paths_under(const std::string& directory) const;
+    // Files below directory whose content has no copy outside it
+    std::vector<std::string> unique_under(const std::string& directory) const;
+    std::vector<std::vector<std::string>> duplicate_groups() const;
+
+    size_t file_count() const;
+    uintmax_t total_size() const;
+    size_t duplicate_group_count() const;
+
+private:
+    void erase_locked(std::map<std::string, IndexedFile>::iterator it);
+
+    mutable std::shared_mutex mutex;
+    std::map<std::string, IndexedFile> files;  // ordered for subtree ranges
+    std::unordered_map<std::string, std::set<std::string>> paths_by_digest;
+    uintmax_t indexed_bytes;
+    size_t group_count;  // digests currently held by more than one path
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MemoryAccounting.hpp"
+
+struct ExternalOptions {
+    size_t memory_budget = 64 << 20;      // bytes of records held before spilling
+    std::filesystem::path scratch_dir;     // defaults to the system temp directory
+    bool expand_archives = false;          // group tar members as "x.tar!/member"
+};
+
+struct ExternalMember {
+    size_t root = 0;                       // index into the scanned roots
+    std::filesystem::path relative_path;
+};
+
+// Files with identical size and content, in the order the merge produced them
+struct ExternalGroup {
+    uint64_t size = 0;
+    std::string digest;
+    std::vector<ExternalMember> members;
+
+    // Number of distinct roots holding a member
+    size_t root_count() const;
+};
+
+struct ExternalStats {
+    size_t files = 0;
+    size_t runs = 0;             // sorted runs written to scratch
+    size_t merge_passes = 0;     // intermediate passes needed to respect the fan-in
+    uint64_t spilled_bytes = 0;
+};
+
+// Finds identical files under a set of roots without holding the whole
+// path -> digest map in memory. Each file becomes a (size, digest, path-id)
+// record; records are sorted and spilled in runs whenever they outgrow the
+// memory budget, and the runs are k-way merged so equal contents arrive
+// next to each other. Paths live in a scratch file and are read back only
+// for files that are reported.
+class ExternalDuplicateFinder {
+public:
+    ExternalDuplicateFinder(
+        std::vector<std::filesystem::path> roots,
+        std::vector<std::string> exclude_folders,
+        ExternalOptions options = {}
+    );
+    ~ExternalDuplicateFinder();
+
+    ExternalDuplicateFinder(const ExternalDuplicateFinder&) = delete;
+    ExternalDuplicateFinder& operator=(const ExternalDuplicateFinder&) = delete;
+
+    // Scans the roots and calls on_group once per content held by two or
+    // more files, in (size, digest) order. With include_unique, contents
+    // held by a single file are reported too.
+    void run(const std::function<void(const ExternalGroup&)>& on_group, bool include_unique = false);
+
+    const ExternalStats& get_stats() const;
+
+private:
+    // One file as it is spilled: sorted by size, then digest, then root and
+    // path-id so a run is also stable across merges
+    struct Record {
+        uint64_t size;
+        uint64_t path_id;
+        uint32_t root;
+        unsigned char digest[16];
+
+        bool operator<(const Record& other) const;
+    };
+
+    class ScratchFile;
+
+    void scan_root(size_t root_index);
+    void add_file(size_t root_index, const std::string& relative_path, uint64_t size, const std::string& digest);
+    void spill();
+    void merge(const std::vector<std::filesystem::path>& inputs, const std::function<void(const Record&)>& sink);
+    std::filesystem::path next_run_path();
+    std::filesystem::path read_path(uint64_t path_id);
+
+    std::vector<std::filesystem::path> roots;
+    std::vector<std::string> exclude_folders;
+    ExternalOptions options;
+    std::filesystem::path work_dir;
+
+    std::vector<Record, CountingAllocator<Record, MemoryCategory::Buffers>> buffer;
+    size_t buffer_capacity;
+    size_t fan_in;
+    std::vector<std::filesystem::path> runs;
+    size_t next_run;
+
+    std::unique_ptr<ScratchFile> paths;     // path bytes, back to back
+    std::unique_ptr<ScratchFile> offsets;   // (offset, length) per path-id
+    uint64_t next_path_id;
+
+    ExternalStats stats;
+};
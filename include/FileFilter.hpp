@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+// Metadata-only predicates deciding which files are hashed at all. Every
+// condition set must hold; an empty filter accepts everything. Only the
+// size, modification time and path relative to the scanned root are
+// consulted, so a rejected file is never opened.
+class FileFilter {
+public:
+    using Time = std::filesystem::file_time_type;
+
+    std::optional<uintmax_t> min_size;          // inclusive
+    std::optional<uintmax_t> max_size;          // inclusive
+    std::optional<Time> modified_after;         // inclusive
+    std::optional<Time> modified_before;        // exclusive
+
+    // Accepted extensions, matched case-insensitively with or without the
+    // leading dot; "tar.gz" style double extensions match the last part only
+    void add_extension(std::string extension);
+
+    // ECMAScript regex searched for in the generic relative path, such as
+    // "photos/2023/img.jpg"; throws std::regex_error if it does not compile
+    void set_path_pattern(const std::string& pattern);
+
+    bool empty() const;
+    bool needs_mtime() const { return modified_after || modified_before; }
+
+    // mtime is only read when needs_mtime(); pass anything otherwise
+    bool matches(const std::filesystem::path& relative_path, uintmax_t size, Time mtime = {}) const;
+
+    // "1048576", "512K", "1M", "2.5G": bytes with an optional binary suffix
+    static uintmax_t parse_size(const std::string& text);
+
+    // "90s", "30m", "12h", "7d", "2w"; throws on anything else
+    static std::chrono::seconds parse_duration(const std::string& text);
+
+private:
+    std::vector<std::string> extensions;   // lowercase, with the dot
+    std::optional<std::regex> path_pattern;
+};
@@ -4,20 +4,116 @@
 #include <filesystem>
 #include <unordered_map>
 #include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "Cancellation.hpp"
+#include "FileFilter.hpp"
+#include "MemoryAccounting.hpp"
+
+// What sampling saved in fingerprint mode
+struct SampleStats {
+    size_t files = 0;              // files fingerprinted from samples
+    uintmax_t bytes_sampled = 0;
+    size_t unread = 0;             // sampled files never read in full
+    uintmax_t bytes_not_read = 0;  // their bytes outside the samples
+};
 
 class FileHashMapper {
 public:
-    FileHashMapper();
-    void process_directory(const std::filesystem::path& dir);
+    // With expand_archives, members of tar archives are mapped under virtual
+    // paths such as "backup.tar!/dir/file" instead of the archive itself
+    //
+    // With fingerprint_first, files are read once for a 64-bit fingerprint
+    // and MD5 is computed only for files whose size and fingerprint match
+    // another file's, right after the match is found so the data is still in
+    // the page cache. A file with no match is keyed by its size and
+    // fingerprint instead, a form an MD5 digest never takes, so equal
+    // digests still mean equal content. Files of 16 bytes or less are keyed
+    // by their content and never hashed. Files of 4 MiB or more are only
+    // sampled at first (see sample_offsets): a file whose samples match no
+    // other file's is never read in full, and one that does match is
+    // confirmed by MD5 like any other. The check spans every directory this
+    // mapper processes. It cannot be combined with expand_archives.
+    explicit FileHashMapper(bool expand_archives = false, bool fingerprint_first = false);
+
+    // Files the filter rejects, judged on their path relative to the
+    // processed directory, size and mtime, are skipped without being opened
+    void set_filter(FileFilter filter);
+
+    // Once the token asks to stop, process_directory returns at the next
+    // entry or chunk boundary. Everything mapped so far stays valid; the
+    // file being hashed is left out and listed by get_incomplete_files(),
+    // and is_complete() turns false. The token must outlive the mapper's use.
+    void set_cancellation(const CancellationToken* token);
+    bool is_complete() const;
+    std::vector<std::string> get_incomplete_files() const;
+
+    // key_prefix is put in front of every stored path, so one mapper can
+    // hold several roots. Directories named in exclude_folders are not
+    // entered, as in MerkleTree::build.
+    void process_directory(const std::filesystem::path& dir, const std::string& key_prefix = {},
+                           const std::vector<std::string>& exclude_folders = {});
     size_t get_file_count() const;
     uintmax_t get_total_size() const;
+    size_t get_strong_hash_count() const;
+    size_t get_filtered_count() const;
+    SampleStats get_sample_stats() const;
     std::unordered_map<std::string, std::string> get_file_hashes() const;
-    static std::string compute_md5(const std::filesystem::path& file_path);
+    // Reads with plain read() into a per-thread buffer and reuses a
+    // per-thread digest context; a file up to 16 KiB takes one read and one
+    // update. The returned string is the only allocation. With a cancel
+    // token, throws OperationCancelled between chunks once it asks to stop.
+    static std::string compute_md5(const std::filesystem::path& file_path,
+                                   const CancellationToken* cancel = nullptr);
+    static std::string compute_md5_of_buffer(const void* data, size_t size);
 
 private:
-    std::unordered_map<std::string, std::string> file_hashes;
+    using PathDigestMap = std::unordered_map<
+        PathString, DigestString, StringViewHash, std::equal_to<PathString>,
+        CountingAllocator<std::pair<const PathString, DigestString>, MemoryCategory::Index>>;
+
+    // The first file seen with a given size and fingerprint. Once a second
+    // one turns up, both have MD5 digests and later ones are hashed directly.
+    struct FingerprintOwner {
+        PathString key;
+        std::filesystem::path path;
+        bool confirmed = false;
+        uintmax_t unread = 0;      // bytes skipped by sampling, until confirmed
+    };
+
+    struct FingerprintKeyHash {
+        size_t operator()(const std::pair<uintmax_t, uint64_t>& key) const noexcept {
+            return static_cast<size_t>(key.second ^ (key.first * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    using FingerprintMap = std::unordered_map<
+        std::pair<uintmax_t, uint64_t>, FingerprintOwner, FingerprintKeyHash,
+        std::equal_to<std::pair<uintmax_t, uint64_t>>,
+        CountingAllocator<std::pair<const std::pair<uintmax_t, uint64_t>, FingerprintOwner>, MemoryCategory::Index>>;
+
+    void add_fingerprinted(PathString key, const std::filesystem::path& path, uintmax_t size);
+
+    // Adds every member of a tar archive under "<archive>!/<member>". An
+    // archive that cannot be read as tar adds nothing and returns false.
+    bool add_archive_members(const std::filesystem::path& path, const std::filesystem::path& archive,
+                             const std::string& key_prefix);
+
+    PathDigestMap file_hashes;
+    FingerprintMap fingerprints;
+    bool expand_archives;
+    bool fingerprint_first;
     std::atomic<size_t> file_count;
     std::atomic<uintmax_t> total_size;
+    size_t strong_hash_count = 0;
+    SampleStats sample_stats;
+    FileFilter filter;
+    size_t filtered_count = 0;
+    const CancellationToken* cancel = nullptr;
+    bool complete = true;
+    std::vector<std::string> incomplete_files;
 
 };
 
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "Cancellation.hpp"
+
+// A fast 64-bit content fingerprint, the XXH64 construction: four
+// independent multiply-rotate lanes over 32-byte stripes, merged and mixed
+// at the end. It runs several times faster than MD5 but is not collision
+// resistant, so equal fingerprints only nominate files for a strong check.
+// The lanes are scalar: SSE2 and AVX2 have no 64-bit multiply, and emulating
+// one costs more than it saves, so the four independent lanes rely on the
+// CPU issuing their multiplies in parallel instead.
+class Fingerprint64 {
+public:
+    explicit Fingerprint64(uint64_t seed = 0);
+
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+    static uint64_t of_buffer(const void* data, size_t size, uint64_t seed = 0);
+
+    // Reads the whole file; throws when it cannot be opened or read, and
+    // OperationCancelled between reads once cancel asks to stop
+    static uint64_t of_file(const std::filesystem::path& path, const CancellationToken* cancel = nullptr);
+
+    // Fingerprints only the blocks sample_offsets(size) names, seeded with
+    // the size; throws when the file is shorter than size, and
+    // OperationCancelled between blocks once cancel asks to stop
+    static uint64_t of_samples(const std::filesystem::path& path, uintmax_t size,
+                               const CancellationToken* cancel = nullptr);
+
+private:
+    uint64_t lanes[4];
+    uint64_t seed;
+    uint64_t total = 0;
+    unsigned char pending[32];
+    size_t pending_size = 0;
+};
+
+// Files at least this large can be sampled instead of read in full
+constexpr uintmax_t sample_min_size = 4 << 20;
+constexpr size_t sample_block_size = 64 << 10;
+constexpr size_t sample_interior_blocks = 6;
+
+// Where a file of the given size is sampled, in ascending order: the first
+// and last sample_block_size bytes and sample_interior_blocks blocks in
+// between, at block-aligned offsets drawn from a generator seeded with the
+// size. Files of the same size are always sampled at the same offsets.
+std::vector<uintmax_t> sample_offsets(uintmax_t size);
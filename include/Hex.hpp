@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Lowercase hex, two digits per byte, as digests are written everywhere
+std::string to_hex(const unsigned char* data, size_t size);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "DuplicateIndex.hpp"
+
+struct WatchUpdate {
+    size_t rehashed = 0;   // files whose content was read again
+    size_t removed = 0;    // files dropped from the index
+    size_t file_count = 0;
+    size_t duplicate_groups = 0;
+};
+
+// Keeps a DuplicateIndex of the given roots current. The roots are hashed
+// once by start(); afterwards recursive inotify watches report changes,
+// which are coalesced per path and rehashed once the path has been quiet
+// for the debounce interval. Steady-state I/O follows churn, not tree size.
+class IndexWatcher {
+public:
+    IndexWatcher(
+        std::vector<std::filesystem::path> roots,
+        std::vector<std::string> exclude_folders,
+        std::chrono::milliseconds debounce = std::chrono::milliseconds(500)
+    );
+    ~IndexWatcher();
+
+    IndexWatcher(const IndexWatcher&) = delete;
+    IndexWatcher& operator=(const IndexWatcher&) = delete;
+
+    void start();
+    void stop();
+
+    // Called on the watcher thread after each batch of changes is applied
+    void set_update_callback(std::function<void(const WatchUpdate&)> callback);
+
+    const DuplicateIndex& index() const;
+    size_t get_rehashed_file_count() const;
+
+private:
+    struct PendingChange {
+        std::chrono::steady_clock::time_point first_event;
+        std::chrono::steady_clock::time_point last_event;
+    };
+
+    void run();
+    void read_events();
+    void add_tree(const std::filesystem::path& dir, std::vector<std::filesystem::path>& files);
+    void remove_tree(const std::string& dir);
+    void mark_pending(const std::string& path, std::chrono::steady_clock::time_point now);
+    void resync();
+    void flush(bool force);
+    bool refresh_file(const std::string& path);
+
+    std::vector<std::filesystem::path> roots;
+    std::vector<std::string> exclude_folders;
+    std::chrono::milliseconds debounce;
+
+    DuplicateIndex file_index;
+    std::function<void(const WatchUpdate&)> update_callback;
+
+    int inotify_fd;
+    int wake_fd;
+    std::unordered_map<int, std::string> watch_paths;
+    std::unordered_map<std::string, int> watch_descriptors;
+    std::unordered_map<std::string, PendingChange> pending;
+    bool needs_resync;
+
+    std::thread watch_thread;
+    std::atomic<bool> running;
+    std::atomic<size_t> rehashed_file_count;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "PerfCounters.hpp"
+
+// Operation counters and latency histograms are compiled in unless the build
+// sets FSF_STATS=0, in which case recording them costs nothing at all
+#ifndef FSF_STATS
+#define FSF_STATS 1
+#endif
+
+// The stages a scan spends its time in. Walk is directory enumeration,
+// Stat is per-file metadata, Read and Hash split content digesting, and
+// Join is matching results across directories.
+enum class Phase {
+    Walk,
+    Stat,
+    Read,
+    Hash,
+    Join
+};
+
+constexpr size_t phase_count = 5;
+
+const char* phase_name(Phase phase);
+
+struct PhaseTimes {
+    std::array<uint64_t, phase_count> nanoseconds{};
+
+    uint64_t& operator[](Phase phase) { return nanoseconds[static_cast<size_t>(phase)]; }
+    uint64_t operator[](Phase phase) const { return nanoseconds[static_cast<size_t>(phase)]; }
+    double milliseconds(Phase phase) const { return (*this)[phase] / 1e6; }
+
+    PhaseTimes& operator+=(const PhaseTimes& other);
+    PhaseTimes operator-(const PhaseTimes& other) const;
+};
+
+// Hardware counter deltas per phase, gathered while perf profiling is on
+struct PhaseCounters {
+    std::array<PerfSample, phase_count> samples{};
+
+    PerfSample& operator[](Phase phase) { return samples[static_cast<size_t>(phase)]; }
+    const PerfSample& operator[](Phase phase) const { return samples[static_cast<size_t>(phase)]; }
+
+    PerfSample total() const;
+
+    PhaseCounters& operator+=(const PhaseCounters& other);
+    PhaseCounters operator-(const PhaseCounters& other) const;
+};
+
+// Individual filesystem and hashing operations. Read and Hash are counted
+// once per file, covering all of that file's chunks.
+enum class Operation {
+    Open,
+    Stat,
+    Read,
+    Hash
+};
+
+constexpr size_t operation_count = 4;
+
+// Bucket b holds latencies in [2^(b-1), 2^b) nanoseconds; the last bucket
+// also takes anything slower
+constexpr size_t latency_bucket_count = 40;
+
+const char* operation_name(Operation operation);
+
+struct OperationStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t total_nanoseconds = 0;
+    uint64_t max_nanoseconds = 0;
+    std::array<uint64_t, latency_bucket_count> buckets{};
+
+    double mean_nanoseconds() const { return count ? static_cast<double>(total_nanoseconds) / count : 0.0; }
+
+    // Upper bound of the bucket holding the p-th percentile, capped at the
+    // largest latency seen
+    uint64_t percentile_nanoseconds(double p) const;
+
+    OperationStats& operator+=(const OperationStats& other);
+};
+
+struct ScanStats {
+    std::array<OperationStats, operation_count> operations;
+
+    OperationStats& operator[](Operation operation) { return operations[static_cast<size_t>(operation)]; }
+    const OperationStats& operator[](Operation operation) const { return operations[static_cast<size_t>(operation)]; }
+};
+
+// Adds the time between construction and destruction to the calling
+// thread's total for one phase, and optionally records it as one operation.
+// While perf profiling is enabled the counters are read at both ends too.
+class ScopedPhase {
+public:
+    explicit ScopedPhase(Phase phase);
+    ScopedPhase(Phase phase, Operation operation);
+    ~ScopedPhase();
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    Phase phase;
+    Operation operation;
+    bool counted;
+    bool profiled;
+    PerfSample start_counters;
+    std::chrono::steady_clock::time_point start;
+};
+
+namespace instrumentation {
+
+// Phase totals accumulated so far by the calling thread. Take one before
+// and one after an operation and subtract to attribute its time.
+PhaseTimes thread_phase_times();
+
+void add_phase_time(Phase phase, uint64_t nanoseconds);
+
+PhaseCounters thread_phase_counters();
+
+void add_phase_counters(Phase phase, const PerfSample& sample);
+
+#if FSF_STATS
+
+// Operation stats are only gathered while enabled. Each thread writes its
+// own cache-line aligned slot, so recording never contends with other
+// threads; collect_stats() sums the slots when asked.
+void set_stats_enabled(bool enabled);
+bool stats_enabled();
+
+void record(Operation operation, uint64_t nanoseconds, uint64_t bytes = 0);
+
+ScanStats collect_stats();
+
+// Zeroes every thread's counters. Counts recorded concurrently may be lost.
+void reset_stats();
+
+#else
+
+inline void set_stats_enabled(bool) {}
+inline bool stats_enabled() { return false; }
+inline void record(Operation, uint64_t, uint64_t = 0) {}
+inline ScanStats collect_stats() { return {}; }
+inline void reset_stats() {}
+
+#endif
+
+} // namespace instrumentation
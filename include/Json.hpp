@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+// Appends value to out as a quoted JSON string. Bytes are passed through
+// unchanged apart from quotes, backslashes and control characters, so paths
+// that are not valid UTF-8 still round-trip through byte-oriented readers.
+void append_json_string(std::string& out, const std::string& value);
+
+std::string json_string(const std::string& value);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// What the memory of a scan is spent on. Paths are file and directory names,
+// Digests the hex digest strings, Index the nodes, buckets and child arrays
+// that hold them together, and Buffers the queues and ring buffers.
+enum class MemoryCategory {
+    Paths,
+    Digests,
+    Index,
+    Buffers
+};
+
+constexpr size_t memory_category_count = 4;
+
+const char* memory_category_name(MemoryCategory category);
+
+struct CategoryUsage {
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+    uint64_t live_bytes = 0;
+    uint64_t peak_bytes = 0;
+};
+
+struct MemoryUsage {
+    std::array<CategoryUsage, memory_category_count> categories;
+    uint64_t peak_rss_bytes = 0;      // 0 where the platform cannot say
+    uint64_t current_rss_bytes = 0;
+
+    const CategoryUsage& operator[](MemoryCategory category) const {
+        return categories[static_cast<size_t>(category)];
+    }
+};
+
+namespace memory {
+
+void note_allocation(MemoryCategory category, size_t bytes);
+void note_deallocation(MemoryCategory category, size_t bytes);
+
+MemoryUsage usage();
+
+// Starts a new peak window: category peaks drop to their live bytes and,
+// where the kernel allows it, the process RSS high-water mark is cleared
+void reset_peaks();
+
+} // namespace memory
+
+// std::allocator that books every allocation against a category
+template <typename T, MemoryCategory Category>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U, Category>;
+    };
+
+    CountingAllocator() noexcept = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U, Category>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        memory::note_allocation(Category, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        memory::note_deallocation(Category, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U, Category>&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U, Category>&) const noexcept { return false; }
+};
+
+template <MemoryCategory Category>
+using CountedString = std::basic_string<char, std::char_traits<char>, CountingAllocator<char, Category>>;
+
+using PathString = CountedString<MemoryCategory::Paths>;
+using DigestString = CountedString<MemoryCategory::Digests>;
+
+// Hashes any string type by its characters
+struct StringViewHash {
+    size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>()(s); }
+};
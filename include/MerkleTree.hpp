@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Cancellation.hpp"
+#include "MemoryAccounting.hpp"
+
+// A node of a content-addressed directory tree. A file's digest is the MD5 of
+// its content; a directory's digest is the MD5 of its children's kinds, names
+// and digests in name order, so two directories share a digest exactly when
+// their whole subtrees are identical.
+// Names, digests and the nodes themselves are allocated through counting
+// allocators so a scan's memory can be reported by category.
+struct MerkleNode {
+    using ChildList = std::vector<std::unique_ptr<MerkleNode>,
+                                  CountingAllocator<std::unique_ptr<MerkleNode>, MemoryCategory::Index>>;
+
+    PathString name;
+    bool is_directory = false;
+    uintmax_t size = 0;        // file size, or total file bytes below a directory
+    size_t file_count = 0;     // 1 for a file, number of files below a directory
+    int64_t mtime = 0;         // files only; lets a manifest digest be reused
+    bool complete = true;      // false for a directory whose walk was stopped early
+    DigestString digest;
+    ChildList children;        // sorted by name
+
+    const MerkleNode* find_child(std::string_view child_name) const;
+
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size) noexcept;
+};
+
+// A set of directories sharing one Merkle digest. Only the outermost
+// duplicated directories are reported, not every directory below them.
+struct DuplicateDirectoryGroup {
+    std::string digest;
+    size_t file_count = 0;
+    uintmax_t size = 0;
+    std::vector<std::filesystem::path> directories;
+};
+
+class FileFilter;
+class SharedExtentCache;
+
+struct TreeBuildOptions {
+    // A tar archive "x.tar" becomes a directory node "x.tar!" holding its
+    // members; archives are always read again
+    bool expand_archives = false;
+
+    // Files sharing all their extents with an already hashed file take its
+    // digest unread; one cache can span several trees
+    SharedExtentCache* shared_extents = nullptr;
+
+    // Files the filter rejects are left out of the tree without being read
+    const FileFilter* filter = nullptr;
+
+    // Once the token asks to stop, the build returns what it has: the file
+    // being hashed is left out, and it and every directory above it are
+    // marked incomplete, their digests covering only what was read
+    const CancellationToken* cancel = nullptr;
+};
+
+class MerkleTree {
+public:
+    MerkleTree();
+
+    // Walks and hashes root. When a previous tree of the same root is given,
+    // files whose size and mtime are unchanged reuse its digest unread.
+    static MerkleTree build(
+        const std::filesystem::path& root,
+        const std::vector<std::string>& exclude_folders = {},
+        const MerkleTree* previous = nullptr,
+        const TreeBuildOptions& options = {}
+    );
+
+    static MerkleTree load_manifest(const std::filesystem::path& manifest_path);
+    void save_manifest(const std::filesystem::path& manifest_path) const;
+
+    const MerkleNode& root() const;
+    const std::filesystem::path& root_path() const;
+    const DigestString& digest() const;
+
+    // Number of files read during build, as opposed to reused from a manifest.
+    size_t get_hashed_file_count() const;
+
+    // Files left out by TreeBuildOptions::filter
+    size_t get_filtered_file_count() const;
+
+    // False when TreeBuildOptions::cancel stopped the build early
+    bool is_complete() const;
+
+    static std::vector<DuplicateDirectoryGroup> find_duplicate_directories(
+        const std::vector<const MerkleTree*>& trees
+    );
+
+private:
+    std::filesystem::path root_directory;
+    std::unique_ptr<MerkleNode> root_node;
+    size_t hashed_file_count;
+    size_t filtered_file_count;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ScanPipeline.hpp"
+
+// How much of one root's content another root holds
+struct OverlapCell {
+    uint64_t files = 0;      // files of the row root whose content the column root has
+    uint64_t bytes = 0;      // their total size
+    uint64_t contents = 0;   // distinct contents the two roots share
+};
+
+// The N x N overlap between a set of roots, from a single scan of all of
+// them. Every distinct content gets an index, and each root a bitset over
+// those indices marking the contents it holds. Distinct shared contents are
+// the popcount of two roots' bitsets ANDed word by word; files and bytes
+// sum the row root's per-content weights over the set bits of the same
+// AND, so both cost one pass over the words plus the shared contents. Row
+// a, column b answers "how much of a exists in b"; the diagonal is each
+// root's own totals. The matrix is not symmetric in files and bytes.
+class OverlapMatrix {
+public:
+    OverlapMatrix(std::vector<std::filesystem::path> roots, const std::vector<ScannedFile>& files);
+
+    // Hashes every root once with the scan pipeline
+    static OverlapMatrix scan(
+        std::vector<std::filesystem::path> roots,
+        std::vector<std::string> exclude_folders,
+        PipelineOptions options = {}
+    );
+
+    size_t root_count() const { return roots.size(); }
+    const std::vector<std::filesystem::path>& get_roots() const { return roots; }
+    const OverlapCell& cell(size_t row, size_t column) const { return cells[row * roots.size() + column]; }
+
+    // One row per ordered pair: from,to,files,bytes,contents
+    void write_csv(std::ostream& out) const;
+
+    // {"roots":[...],"files":[[...]],"bytes":[[...]],"contents":[[...]]},
+    // with rows and columns in root order
+    void write_json(std::ostream& out) const;
+
+private:
+    std::vector<std::filesystem::path> roots;
+    std::vector<OverlapCell> cells;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Hardware and scheduler events counted with perf_event_open
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    CacheMisses,      // last-level cache read misses
+    ContextSwitches
+};
+
+constexpr size_t perf_event_count = 4;
+
+const char* perf_event_name(PerfEvent event);
+
+struct PerfSample {
+    std::array<uint64_t, perf_event_count> values{};
+
+    uint64_t& operator[](PerfEvent event) { return values[static_cast<size_t>(event)]; }
+    uint64_t operator[](PerfEvent event) const { return values[static_cast<size_t>(event)]; }
+
+    PerfSample& operator+=(const PerfSample& other);
+    PerfSample operator-(const PerfSample& other) const;
+};
+
+namespace perf {
+
+// Counters are opened per thread the first time that thread reads them
+// while profiling is enabled. Events the kernel refuses (no PMU, a
+// restrictive perf_event_paranoid, seccomp) are left out and read as zero.
+void set_profiling_enabled(bool enabled);
+bool profiling_enabled();
+
+// Current counts for the calling thread. Returns false when profiling is
+// disabled or no event could be opened.
+bool read_thread_counters(PerfSample& sample);
+
+// Whether the calling thread could open the event; opens counters if needed
+bool event_available(PerfEvent event);
+
+// Why events are missing on the calling thread, empty when all opened
+std::string unavailable_reason();
+
+} // namespace perf
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ProgressSnapshot {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t directories = 0;
+    uint64_t queue_depth = 0;
+};
+
+// Scan progress counters. Each worker bumps its own padded slot, so
+// counting costs a couple of uncontended stores per file.
+namespace progress {
+
+void add_directory();
+void add_file(uint64_t bytes);
+
+// Work items waiting in the scan's queues, for pipelines that have them
+void set_queue_depth(uint64_t depth);
+
+// Sums the slots without stopping the workers
+ProgressSnapshot snapshot();
+
+} // namespace progress
+
+enum class ProgressFormat {
+    Terminal,   // one self-overwriting status line
+    JsonLines   // one JSON object per interval
+};
+
+// Samples the progress counters on its own thread and prints throughput and
+// an ETA. The ETA comes from a stat-only walk of the roots that runs
+// alongside the scan; until that walk finishes the ETA is unknown.
+class ProgressReporter {
+public:
+    ProgressReporter(
+        std::vector<std::filesystem::path> roots,
+        std::vector<std::string> exclude_folders,
+        ProgressFormat format,
+        std::ostream& out,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(1000),
+        size_t passes = 1   // how many times the scan will cover the roots
+    );
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    void start();
+
+    // Prints a final line and joins the threads
+    void stop();
+
+private:
+    void run();
+    void estimate();
+    void report(bool final);
+
+    std::vector<std::filesystem::path> roots;
+    std::vector<std::string> exclude_folders;
+    ProgressFormat format;
+    std::ostream& out;
+    std::chrono::milliseconds interval;
+    size_t passes;
+
+    std::atomic<bool> stopping;
+    std::atomic<bool> estimate_complete;
+    std::atomic<uint64_t> estimated_files;
+    std::atomic<uint64_t> estimated_bytes;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread reporter_thread;
+    std::thread estimate_thread;
+
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point last_sample_time;
+    ProgressSnapshot baseline;
+    ProgressSnapshot last_sample;
+    size_t last_line_length;
+    bool overwrite;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DuplicateIndex.hpp"
+
+// Answers queries against a resident DuplicateIndex over a Unix domain
+// socket. The protocol is line-delimited JSON: each request is one object
+// with an "op" field, each response one object with an "ok" field.
+//
+//   {"op":"lookup","digest":D}      paths whose content has digest D
+//   {"op":"duplicates","path":P}    other paths with the same content as P
+//   {"op":"unique","root":R}        files below R with no copy outside R
+//   {"op":"stats"}                  file, byte and duplicate group counts
+//
+// Each connection is served on its own thread; queries only take the
+// index's shared lock, so they run alongside a watcher refreshing it. At
+// most max_connections are served at once; further clients wait in the
+// listen backlog until one closes. The socket is only ever accessible to
+// its owner.
+class QueryServer {
+public:
+    QueryServer(const DuplicateIndex& index, std::filesystem::path socket_path, size_t max_connections = 64);
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    void start();
+    void stop();
+
+    std::string handle_request(const std::string& line);
+    size_t get_request_count() const;
+
+private:
+    void accept_loop();
+    void serve_connection(int client_fd);
+
+    const DuplicateIndex& index;
+    std::filesystem::path socket_path;
+    size_t max_connections;
+    int listen_fd;
+    std::atomic<bool> running;
+    std::atomic<size_t> request_count;
+
+    std::thread accept_thread;
+    std::mutex connections_mutex;
+    std::condition_variable connections_done;    // a connection closed or stop() ran
+    std::vector<int> client_fds;  // open connections, shut down by stop()
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ConcurrencyController.hpp"
+#include "FileFilter.hpp"
+
+struct PipelineOptions {
+    unsigned threads = 0;           // executor threads; 0 picks one per hardware thread
+    unsigned readers = 0;           // read coroutines; 0 uses the thread count
+    unsigned hashers = 0;           // hash coroutines; 0 uses the thread count
+    size_t channel_capacity = 64;   // items each channel holds before senders wait
+    uintmax_t prefetch_limit = 256 << 10;   // larger files are streamed by the hasher
+
+    // Size each device's I/O concurrency from its measured throughput and
+    // latency instead of using every reader at once. readers left at 0
+    // default to the controller's max_limit; the reads themselves run on a
+    // pool of at most that many I/O threads, while threads stays the
+    // executor's CPU thread count.
+    bool adaptive = false;
+    ControllerOptions controller;
+    std::ostream* decision_log = nullptr;   // one line per limit change
+
+    // Files for which this returns false are counted and dropped before
+    // they are read; the default keeps everything
+    std::function<bool(const std::filesystem::path& relative_path, uintmax_t size)> filter;
+
+    // Applied in the same stage, using the metadata the stat stage gathered
+    FileFilter file_filter;
+};
+
+struct ScannedFile {
+    size_t root = 0;
+    std::filesystem::path relative_path;
+    uintmax_t size = 0;
+    std::string digest;     // MD5 as hex
+};
+
+struct PipelineStats {
+    size_t files = 0;            // files hashed
+    uintmax_t bytes = 0;
+    size_t filtered = 0;         // files the filters dropped
+    size_t directories = 0;
+    size_t peak_queue_depth = 0; // most items seen waiting across the channels
+    std::vector<ControllerDecision> decisions;  // adaptive limit changes, in order
+};
+
+// Scans roots as a chain of coroutine stages joined by bounded channels:
+//
+//   enumerate -> stat -> filter -> read -> hash -> aggregate
+//
+// Enumerate walks the roots, stat drops anything that is not a regular
+// file, filter applies the options' predicate, read pulls small files into
+// memory, hash computes MD5 (streaming the files too large to prefetch) and
+// aggregate collects the results. Read and hash run several coroutines
+// each. A stage that falls behind fills its input channel, which suspends
+// the stage before it. File data only sits in the read -> hash channel and
+// in the coroutines on either side of it, so at most about
+//   (channel_capacity + readers + hashers) * prefetch_limit
+// bytes are held whatever the tree's size. Capacities are rounded up to a
+// power of two.
+class ScanPipeline {
+public:
+    ScanPipeline(
+        std::vector<std::filesystem::path> roots,
+        std::vector<std::string> exclude_folders,
+        PipelineOptions options = {}
+    );
+
+    // Every regular file under the roots, in no particular order. Throws
+    // the first error any stage hit, such as an unreadable file.
+    std::vector<ScannedFile> run();
+
+    const PipelineStats& get_stats() const { return stats; }
+
+private:
+    std::vector<std::filesystem::path> roots;
+    std::vector<std::string> exclude_folders;
+    PipelineOptions options;
+    PipelineStats stats;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "DirectoryComparer.hpp"
+#include "ExternalDuplicateFinder.hpp"
+
+// How paths are spread over shards. Both hash a key into one of count equal
+// ranges of a 64-bit hash space: Subtree keys on the first path component,
+// so a shard skips the top-level subtrees it does not own without walking
+// them, PathHash on the whole relative path for an even spread when one
+// subtree dominates.
+enum class ShardKey {
+    Subtree,
+    PathHash
+};
+
+struct ShardSpec {
+    size_t index = 0;
+    size_t count = 1;
+    ShardKey key = ShardKey::Subtree;
+
+    // Parses "i/N" with 0 <= i < N
+    static ShardSpec parse(const std::string& text, ShardKey key = ShardKey::Subtree);
+
+    // Whether a path relative to a scanned root belongs to this shard. The
+    // same relative path under every root lands on the same shard.
+    bool owns(const std::filesystem::path& relative_path) const;
+};
+
+struct PartialSummary {
+    size_t files = 0;
+    uintmax_t bytes = 0;
+};
+
+// Scans this shard's part of the directories and writes a partial result
+// file: every owned file once sorted by content and once by path, so
+// partials can be merged without loading them
+PartialSummary write_partial(
+    const std::vector<std::filesystem::path>& directories,
+    const std::vector<std::string>& exclude_folders,
+    const ShardSpec& shard,
+    const std::filesystem::path& output
+);
+
+// Streams a complete set of partials back into global results. The
+// constructor checks that the partials come from one sharded scan: same
+// directories, sharding and tree hash threshold, every shard exactly once.
+class PartialMerger {
+public:
+    explicit PartialMerger(std::vector<std::filesystem::path> partials);
+
+    const std::vector<std::filesystem::path>& directories() const;
+
+    // Same contract as ExternalDuplicateFinder::run
+    void merge_groups(const std::function<void(const ExternalGroup&)>& on_group, bool include_unique = false) const;
+
+    // One file-level entry per relative path, in path order
+    void merge_entries(const std::function<void(const ComparisonEntry&)>& on_entry) const;
+
+private:
+    std::vector<std::filesystem::path> partials;
+    std::vector<std::filesystem::path> roots;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Cancellation.hpp"
+
+struct SharedExtentStats {
+    size_t files_queried = 0;     // files whose extents were asked for
+    size_t files_shared = 0;      // files settled by an earlier file's digest
+    uintmax_t bytes_avoided = 0;  // bytes of those files that were not read
+    size_t unsupported = 0;       // files the filesystem could not map
+};
+
+// The physical layout of a file as FIEMAP reports it. A signature is only
+// formed when every extent has a trustworthy physical address: inline,
+// encoded or delayed-allocation extents make it empty.
+struct ExtentMap {
+    std::string signature;    // device, size and every (logical, physical, length)
+    bool shared = false;      // some extent is marked shared with another file
+    size_t links = 0;
+};
+
+// Reads the extent map of path; false when FIEMAP is unsupported or fails
+bool read_extent_map(const std::filesystem::path& path, ExtentMap& map);
+
+// Digests that follow physical storage. Reflinked clones on btrfs or xfs,
+// and hard links everywhere, have identical extent lists, so once one of
+// them is hashed the others take its digest without being read. Only files
+// with shared extents or several links are remembered, which keeps the map
+// to the files that can actually match.
+class SharedExtentCache {
+public:
+    // The file's MD5, from a file with the same extents when one was seen.
+    // read is set when the file had to be hashed; cancel is passed on to
+    // FileHashMapper::compute_md5.
+    std::string digest(const std::filesystem::path& path, uintmax_t size, bool& read,
+                       const CancellationToken* cancel = nullptr);
+
+    SharedExtentStats stats() const;
+
+    // Files found sharing all of their storage, at least two per group
+    std::vector<std::vector<std::filesystem::path>> shared_groups() const;
+
+private:
+    struct Entry {
+        std::string digest;
+        std::vector<std::filesystem::path> paths;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> by_signature;
+    SharedExtentStats counters;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+#include "Cancellation.hpp"
+
+// A regular file stored in a tar archive, hashed while the archive streams by
+struct TarMember {
+    std::string path;       // normalized and relative, e.g. "dir/file"
+    uintmax_t size = 0;
+    int64_t mtime = 0;      // seconds since the epoch
+    std::string digest;     // MD5 of the member's content, as hex
+};
+
+// Separates an archive from the member path in virtual paths such as
+// "backup.tar!/dir/file"
+constexpr const char* archive_member_separator = "!";
+
+// Whether the name says tar: .tar always, .tar.gz and .tgz when built with zlib
+bool is_tar_archive(const std::filesystem::path& path);
+
+// "<archive>!/<member>", the path a member is reported under
+std::filesystem::path archive_member_path(const std::filesystem::path& archive, const std::string& member);
+
+// Reads the archive once, front to back, and calls on_member for every
+// regular file in it. Understands ustar, pax extended headers and GNU long
+// names; directories, links and devices are skipped. Nothing is extracted.
+// Throws OperationCancelled between headers and between 64 KiB chunks of a
+// member once cancel asks to stop.
+void for_each_tar_member(
+    const std::filesystem::path& archive,
+    const std::function<void(const TarMember&)>& on_member,
+    const CancellationToken* cancel = nullptr
+);
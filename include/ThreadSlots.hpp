@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// One cache-line aligned Slot per thread, for counters that the owning
+// thread bumps without contention and that readers sum on demand. A slot
+// is claimed on a thread's first local() call and returned when the thread
+// exits; the next thread to start reuses it with its contents intact, so
+// nothing a finished thread counted is lost. Slot must be default
+// constructible and safe to read while its owner writes (use atomics).
+template <typename Slot>
+class ThreadSlots {
+public:
+    static Slot& local() {
+        thread_local Handle handle;
+        if (!handle.entry) {
+            handle.entry = instance().acquire();
+        }
+        return handle.entry->slot;
+    }
+
+    // Visits every slot ever handed out, under the registry lock
+    template <typename F>
+    static void for_each(F&& f) {
+        ThreadSlots& slots = instance();
+        std::lock_guard<std::mutex> lock(slots.mutex);
+        for (auto& entry : slots.entries) {
+            f(entry->slot);
+        }
+    }
+
+private:
+    struct alignas(64) Entry {
+        Slot slot;
+        bool in_use = false;
+    };
+
+    struct Handle {
+        Entry* entry = nullptr;
+
+        ~Handle() {
+            if (entry) {
+                std::lock_guard<std::mutex> lock(instance().mutex);
+                entry->in_use = false;
+            }
+        }
+    };
+
+    // Never destroyed, so threads exiting during shutdown can still release
+    static ThreadSlots& instance() {
+        static ThreadSlots* slots = new ThreadSlots;
+        return *slots;
+    }
+
+    Entry* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : entries) {
+            if (!entry->in_use) {
+                entry->in_use = true;
+                return entry.get();
+            }
+        }
+        entries.push_back(std::make_unique<Entry>());
+        entries.back()->in_use = true;
+        return entries.back().get();
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Entry>> entries;
+};
+
+// Adds to a counter that only the calling thread writes. A relaxed load and
+// store avoid the locked read-modify-write that fetch_add would issue.
+inline void single_writer_add(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Opt-in timeline of a scan in the Chrome trace event format, which
+// Perfetto and chrome://tracing load directly. Every thread records into
+// its own fixed-size ring buffer without locking; once full, the oldest
+// events are overwritten and counted as dropped.
+namespace trace {
+
+constexpr size_t default_capacity = 1 << 16;
+
+// Starts recording. Buffers are allocated per thread on its first event.
+void start(size_t capacity_per_thread = default_capacity);
+void stop();
+bool enabled();
+
+// Records one complete event. detail, when given, is stored as the event's
+// "path" argument, keeping its tail if it is too long.
+void record(
+    const char* name,
+    std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end,
+    const char* detail = nullptr
+);
+
+// Writes every buffered event as trace JSON and returns how many were
+// written. Call once the threads being traced have stopped recording.
+size_t write(const std::filesystem::path& path);
+
+// Arranges for write(path) to run when the process exits normally
+void write_at_exit(const std::filesystem::path& path);
+
+// Discards all buffered events
+void clear();
+
+} // namespace trace
+
+// Records the lifetime of a scope as one trace event, when tracing is on
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const std::filesystem::path& detail);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    const std::filesystem::path* detail;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Cancellation.hpp"
+
+// A chunked MD5 tree for files too large to hash on one core. The
+// construction is fixed, so digests stay comparable across runs and
+// machines regardless of how many threads produced them:
+//
+//   leaf_i = MD5(bytes [i * 4 MiB, min((i + 1) * 4 MiB, size)))
+//   root   = MD5("fsf-tree-md5" 0x00 || le64(4 MiB) || le64(size)
+//                || leaf_0 || leaf_1 || ... || leaf_{n-1})
+//
+// n is ceil(size / 4 MiB), and the root is written as 32 hex digits like a
+// plain MD5. The digest differs from the file's MD5, so a file hashed this
+// way only matches another hashed the same way; since the mode is chosen by
+// size alone, two files with equal content always are.
+constexpr size_t tree_hash_chunk_size = 4 << 20;
+
+// Builds the same digest from data arriving in order, for streams that
+// cannot be read positionally such as archive members
+class TreeHasher {
+public:
+    TreeHasher();
+
+    void update(const void* data, size_t size);
+    std::string finish();
+
+private:
+    void close_leaf();
+
+    std::vector<unsigned char> leaves;
+    std::vector<char> pending;
+    uint64_t total = 0;
+};
+
+// Hashes the file's chunks concurrently with pread on up to threads threads
+// (0 means one per core); throws when the file cannot be read or shrinks
+// while it is being hashed, and OperationCancelled between chunks once
+// cancel asks to stop
+std::string tree_hash_file(const std::filesystem::path& path, unsigned threads = 0,
+                           const CancellationToken* cancel = nullptr);
+
+namespace tree_hash {
+
+// Files of at least threshold bytes are tree hashed wherever a file's MD5
+// would otherwise be computed; 0, the default, turns tree hashing off
+void set_threshold(uintmax_t bytes);
+uintmax_t threshold();
+
+inline bool applies(uintmax_t size) {
+    uintmax_t limit = threshold();
+    return limit && size >= limit;
+}
+
+// Threads per tree-hashed file; 0 means one per core
+void set_threads(unsigned threads);
+unsigned threads();
+
+} // namespace tree_hash
@@ -0,0 +1,167 @@
+#include "ConcurrencyController.hpp"
+#include "Coroutine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include <sys/sysmacros.h>
+
+AimdPolicy::AimdPolicy(ControllerOptions options)
+    : options(options),
+      current(std::clamp(options.initial_limit, options.min_limit, std::max(options.min_limit, options.max_limit))) {}
+
+unsigned AimdPolicy::next_limit(const IntervalSample& sample, std::string& reason) {
+    unsigned old = current;
+    unsigned top = std::max(options.min_limit, options.max_limit);
+    // Below the limit the device was not the bottleneck and says nothing
+    // about deeper queues
+    if (sample.operations == 0 || sample.peak_in_flight < current) {
+        return current;
+    }
+    if (best_latency_ms == 0 || sample.mean_latency_ms < best_latency_ms) {
+        best_latency_ms = sample.mean_latency_ms;
+    }
+
+    bool congested = false;
+    if (have_previous) {
+        bool raised = previous_limit < current;
+        bool gained = sample.bytes_per_second > previous.bytes_per_second * (1 + options.gain_threshold);
+        bool queueing = sample.mean_latency_ms > best_latency_ms * options.latency_tolerance;
+        if (raised && !gained && queueing) {
+            congested = true;
+            reason = "latency rose without more throughput";
+        } else if (previous_limit <= current &&
+                   sample.bytes_per_second < previous.bytes_per_second * (1 - options.drop_threshold)) {
+            // A fall right after a cut is the cut itself, not congestion
+            congested = true;
+            reason = "throughput fell";
+        }
+    }
+    previous = sample;
+    previous_limit = current;
+    have_previous = true;
+
+    if (congested) {
+        ceiling = current;
+        settled = 0;
+        current = std::max(options.min_limit,
+                           std::min(current - 1, static_cast<unsigned>(std::floor(current * options.decrease_factor))));
+    } else if (ceiling && current >= ceiling) {
+        // The probe held up; whatever congested the device has passed
+        ceiling = 0;
+        if (current < top) {
+            ++current;
+            reason = "throughput rising";
+        }
+    } else if (ceiling && current + 1 == ceiling) {
+        // Just below the last congested limit: stay a while before probing it
+        if (++settled >= options.probe_after && current < top) {
+            ++current;
+            settled = 0;
+            reason = "probing the last congested limit";
+        }
+    } else if (current < top) {
+        ++current;
+        reason = "throughput rising";
+    }
+    if (current == old) {
+        reason.clear();
+    }
+    return current;
+}
+
+bool ConcurrencyController::Acquire::await_suspend(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(controller.mutex);
+    Device& state = controller.device_locked(device);
+    if (state.in_flight < state.policy.limit()) {
+        ++state.in_flight;
+        state.peak_in_flight = std::max(state.peak_in_flight, state.in_flight);
+        return false;
+    }
+    state.waiters.push_back(handle);
+    return true;
+}
+
+ConcurrencyController::ConcurrencyController(Executor& executor, ControllerOptions options, std::ostream* log)
+    : executor(executor), options(options), log(log), started(Clock::now()) {}
+
+ConcurrencyController::Device& ConcurrencyController::device_locked(uint64_t id) {
+    auto it = devices.find(id);
+    if (it == devices.end()) {
+        it = devices.emplace(id, Device(options)).first;
+        it->second.interval_start = Clock::now();
+    }
+    return it->second;
+}
+
+void ConcurrencyController::release(uint64_t id, uint64_t bytes, std::chrono::nanoseconds latency) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Device& device = device_locked(id);
+    --device.in_flight;
+    device.bytes += bytes;
+    ++device.operations;
+    device.latency += latency;
+
+    Clock::time_point now = Clock::now();
+    if (now - device.interval_start >= options.interval) {
+        evaluate_locked(id, device, now);
+    }
+    // Hand out whatever the limit now allows; a waiter resumes holding its permit
+    while (!device.waiters.empty() && device.in_flight < device.policy.limit()) {
+        ++device.in_flight;
+        device.peak_in_flight = std::max(device.peak_in_flight, device.in_flight);
+        executor.schedule(device.waiters.front());
+        device.waiters.pop_front();
+    }
+}
+
+void ConcurrencyController::evaluate_locked(uint64_t id, Device& device, Clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - device.interval_start).count();
+    IntervalSample sample;
+    sample.operations = device.operations;
+    sample.peak_in_flight = device.peak_in_flight;
+    sample.bytes_per_second = static_cast<double>(device.bytes) / seconds;
+    sample.mean_latency_ms =
+        std::chrono::duration<double, std::milli>(device.latency).count() / static_cast<double>(device.operations);
+
+    unsigned old_limit = device.policy.limit();
+    std::string reason;
+    unsigned new_limit = device.policy.next_limit(sample, reason);
+    if (new_limit != old_limit) {
+        ControllerDecision decision;
+        decision.device = id;
+        decision.seconds = std::chrono::duration<double>(now - started).count();
+        decision.old_limit = old_limit;
+        decision.new_limit = new_limit;
+        decision.sample = sample;
+        decision.reason = reason;
+        if (log) {
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(2) << "[adaptive] " << decision.seconds << "s device "
+                 << major(id) << ":" << minor(id) << " limit " << old_limit << " -> " << new_limit
+                 << " (" << sample.bytes_per_second / (1 << 20) << " MiB/s, " << sample.mean_latency_ms
+                 << " ms mean latency): " << reason << "\n";
+            *log << line.str() << std::flush;
+        }
+        history.push_back(std::move(decision));
+    }
+
+    device.interval_start = now;
+    device.bytes = 0;
+    device.operations = 0;
+    device.latency = std::chrono::nanoseconds(0);
+    device.peak_in_flight = device.in_flight;
+}
+
+unsigned ConcurrencyController::limit(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = devices.find(id);
+    return it == devices.end() ? options.initial_limit : it->second.policy.limit();
+}
+
+std::vector<ControllerDecision> ConcurrencyController::decisions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return history;
+}
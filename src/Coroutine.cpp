@@ -0,0 +1,143 @@
+#include "Coroutine.hpp"
+
+#include <algorithm>
+
+void Task::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+    Executor* executor = handle.promise().executor;
+    handle.destroy();
+    executor->task_done();
+}
+
+void Task::promise_type::unhandled_exception() {
+    executor->fail(std::current_exception());
+}
+
+Executor::Executor(unsigned threads)
+    : threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+void Executor::spawn(Task task) {
+    auto handle = task.handle;
+    task.handle = nullptr;
+    handle.promise().executor = this;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++live_tasks;
+    }
+    schedule(handle);
+}
+
+void Executor::schedule(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(handle);
+    }
+    ready_cv.notify_one();
+}
+
+void Executor::fail(std::exception_ptr failure) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!error) {
+        error = failure;
+        has_error = true;
+    }
+}
+
+void Executor::task_done() {
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = --live_tasks == 0;
+    }
+    if (finished) {
+        ready_cv.notify_all();
+    }
+}
+
+void Executor::worker() {
+    for (;;) {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready_cv.wait(lock, [&] { return !ready.empty() || live_tasks == 0; });
+            if (ready.empty()) {
+                return;
+            }
+            handle = ready.front();
+            ready.pop_front();
+        }
+        handle.resume();
+    }
+}
+
+void Executor::run() {
+    std::vector<std::thread> pool;
+    for (unsigned id = 1; id < threads; ++id) {
+        pool.emplace_back([this] { worker(); });
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+BlockingPool::BlockingPool(Executor& executor, unsigned max_threads)
+    : executor(executor), max_threads(std::max(1u, max_threads)) {}
+
+BlockingPool::~BlockingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+size_t BlockingPool::thread_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return threads.size();
+}
+
+void BlockingPool::Call::await_suspend(std::coroutine_handle<> awaiting) {
+    handle = awaiting;
+    // Once queued the call may finish and resume the coroutine at any time,
+    // so nothing here touches it after the lock is released
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.queue.push_back(this);
+    if (pool.queue.size() > pool.idle && pool.threads.size() < pool.max_threads) {
+        pool.threads.emplace_back([pool = &pool] { pool->worker(); });
+    }
+    pool.work_cv.notify_one();
+}
+
+void BlockingPool::Call::await_resume() {
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void BlockingPool::worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        ++idle;
+        work_cv.wait(lock, [&] { return stopping || !queue.empty(); });
+        --idle;
+        if (queue.empty()) {
+            return;
+        }
+        Call* call = queue.front();
+        queue.pop_front();
+        lock.unlock();
+        try {
+            call->work();
+        } catch (...) {
+            call->error = std::current_exception();
+        }
+        executor.schedule(call->handle);
+        lock.lock();
+    }
+}
@@ -0,0 +1,342 @@
+#include "CorpusGenerator.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t write_buffer_size = 1 << 20;
+const uintmax_t sparse_block_size = 4096;
+const size_t indices_per_claim = 64;
+
+enum class FileKind {
+    Unique,
+    Duplicate,
+    NearDuplicate,
+    Hardlink
+};
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Sequential draws for one file, seeded from the corpus seed and its index
+class FileRandom {
+public:
+    FileRandom(uint64_t seed, size_t index) : state(splitmix64(seed ^ splitmix64(index))) {}
+
+    uint64_t next() {
+        state = splitmix64(state);
+        return state;
+    }
+
+    double uniform() {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+private:
+    uint64_t state;
+};
+
+// What a file holds. Bytes come from a counter-based stream so any chunk
+// can be produced on its own; sparse files only carry data in a head, a
+// middle and a tail block.
+struct Content {
+    uint64_t seed = 0;
+    uintmax_t size = 0;
+    bool sparse = false;
+    bool huge = false;
+    std::vector<uintmax_t> mutations;  // offsets whose byte is inverted
+};
+
+struct PlannedFile {
+    FileKind kind = FileKind::Unique;
+    size_t source = 0;
+    fs::path relative_dir;
+};
+
+class Planner {
+public:
+    explicit Planner(const CorpusSpec& spec) : spec(spec) {}
+
+    PlannedFile plan(size_t index) const {
+        FileRandom random(spec.seed, index);
+        PlannedFile file;
+
+        double roll = random.uniform();
+        size_t source = index > 0 ? static_cast<size_t>(random.next() % index) : 0;
+        if (index > 0) {
+            if (roll < spec.hardlink_ratio) {
+                file.kind = FileKind::Hardlink;
+            } else if (roll < spec.hardlink_ratio + spec.duplicate_ratio) {
+                file.kind = FileKind::Duplicate;
+            } else if (roll < spec.hardlink_ratio + spec.duplicate_ratio + spec.near_duplicate_ratio) {
+                file.kind = FileKind::NearDuplicate;
+            }
+            file.source = source;
+        }
+
+        size_t levels = static_cast<size_t>(random.next() % (spec.depth + 1));
+        for (size_t level = 0; level < levels; ++level) {
+            file.relative_dir /= "d" + std::to_string(random.next() % std::max<size_t>(spec.fanout, 1));
+        }
+        return file;
+    }
+
+    Content content(size_t index) const {
+        PlannedFile file = plan(index);
+        if (file.kind == FileKind::Duplicate || file.kind == FileKind::Hardlink) {
+            return content(file.source);
+        }
+        if (file.kind == FileKind::NearDuplicate) {
+            Content near = content(file.source);
+            if (near.size == 0) {
+                near.size = 1;
+            }
+            // Sparse sources only hold data in their blocks, so flip bytes there
+            uintmax_t span = near.sparse ? std::min(near.size, sparse_block_size) : near.size;
+            FileRandom random(spec.seed ^ 0x6E656172ull, index);
+            for (size_t i = 0; i < std::max<size_t>(spec.near_duplicate_mutations, 1); ++i) {
+                near.mutations.push_back(random.next() % span);
+            }
+            return near;
+        }
+
+        FileRandom random(spec.seed ^ 0x73697A65ull, index);
+        Content unique;
+        unique.seed = random.next();
+        double roll = random.uniform();
+        if (roll < spec.sparse_ratio) {
+            unique.sparse = true;
+            unique.size = spec.huge_size;
+        } else if (roll < spec.sparse_ratio + spec.huge_ratio) {
+            unique.huge = true;
+            unique.size = spec.huge_size;
+        } else {
+            // Log-uniform, so small files dominate as they do on real disks
+            double low = std::log(static_cast<double>(spec.min_size) + 1.0);
+            double high = std::log(static_cast<double>(std::max(spec.max_size, spec.min_size)) + 1.0);
+            double size = std::exp(low + (high - low) * random.uniform()) - 1.0;
+            unique.size = std::clamp(static_cast<uintmax_t>(size), spec.min_size, std::max(spec.max_size, spec.min_size));
+        }
+        return unique;
+    }
+
+    // Hardlinks point at the first non-hardlink ancestor, which pass one wrote
+    size_t link_target(size_t index) const {
+        PlannedFile file = plan(index);
+        while (file.kind == FileKind::Hardlink) {
+            index = file.source;
+            file = plan(index);
+        }
+        return index;
+    }
+
+    fs::path relative_path(size_t index) const {
+        return plan(index).relative_dir / ("f" + std::to_string(index));
+    }
+
+private:
+    const CorpusSpec& spec;
+};
+
+void fill(const Content& content, uintmax_t offset, char* buffer, size_t length) {
+    for (size_t i = 0; i < length;) {
+        uintmax_t position = offset + i;
+        uint64_t word = splitmix64(content.seed + (position / 8) * 0x9E3779B97F4A7C15ull);
+        for (size_t b = position % 8; b < 8 && i < length; ++b, ++i) {
+            buffer[i] = static_cast<char>(word >> (8 * b));
+        }
+    }
+    for (uintmax_t mutation : content.mutations) {
+        if (mutation >= offset && mutation < offset + length) {
+            buffer[mutation - offset] = static_cast<char>(~buffer[mutation - offset]);
+        }
+    }
+}
+
+void write_all(int fd, const char* data, size_t length, uintmax_t offset, const fs::path& path) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Unable to write " + path.string() + ": " + std::strerror(errno));
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uintmax_t>(written);
+    }
+}
+
+// Returns the number of bytes written
+uintmax_t write_content(const fs::path& path, const Content& content, std::vector<char>& buffer) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to create " + path.string() + ": " + std::strerror(errno));
+    }
+
+    uintmax_t written = 0;
+    try {
+        if (content.sparse) {
+            if (ftruncate(fd, static_cast<off_t>(content.size)) < 0) {
+                throw std::runtime_error("Unable to size " + path.string() + ": " + std::strerror(errno));
+            }
+            uintmax_t middle = content.size / 2 / sparse_block_size * sparse_block_size;
+            uintmax_t tail = content.size > sparse_block_size ? content.size - sparse_block_size : 0;
+            uintmax_t last_end = 0;
+            for (uintmax_t block : {uintmax_t(0), middle, tail}) {
+                block = std::max(block, last_end);
+                size_t length = static_cast<size_t>(std::min(sparse_block_size, content.size - std::min(block, content.size)));
+                if (length == 0) {
+                    continue;
+                }
+                fill(content, block, buffer.data(), length);
+                write_all(fd, buffer.data(), length, block, path);
+                written += length;
+                last_end = block + length;
+            }
+        } else {
+            for (uintmax_t offset = 0; offset < content.size; offset += buffer.size()) {
+                size_t length = static_cast<size_t>(std::min<uintmax_t>(buffer.size(), content.size - offset));
+                fill(content, offset, buffer.data(), length);
+                write_all(fd, buffer.data(), length, offset, path);
+                written += length;
+            }
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+    return written;
+}
+
+// Concurrent workers may race to create the same parent; losing is fine
+void ensure_directory(const fs::path& dir, std::unordered_set<std::string>& created) {
+    if (created.count(dir.string())) {
+        return;
+    }
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec && !fs::is_directory(dir)) {
+        throw std::runtime_error("Unable to create " + dir.string() + ": " + ec.message());
+    }
+    created.insert(dir.string());
+}
+
+void add(CorpusStats& total, const CorpusStats& part) {
+    total.files += part.files;
+    total.unique += part.unique;
+    total.duplicates += part.duplicates;
+    total.near_duplicates += part.near_duplicates;
+    total.hardlinks += part.hardlinks;
+    total.sparse += part.sparse;
+    total.huge += part.huge;
+    total.logical_bytes += part.logical_bytes;
+    total.written_bytes += part.written_bytes;
+}
+
+} // namespace
+
+CorpusGenerator::CorpusGenerator(const CorpusSpec& spec) : spec(spec) {}
+
+CorpusStats CorpusGenerator::generate(const fs::path& root) const {
+    fs::create_directories(root);
+    Planner planner(spec);
+
+    unsigned thread_count = spec.threads ? spec.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<CorpusStats> thread_stats(thread_count);
+    std::vector<std::exception_ptr> errors(thread_count);
+
+    // Pass one writes file content; pass two links to it
+    for (bool linking : {false, true}) {
+        std::atomic<size_t> next_index(0);
+        auto worker = [&](unsigned id) {
+            try {
+                CorpusStats& stats = thread_stats[id];
+                std::vector<char> buffer(write_buffer_size);
+                std::unordered_set<std::string> created;
+
+                for (;;) {
+                    size_t begin = next_index.fetch_add(indices_per_claim);
+                    if (begin >= spec.file_count) {
+                        return;
+                    }
+                    size_t end = std::min(spec.file_count, begin + indices_per_claim);
+                    for (size_t index = begin; index < end; ++index) {
+                        PlannedFile file = planner.plan(index);
+                        if ((file.kind == FileKind::Hardlink) != linking) {
+                            continue;
+                        }
+
+                        fs::path dir = root / file.relative_dir;
+                        ensure_directory(dir, created);
+                        fs::path path = dir / ("f" + std::to_string(index));
+                        ++stats.files;
+
+                        if (linking) {
+                            std::error_code ec;
+                            fs::remove(path, ec);
+                            fs::create_hard_link(root / planner.relative_path(planner.link_target(index)), path);
+                            ++stats.hardlinks;
+                            continue;
+                        }
+
+                        Content content = planner.content(index);
+                        stats.written_bytes += write_content(path, content, buffer);
+                        stats.logical_bytes += content.size;
+                        stats.sparse += content.sparse;
+                        stats.huge += content.huge;
+                        switch (file.kind) {
+                            case FileKind::Unique: ++stats.unique; break;
+                            case FileKind::Duplicate: ++stats.duplicates; break;
+                            case FileKind::NearDuplicate: ++stats.near_duplicates; break;
+                            case FileKind::Hardlink: break;
+                        }
+                    }
+                }
+            } catch (...) {
+                errors[id] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned id = 1; id < thread_count; ++id) {
+            threads.emplace_back(worker, id);
+        }
+        worker(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    CorpusStats total;
+    for (const auto& stats : thread_stats) {
+        add(total, stats);
+    }
+    return total;
+}
@@ -0,0 +1,333 @@
+#include "Deduplicator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t compare_buffer_size = 64 << 10;
+
+std::atomic<unsigned> temporary_counter(0);
+
+std::string error_text(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+// Closes a descriptor when it goes out of scope
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd; }
+
+private:
+    int fd;
+};
+
+size_t read_full(int fd, char* buffer, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = ::read(fd, buffer + total, size - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error(error_text("read"));
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    return total;
+}
+
+// Extended attributes of the copy, carried over to its replacement.
+// Filesystems without xattr support have nothing to carry.
+void copy_xattrs(int from, int to) {
+    ssize_t length = ::flistxattr(from, nullptr, 0);
+    if (length <= 0) {
+        return;
+    }
+    std::string names(static_cast<size_t>(length), '\0');
+    length = ::flistxattr(from, names.data(), names.size());
+    if (length < 0) {
+        return;
+    }
+    names.resize(static_cast<size_t>(length));
+    for (size_t pos = 0; pos < names.size(); pos = names.find('\0', pos) + 1) {
+        const char* name = names.c_str() + pos;
+        ssize_t size = ::fgetxattr(from, name, nullptr, 0);
+        if (size < 0) {
+            continue;
+        }
+        std::string value(static_cast<size_t>(size), '\0');
+        size = ::fgetxattr(from, name, value.data(), value.size());
+        if (size < 0 || ::fsetxattr(to, name, value.data(), static_cast<size_t>(size), 0) != 0) {
+            throw std::runtime_error(error_text(std::string("copy xattr ") + name));
+        }
+    }
+}
+
+bool unchanged(const fs::path& path, const struct stat& before) {
+    struct stat now;
+    return ::lstat(path.c_str(), &now) == 0 && now.st_ino == before.st_ino && now.st_size == before.st_size &&
+           now.st_mtim.tv_sec == before.st_mtim.tv_sec && now.st_mtim.tv_nsec == before.st_mtim.tv_nsec;
+}
+
+// Fixed length apart from the numbers, so a copy whose name is already
+// near NAME_MAX still gets a temporary beside it
+fs::path temporary_path_for(const fs::path& copy) {
+    return copy.parent_path() / (".fsf-dedup-" + std::to_string(::getpid()) + "-" +
+                                 std::to_string(temporary_counter++));
+}
+
+// Builds the replacement at temporary: a clone of keeper carrying the copy's
+// metadata, or a second name for keeper
+void make_replacement(DedupMethod method, const fs::path& keeper, const fs::path& copy,
+                      const struct stat& copy_stat, const fs::path& temporary) {
+    if (method == DedupMethod::Hardlink) {
+        if (::link(keeper.c_str(), temporary.c_str()) != 0) {
+            throw std::runtime_error(error_text("link"));
+        }
+        return;
+    }
+
+    FileDescriptor source(::open(keeper.c_str(), O_RDONLY | O_CLOEXEC));
+    FileDescriptor original(::open(copy.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    if (source.get() < 0 || original.get() < 0) {
+        throw std::runtime_error(error_text("open"));
+    }
+    FileDescriptor target(::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600));
+    if (target.get() < 0) {
+        throw std::runtime_error(error_text("create"));
+    }
+    if (::ioctl(target.get(), FICLONE, source.get()) != 0) {
+        throw std::runtime_error(error_text("reflink"));
+    }
+    if (::fchown(target.get(), copy_stat.st_uid, copy_stat.st_gid) != 0) {
+        struct stat mine;
+        if (::fstat(target.get(), &mine) != 0 || mine.st_uid != copy_stat.st_uid || mine.st_gid != copy_stat.st_gid) {
+            throw std::runtime_error(error_text("chown"));
+        }
+    }
+    if (::fchmod(target.get(), copy_stat.st_mode & 07777) != 0) {
+        throw std::runtime_error(error_text("chmod"));
+    }
+    copy_xattrs(original.get(), target.get());
+    struct timespec times[2] = {copy_stat.st_atim, copy_stat.st_mtim};
+    if (::futimens(target.get(), times) != 0) {
+        throw std::runtime_error(error_text("set times"));
+    }
+}
+
+void add(DedupReport& total, DedupReport& part) {
+    total.groups += part.groups;
+    total.replaced += part.replaced;
+    total.already_linked += part.already_linked;
+    total.mismatched += part.mismatched;
+    total.failed += part.failed;
+    total.bytes_reclaimed += part.bytes_reclaimed;
+    std::move(part.errors.begin(), part.errors.end(), std::back_inserter(total.errors));
+}
+
+} // namespace
+
+Deduplicator::Deduplicator(DedupOptions options) : options(options) {}
+
+bool Deduplicator::same_content(const fs::path& a, const fs::path& b) {
+    FileDescriptor fa(::open(a.c_str(), O_RDONLY | O_CLOEXEC));
+    FileDescriptor fb(::open(b.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fa.get() < 0 || fb.get() < 0) {
+        throw std::runtime_error(error_text("open"));
+    }
+    ::posix_fadvise(fa.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    ::posix_fadvise(fb.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::vector<char> buffer_a(compare_buffer_size);
+    std::vector<char> buffer_b(compare_buffer_size);
+    for (;;) {
+        size_t na = read_full(fa.get(), buffer_a.data(), buffer_a.size());
+        size_t nb = read_full(fb.get(), buffer_b.data(), buffer_b.size());
+        if (na != nb || std::memcmp(buffer_a.data(), buffer_b.data(), na) != 0) {
+            return false;
+        }
+        if (na < buffer_a.size()) {
+            return true;
+        }
+    }
+}
+
+void Deduplicator::replace_verified(DedupMethod method, const fs::path& keeper, const struct stat& keeper_stat,
+                                    const fs::path& copy, const struct stat& copy_stat) {
+    fs::path temporary = temporary_path_for(copy);
+    try {
+        make_replacement(method, keeper, copy, copy_stat, temporary);
+        // Either file may have changed since it was compared; the keeper
+        // is checked after the replacement was built from it, so a rewrite
+        // before that shows here, and the replacement must hold its bytes
+        if (!unchanged(copy, copy_stat)) {
+            throw std::runtime_error("changed while being verified");
+        }
+        if (!unchanged(keeper, keeper_stat)) {
+            throw std::runtime_error("kept file " + keeper.string() + " changed while being verified");
+        }
+        struct stat built;
+        if (::lstat(temporary.c_str(), &built) != 0) {
+            throw std::runtime_error(error_text("stat"));
+        }
+        bool matches = method == DedupMethod::Hardlink
+                     ? built.st_ino == keeper_stat.st_ino && built.st_size == keeper_stat.st_size
+                     : built.st_size == copy_stat.st_size && same_content(temporary, copy);
+        if (!matches) {
+            throw std::runtime_error("replacement does not match " + keeper.string());
+        }
+        if (::rename(temporary.c_str(), copy.c_str()) != 0) {
+            throw std::runtime_error(error_text("rename"));
+        }
+    } catch (...) {
+        ::unlink(temporary.c_str());
+        throw;
+    }
+}
+
+DedupReport Deduplicator::run(const std::vector<std::vector<fs::path>>& groups) const {
+    unsigned thread_count = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    thread_count = static_cast<unsigned>(std::min<size_t>(thread_count, std::max<size_t>(groups.size(), 1)));
+    std::vector<DedupReport> thread_reports(thread_count);
+    std::vector<std::exception_ptr> errors(thread_count);
+    std::atomic<size_t> next_group(0);
+
+    auto worker = [&](unsigned id) {
+        try {
+            DedupReport& report = thread_reports[id];
+            for (size_t g = next_group++; g < groups.size(); g = next_group++) {
+                const auto& group = groups[g];
+                if (group.size() < 2) {
+                    continue;
+                }
+                // The scans follow symlinks, so a link to a copy lands in its
+                // group; it and anything else not a regular file is passed
+                // over, and the first regular file is kept
+                std::vector<std::pair<const fs::path*, struct stat>> files;
+                std::vector<std::string> missing;
+                for (const auto& path : group) {
+                    struct stat st;
+                    if (::lstat(path.c_str(), &st) != 0) {
+                        missing.push_back(path.string() + ": " + error_text("lstat"));
+                    } else if (S_ISREG(st.st_mode)) {
+                        files.emplace_back(&path, st);
+                    }
+                }
+                // Empty files are unrelated markers and lock files, not
+                // copies, and linking them reclaims nothing
+                if (files.size() + missing.size() < 2 || (!files.empty() && files.front().second.st_size == 0)) {
+                    continue;
+                }
+                ++report.groups;
+                report.failed += missing.size();
+                report.errors.insert(report.errors.end(), missing.begin(), missing.end());
+                if (files.empty()) {
+                    continue;
+                }
+                const fs::path& keeper = *files.front().first;
+                const struct stat& keeper_stat = files.front().second;
+
+                for (size_t i = 1; i < files.size(); ++i) {
+                    const fs::path& copy = *files[i].first;
+                    const struct stat& copy_stat = files[i].second;
+                    auto fail = [&](const std::string& reason) {
+                        ++report.failed;
+                        report.errors.push_back(copy.string() + ": " + reason);
+                    };
+                    if (copy_stat.st_dev == keeper_stat.st_dev && copy_stat.st_ino == keeper_stat.st_ino) {
+                        ++report.already_linked;
+                        continue;
+                    }
+                    if (copy_stat.st_dev != keeper_stat.st_dev) {
+                        fail("on a different filesystem than " + keeper.string());
+                        continue;
+                    }
+                    if (options.method == DedupMethod::Hardlink &&
+                        ((copy_stat.st_mode & 07777) != (keeper_stat.st_mode & 07777) ||
+                         copy_stat.st_uid != keeper_stat.st_uid || copy_stat.st_gid != keeper_stat.st_gid)) {
+                        fail("mode or owner differs from " + keeper.string());
+                        continue;
+                    }
+                    bool identical = false;
+                    try {
+                        identical = copy_stat.st_size == keeper_stat.st_size && same_content(keeper, copy);
+                    } catch (const std::exception& e) {
+                        fail(e.what());
+                        continue;
+                    }
+                    if (!identical) {
+                        ++report.mismatched;
+                        continue;
+                    }
+
+                    // A copy with other names keeps its blocks alive through them
+                    uintmax_t reclaimed = copy_stat.st_nlink == 1 ? static_cast<uintmax_t>(copy_stat.st_size) : 0;
+                    if (options.dry_run) {
+                        ++report.replaced;
+                        report.bytes_reclaimed += reclaimed;
+                        continue;
+                    }
+
+                    try {
+                        replace_verified(options.method, keeper, keeper_stat, copy, copy_stat);
+                    } catch (const std::exception& e) {
+                        fail(e.what());
+                        continue;
+                    }
+                    ++report.replaced;
+                    report.bytes_reclaimed += reclaimed;
+                }
+            }
+        } catch (...) {
+            errors[id] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned id = 1; id < thread_count; ++id) {
+        threads.emplace_back(worker, id);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    DedupReport total;
+    for (auto& report : thread_reports) {
+        add(total, report);
+    }
+    return total;
+}
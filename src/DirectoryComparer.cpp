@@ -1,23 +1,183 @@
 #include "DirectoryComparer.hpp"
+#include "FileHashMapper.hpp"
+#include "TreeHash.hpp"
 #include <atomic>
+#include <memory>
+#include <set>
+#include <string_view>
+
+namespace fs = std::filesystem;
 
 // Define the external atomic variables
 std::atomic<size_t> total_files(0);
 std::atomic<size_t> total_bytes(0);
 
-// Implement other functions
-void DirectoryComparer::compare_directories(
-    const std::vector<std::filesystem::path>& directories,
+namespace {
+
+bool wanted(ComparisonMode mode, EntryStatus status) {
+    switch (mode) {
+        case ComparisonMode::All: return true;
+        case ComparisonMode::OnlySame: return status == EntryStatus::Same;
+        case ComparisonMode::OnlyDifferent: return status == EntryStatus::Different;
+        case ComparisonMode::OnlyUnique: return status == EntryStatus::Unique;
+    }
+    return false;
+}
+
+// Walks the trees in lockstep. As soon as every present copy of a path has
+// the same digest the whole subtree is settled and nothing below is visited.
+// unseen[i] is set when tree i's walk stopped somewhere above this path, so
+// a copy missing from it may simply not have been reached.
+void compare_nodes(
+    const std::vector<const MerkleNode*>& nodes,
+    const std::vector<bool>& unseen,
+    const fs::path& relative_path,
     ComparisonMode mode,
-    const std::vector<std::string>& exclude_folders
+    ComparisonResult& result
 ) {
-    for (const auto& dir : directories) {
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(dir)) {
-            if (entry.is_regular_file()) {
-                ++total_files;
-                total_bytes += entry.file_size();
+    ComparisonEntry entry;
+    entry.relative_path = relative_path;
+
+    const MerkleNode* first = nullptr;
+    size_t present_count = 0;
+    bool identical = true;
+    bool all_directories = true;
+    std::vector<bool> child_unseen(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const MerkleNode* node = nodes[i];
+        entry.present.push_back(node != nullptr);
+        child_unseen[i] = node ? !node->complete : unseen[i];
+        entry.incomplete = entry.incomplete || child_unseen[i];
+        if (!node) {
+            continue;
+        }
+        ++present_count;
+        all_directories = all_directories && node->is_directory;
+        // A partial digest proves nothing, so a stopped directory is
+        // never settled whole
+        if (!node->complete) {
+            identical = false;
+        }
+        if (!first) {
+            first = node;
+        } else if (node->is_directory != first->is_directory || node->digest != first->digest) {
+            identical = false;
+        }
+    }
+
+    entry.is_directory = all_directories;
+    entry.file_count = first->file_count;
+
+    if (present_count == 1 || identical || !all_directories) {
+        entry.status = present_count == 1 ? EntryStatus::Unique
+                     : identical ? EntryStatus::Same
+                     : EntryStatus::Different;
+        if (entry.status == EntryStatus::Same && entry.is_directory && !entry.incomplete) {
+            result.files_pruned += entry.file_count;
+        }
+        if (wanted(mode, entry.status)) {
+            result.entries.push_back(std::move(entry));
+        }
+        return;
+    }
+
+    std::set<std::string_view> child_names;
+    for (const auto* node : nodes) {
+        if (node) {
+            for (const auto& child : node->children) {
+                child_names.insert(child->name);
             }
         }
     }
+
+    for (const auto& name : child_names) {
+        std::vector<const MerkleNode*> children;
+        for (const auto* node : nodes) {
+            children.push_back(node ? node->find_child(name) : nullptr);
+        }
+        compare_nodes(children, child_unseen, relative_path == "." ? fs::path(name) : relative_path / name,
+                      mode, result);
+    }
+}
+
+} // namespace
+
+fs::path DirectoryComparer::manifest_path_for(const fs::path& manifest_dir, const fs::path& directory) {
+    std::string key = fs::absolute(directory).lexically_normal().string();
+    // Digests of large files depend on the tree hash threshold, so each
+    // threshold keeps its own manifest
+    if (tree_hash::threshold()) {
+        key += "\ntree-hash:" + std::to_string(tree_hash::threshold());
+    }
+    return manifest_dir / (FileHashMapper::compute_md5_of_buffer(key.data(), key.size()) + ".manifest");
 }
 
+ComparisonResult DirectoryComparer::compare_directories(
+    const std::vector<fs::path>& directories,
+    ComparisonMode mode,
+    const std::vector<std::string>& exclude_folders,
+    const ComparisonOptions& options
+) {
+    ComparisonResult result;
+    PhaseTimes before = instrumentation::thread_phase_times();
+    PhaseCounters counters_before = instrumentation::thread_phase_counters();
+    std::vector<MerkleTree> trees;
+    trees.reserve(directories.size());
+
+    SharedExtentCache shared_extents;
+    TreeBuildOptions build_options;
+    build_options.expand_archives = options.expand_archives;
+    build_options.shared_extents = options.detect_shared_extents ? &shared_extents : nullptr;
+    build_options.filter = options.filter.empty() ? nullptr : &options.filter;
+    build_options.cancel = options.cancel;
+
+    for (const auto& dir : directories) {
+        std::unique_ptr<MerkleTree> previous;
+        fs::path manifest_path;
+        if (!options.manifest_dir.empty()) {
+            manifest_path = manifest_path_for(options.manifest_dir, dir);
+            if (fs::exists(manifest_path)) {
+                previous = std::make_unique<MerkleTree>(MerkleTree::load_manifest(manifest_path));
+            }
+        }
+
+        trees.push_back(MerkleTree::build(dir, exclude_folders, previous.get(), build_options));
+        const MerkleTree& tree = trees.back();
+        total_files += tree.root().file_count;
+        total_bytes += tree.root().size;
+        result.files_hashed += tree.get_hashed_file_count();
+        result.files_filtered += tree.get_filtered_file_count();
+        result.files_scanned += tree.root().file_count;
+        result.bytes_scanned += tree.root().size;
+        result.complete = result.complete && tree.is_complete();
+
+        // A stopped tree is saved as well; every file in it was hashed
+        // whole, so the next run resumes rather than starting over
+        if (!manifest_path.empty()) {
+            fs::create_directories(options.manifest_dir);
+            tree.save_manifest(manifest_path);
+        }
+    }
+
+    std::vector<const MerkleNode*> roots;
+    std::vector<const MerkleTree*> tree_pointers;
+    for (const auto& tree : trees) {
+        roots.push_back(&tree.root());
+        tree_pointers.push_back(&tree);
+    }
+    {
+        ScopedPhase join(Phase::Join);
+        if (!roots.empty()) {
+            compare_nodes(roots, std::vector<bool>(roots.size(), false), ".", mode, result);
+        }
+        result.duplicate_directories = MerkleTree::find_duplicate_directories(tree_pointers);
+    }
+    if (options.detect_shared_extents) {
+        result.shared_extents = shared_extents.stats();
+        result.already_deduplicated = shared_extents.shared_groups();
+    }
+
+    result.phase_times = instrumentation::thread_phase_times() - before;
+    result.phase_counters = instrumentation::thread_phase_counters() - counters_before;
+    return result;
+}
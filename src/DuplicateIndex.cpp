@@ -0,0 +1,156 @@
+#include "DuplicateIndex.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+namespace {
+
+// First key past every path below directory: '/' + 1 == '0'
+std::string subtree_end(const std::string& directory) {
+    return directory + static_cast<char>('/' + 1);
+}
+
+} // namespace
+
+DuplicateIndex::DuplicateIndex() : indexed_bytes(0), group_count(0) {}
+
+void DuplicateIndex::erase_locked(std::map<std::string, IndexedFile>::iterator it) {
+    auto paths = paths_by_digest.find(it->second.digest);
+    if (paths != paths_by_digest.end()) {
+        if (paths->second.size() == 2) {
+            --group_count;
+        }
+        paths->second.erase(it->first);
+        if (paths->second.empty()) {
+            paths_by_digest.erase(paths);
+        }
+    }
+    indexed_bytes -= it->second.size;
+    files.erase(it);
+}
+
+void DuplicateIndex::update(const std::string& path, const IndexedFile& file) {
+    std::unique_lock lock(mutex);
+
+    auto it = files.find(path);
+    if (it != files.end()) {
+        if (it->second.digest == file.digest) {
+            indexed_bytes += file.size - it->second.size;
+            it->second = file;
+            return;
+        }
+        erase_locked(it);
+    }
+
+    files.emplace(path, file);
+    indexed_bytes += file.size;
+    auto& paths = paths_by_digest[file.digest];
+    paths.insert(path);
+    if (paths.size() == 2) {
+        ++group_count;
+    }
+}
+
+bool DuplicateIndex::remove(const std::string& path) {
+    std::unique_lock lock(mutex);
+
+    auto it = files.find(path);
+    if (it == files.end()) {
+        return false;
+    }
+    erase_locked(it);
+    return true;
+}
+
+size_t DuplicateIndex::remove_under(const std::string& directory) {
+    std::unique_lock lock(mutex);
+
+    size_t removed = 0;
+    auto it = files.lower_bound(directory + '/');
+    auto end = files.lower_bound(subtree_end(directory));
+    while (it != end) {
+        auto next = std::next(it);
+        erase_locked(it);
+        it = next;
+        ++removed;
+    }
+    return removed;
+}
+
+std::optional<IndexedFile> DuplicateIndex::find(const std::string& path) const {
+    std::shared_lock lock(mutex);
+
+    auto it = files.find(path);
+    if (it == files.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::vector<std::string> DuplicateIndex::paths_with_digest(const std::string& digest) const {
+    std::shared_lock lock(mutex);
+
+    auto it = paths_by_digest.find(digest);
+    if (it == paths_by_digest.end()) {
+        return {};
+    }
+    return std::vector<std::string>(it->second.begin(), it->second.end());
+}
+
+std::vector<std::string> DuplicateIndex::paths_under(const std::string& directory) const {
+    std::shared_lock lock(mutex);
+
+    std::vector<std::string> paths;
+    auto end = files.lower_bound(subtree_end(directory));
+    for (auto it = files.lower_bound(directory + '/'); it != end; ++it) {
+        paths.push_back(it->first);
+    }
+    return paths;
+}
+
+std::vector<std::string> DuplicateIndex::unique_under(const std::string& directory) const {
+    std::shared_lock lock(mutex);
+
+    std::string prefix = directory + '/';
+    std::vector<std::string> paths;
+    auto end = files.lower_bound(subtree_end(directory));
+    for (auto it = files.lower_bound(prefix); it != end; ++it) {
+        const auto& copies = paths_by_digest.at(it->second.digest);
+        bool contained = std::all_of(copies.begin(), copies.end(), [&](const std::string& copy) {
+            return copy.compare(0, prefix.size(), prefix) == 0;
+        });
+        if (contained) {
+            paths.push_back(it->first);
+        }
+    }
+    return paths;
+}
+
+std::vector<std::vector<std::string>> DuplicateIndex::duplicate_groups() const {
+    std::shared_lock lock(mutex);
+
+    std::vector<std::vector<std::string>> groups;
+    groups.reserve(group_count);
+    for (const auto& [digest, paths] : paths_by_digest) {
+        if (paths.size() > 1) {
+            groups.emplace_back(paths.begin(), paths.end());
+        }
+    }
+    return groups;
+}
+
+size_t DuplicateIndex::file_count() const {
+    std::shared_lock lock(mutex);
+    return files.size();
+}
+
+uintmax_t DuplicateIndex::total_size() const {
+    std::shared_lock lock(mutex);
+    return indexed_bytes;
+}
+
+size_t DuplicateIndex::duplicate_group_count() const {
+    std::shared_lock lock(mutex);
+    return group_count;
+}
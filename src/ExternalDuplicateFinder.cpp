@@ -0,0 +1,400 @@
+#include "ExternalDuplicateFinder.hpp"
+#include "FileHashMapper.hpp"
+#include "Hex.hpp"
+#include "Progress.hpp"
+#include "TarArchive.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <set>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Runs are read and written in blocks of this size, so merging k runs needs
+// about (k + 1) blocks of memory
+constexpr size_t block_bytes = 64 << 10;
+
+std::atomic<unsigned> work_dir_counter(0);
+
+void write_all(int fd, const void* data, size_t size, const fs::path& path) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Unable to write " + path.string() + ": " + std::strerror(errno));
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+size_t read_some(int fd, void* data, size_t size, const fs::path& path) {
+    char* p = static_cast<char*>(data);
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = ::read(fd, p + total, size - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Unable to read " + path.string() + ": " + std::strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    return total;
+}
+
+void read_at(int fd, void* data, size_t size, uint64_t offset, const fs::path& path) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::pread(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("Unable to read " + path.string());
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        size -= static_cast<size_t>(n);
+    }
+}
+
+int open_file(const fs::path& path, int flags) {
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open " + path.string() + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+void hex_to_bytes(const std::string& hex, unsigned char* out, size_t size) {
+    auto nibble = [](char c) {
+        return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    };
+    for (size_t i = 0; i < size && 2 * i + 1 < hex.size(); ++i) {
+        out[i] = static_cast<unsigned char>(nibble(hex[2 * i]) << 4 | nibble(hex[2 * i + 1]));
+    }
+}
+
+} // namespace
+
+size_t ExternalGroup::root_count() const {
+    std::set<size_t> seen;
+    for (const auto& member : members) {
+        seen.insert(member.root);
+    }
+    return seen.size();
+}
+
+bool ExternalDuplicateFinder::Record::operator<(const Record& other) const {
+    if (size != other.size) {
+        return size < other.size;
+    }
+    int cmp = std::memcmp(digest, other.digest, sizeof(digest));
+    if (cmp != 0) {
+        return cmp < 0;
+    }
+    if (root != other.root) {
+        return root < other.root;
+    }
+    return path_id < other.path_id;
+}
+
+// Append-only scratch file with a write buffer; reads flush it first
+class ExternalDuplicateFinder::ScratchFile {
+public:
+    explicit ScratchFile(fs::path path)
+        : path(std::move(path)), fd(open_file(this->path, O_RDWR | O_CREAT | O_TRUNC)), size(0) {
+        pending.reserve(block_bytes);
+    }
+
+    ~ScratchFile() {
+        ::close(fd);
+    }
+
+    uint64_t append(const void* data, size_t length) {
+        uint64_t offset = size;
+        if (pending.size() + length > block_bytes) {
+            flush();
+        }
+        if (length > block_bytes) {
+            write_all(fd, data, length, path);
+        } else {
+            pending.append(static_cast<const char*>(data), length);
+        }
+        size += length;
+        return offset;
+    }
+
+    void read(void* data, size_t length, uint64_t offset) {
+        flush();
+        read_at(fd, data, length, offset, path);
+    }
+
+    void flush() {
+        write_all(fd, pending.data(), pending.size(), path);
+        pending.clear();
+    }
+
+private:
+
+    fs::path path;
+    int fd;
+    uint64_t size;
+    std::string pending;
+};
+
+ExternalDuplicateFinder::ExternalDuplicateFinder(
+    std::vector<fs::path> roots,
+    std::vector<std::string> exclude_folders,
+    ExternalOptions options
+) : roots(std::move(roots)),
+    exclude_folders(std::move(exclude_folders)),
+    options(std::move(options)),
+    buffer_capacity(std::max<size_t>(1, this->options.memory_budget / sizeof(Record))),
+    fan_in(std::max<size_t>(3, this->options.memory_budget / block_bytes) - 1),
+    next_run(0),
+    next_path_id(0) {
+    fs::path scratch = this->options.scratch_dir.empty() ? fs::temp_directory_path() : this->options.scratch_dir;
+    work_dir = scratch / ("fsf-spill-" + std::to_string(::getpid()) + "-" + std::to_string(work_dir_counter++));
+    fs::create_directories(work_dir);
+    paths = std::make_unique<ScratchFile>(work_dir / "paths.bin");
+    offsets = std::make_unique<ScratchFile>(work_dir / "offsets.bin");
+}
+
+ExternalDuplicateFinder::~ExternalDuplicateFinder() {
+    paths.reset();
+    offsets.reset();
+    std::error_code ec;
+    fs::remove_all(work_dir, ec);
+}
+
+const ExternalStats& ExternalDuplicateFinder::get_stats() const {
+    return stats;
+}
+
+void ExternalDuplicateFinder::run(const std::function<void(const ExternalGroup&)>& on_group, bool include_unique) {
+    buffer.reserve(buffer_capacity);
+    for (size_t i = 0; i < roots.size(); ++i) {
+        scan_root(i);
+    }
+
+    ExternalGroup group;
+    bool open = false;
+    Record key{};
+    std::vector<std::pair<uint32_t, uint64_t>> members;
+    auto flush_group = [&]() {
+        if (!open || (members.size() < 2 && !include_unique)) {
+            return;
+        }
+        group.size = key.size;
+        group.digest = to_hex(key.digest, sizeof(key.digest));
+        group.members.clear();
+        for (const auto& [root, path_id] : members) {
+            group.members.push_back({root, read_path(path_id)});
+        }
+        on_group(group);
+    };
+    auto sink = [&](const Record& record) {
+        if (!open || record.size != key.size || std::memcmp(record.digest, key.digest, sizeof(key.digest)) != 0) {
+            flush_group();
+            key = record;
+            members.clear();
+            open = true;
+        }
+        members.emplace_back(record.root, record.path_id);
+    };
+
+    if (runs.empty()) {
+        // Everything fit in the budget: no run ever touches the disk
+        std::sort(buffer.begin(), buffer.end());
+        for (const auto& record : buffer) {
+            sink(record);
+        }
+    } else {
+        if (!buffer.empty()) {
+            spill();
+        }
+        buffer = {};
+        // Merge the oldest runs until one pass can take the rest
+        while (runs.size() > fan_in) {
+            std::vector<fs::path> inputs(runs.begin(), runs.begin() + fan_in);
+            runs.erase(runs.begin(), runs.begin() + fan_in);
+            fs::path output = next_run_path();
+            {
+                ScratchFile out(output);
+                merge(inputs, [&](const Record& record) { out.append(&record, sizeof(record)); });
+                out.flush();
+            }
+            stats.spilled_bytes += fs::file_size(output);
+            runs.push_back(output);
+            ++stats.merge_passes;
+        }
+        merge(runs, sink);
+    }
+    flush_group();
+}
+
+void ExternalDuplicateFinder::scan_root(size_t root_index) {
+    const fs::path& root = roots[root_index];
+    for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+        if (it->is_directory()) {
+            std::string name = it->path().filename().string();
+            if (std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end()) {
+                it.disable_recursion_pending();
+            } else {
+                progress::add_directory();
+            }
+            continue;
+        }
+        if (!it->is_regular_file()) {
+            continue;
+        }
+
+        if (options.expand_archives && is_tar_archive(it->path())) {
+            // Members are added once the archive has been read through; one
+            // that is not valid tar is hashed as the plain file it is
+            std::vector<TarMember> members;
+            bool expanded = true;
+            try {
+                for_each_tar_member(it->path(), [&](const TarMember& member) { members.push_back(member); });
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Warning: " << e.what() << "; hashing it as a plain file\n";
+                expanded = false;
+            }
+            if (expanded) {
+                fs::path archive = it->path().lexically_relative(root);
+                for (const TarMember& member : members) {
+                    add_file(root_index, archive_member_path(archive, member.path).string(), member.size,
+                             member.digest);
+                }
+                continue;
+            }
+        }
+        uint64_t size = it->file_size();
+        add_file(root_index, it->path().lexically_relative(root).string(), size,
+                 FileHashMapper::compute_md5(it->path()));
+    }
+}
+
+void ExternalDuplicateFinder::add_file(size_t root_index, const std::string& relative_path, uint64_t size, const std::string& digest) {
+    Record record{};
+    record.size = size;
+    record.root = static_cast<uint32_t>(root_index);
+    record.path_id = next_path_id++;
+    hex_to_bytes(digest, record.digest, sizeof(record.digest));
+
+    uint64_t location[2] = {paths->append(relative_path.data(), relative_path.size()), relative_path.size()};
+    offsets->append(location, sizeof(location));
+
+    buffer.push_back(record);
+    if (buffer.size() >= buffer_capacity) {
+        spill();
+    }
+    ++stats.files;
+    progress::add_file(size);
+}
+
+void ExternalDuplicateFinder::spill() {
+    std::sort(buffer.begin(), buffer.end());
+    fs::path output = next_run_path();
+    int fd = open_file(output, O_WRONLY | O_CREAT | O_TRUNC);
+    try {
+        write_all(fd, buffer.data(), buffer.size() * sizeof(Record), output);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    stats.spilled_bytes += buffer.size() * sizeof(Record);
+    ++stats.runs;
+    runs.push_back(output);
+    buffer.clear();
+}
+
+void ExternalDuplicateFinder::merge(const std::vector<fs::path>& inputs, const std::function<void(const Record&)>& sink) {
+    // A run being read back one block at a time
+    struct Cursor {
+        fs::path path;
+        int fd;
+        std::vector<Record> block;
+        size_t position;
+
+        bool refill() {
+            block.resize(block_bytes / sizeof(Record));
+            size_t bytes = read_some(fd, block.data(), block.size() * sizeof(Record), path);
+            block.resize(bytes / sizeof(Record));
+            position = 0;
+            return !block.empty();
+        }
+    };
+
+    std::vector<Cursor> cursors;
+    cursors.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        cursors.push_back({input, open_file(input, O_RDONLY), {}, 0});
+        ::posix_fadvise(cursors.back().fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    auto greater = [&cursors](size_t a, size_t b) {
+        return cursors[b].block[cursors[b].position] < cursors[a].block[cursors[a].position];
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    try {
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            if (cursors[i].refill()) {
+                heap.push(i);
+            }
+        }
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            Cursor& cursor = cursors[i];
+            sink(cursor.block[cursor.position]);
+            if (++cursor.position < cursor.block.size() || cursor.refill()) {
+                heap.push(i);
+            }
+        }
+    } catch (...) {
+        for (auto& cursor : cursors) {
+            ::close(cursor.fd);
+        }
+        throw;
+    }
+    for (auto& cursor : cursors) {
+        ::close(cursor.fd);
+        std::error_code ec;
+        fs::remove(cursor.path, ec);
+    }
+}
+
+fs::path ExternalDuplicateFinder::next_run_path() {
+    return work_dir / ("run-" + std::to_string(next_run++) + ".bin");
+}
+
+fs::path ExternalDuplicateFinder::read_path(uint64_t path_id) {
+    uint64_t location[2];
+    offsets->read(location, sizeof(location), path_id * sizeof(location));
+    std::string relative(location[1], '\0');
+    if (!relative.empty()) {
+        paths->read(relative.data(), relative.size(), location[0]);
+    }
+    return relative;
+}
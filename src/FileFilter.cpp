@@ -0,0 +1,117 @@
+#include "FileFilter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+// Splits "12.5M" into 12.5 and "M"; throws if no number leads
+double split_number(const std::string& text, std::string& suffix, const char* what) {
+    size_t used = 0;
+    double value;
+    try {
+        value = std::stod(text, &used);
+    } catch (const std::exception&) {
+        throw std::runtime_error(std::string("Invalid ") + what + ": " + text);
+    }
+    if (!std::isfinite(value) || value < 0) {
+        throw std::runtime_error(std::string("Invalid ") + what + ": " + text);
+    }
+    suffix = lowercase(text.substr(used));
+    return value;
+}
+
+} // namespace
+
+void FileFilter::add_extension(std::string extension) {
+    extension = lowercase(std::move(extension));
+    if (extension.empty()) {
+        return;
+    }
+    if (extension[0] != '.') {
+        extension.insert(extension.begin(), '.');
+    }
+    extensions.push_back(std::move(extension));
+}
+
+void FileFilter::set_path_pattern(const std::string& pattern) {
+    path_pattern.emplace(pattern, std::regex::ECMAScript | std::regex::optimize);
+}
+
+bool FileFilter::empty() const {
+    return !min_size && !max_size && !needs_mtime() && extensions.empty() && !path_pattern;
+}
+
+bool FileFilter::matches(const fs::path& relative_path, uintmax_t size, Time mtime) const {
+    // Cheapest checks first; the regex runs only on what survives the rest
+    if ((min_size && size < *min_size) || (max_size && size > *max_size)) {
+        return false;
+    }
+    if ((modified_after && mtime < *modified_after) || (modified_before && mtime >= *modified_before)) {
+        return false;
+    }
+    if (!extensions.empty()) {
+        std::string extension = lowercase(relative_path.extension().string());
+        if (std::find(extensions.begin(), extensions.end(), extension) == extensions.end()) {
+            return false;
+        }
+    }
+    if (path_pattern && !std::regex_search(relative_path.generic_string(), *path_pattern)) {
+        return false;
+    }
+    return true;
+}
+
+uintmax_t FileFilter::parse_size(const std::string& text) {
+    std::string suffix;
+    double value = split_number(text, suffix, "size");
+    if (suffix == "k" || suffix == "kb") {
+        value *= 1 << 10;
+    } else if (suffix == "m" || suffix == "mb") {
+        value *= 1 << 20;
+    } else if (suffix == "g" || suffix == "gb") {
+        value *= 1 << 30;
+    } else if (suffix == "t" || suffix == "tb") {
+        value *= static_cast<double>(uintmax_t(1) << 40);
+    } else if (!suffix.empty() && suffix != "b") {
+        throw std::runtime_error("Invalid size: " + text);
+    }
+    // 2^64 is exact as a double; converting anything from there up is undefined
+    if (value >= 18446744073709551616.0) {
+        throw std::runtime_error("Invalid size: " + text);
+    }
+    return static_cast<uintmax_t>(value);
+}
+
+std::chrono::seconds FileFilter::parse_duration(const std::string& text) {
+    std::string suffix;
+    double value = split_number(text, suffix, "duration");
+    double unit;
+    if (suffix == "s") {
+        unit = 1;
+    } else if (suffix == "m") {
+        unit = 60;
+    } else if (suffix == "h") {
+        unit = 3600;
+    } else if (suffix == "d") {
+        unit = 86400;
+    } else if (suffix == "w") {
+        unit = 7 * 86400;
+    } else {
+        throw std::runtime_error("Invalid duration: " + text);
+    }
+    if (value * unit >= 9223372036854775808.0) {
+        throw std::runtime_error("Invalid duration: " + text);
+    }
+    return std::chrono::seconds(static_cast<int64_t>(value * unit));
+}
@@ -2,32 +2,271 @@
 #include <openssl/err.h>
 
 #include "FileHashMapper.hpp"
+#include "Fingerprint.hpp"
+#include "Hex.hpp"
+#include "Instrumentation.hpp"
+#include "Progress.hpp"
+#include "TarArchive.hpp"
+#include "Tracer.hpp"
+#include "TreeHash.hpp"
 #include <fstream>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
 #include <algorithm>
+#include <cerrno>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
-FileHashMapper::FileHashMapper() : file_count(0), total_size(0) {}
+namespace {
 
-void FileHashMapper::process_directory(const fs::path& dir) {
-    for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-        if (entry.is_regular_file()) {
-            // Store relative paths for consistent comparison
-            std::string relative_path = fs::relative(entry.path(), dir).string();
-            file_hashes[relative_path] = compute_md5(entry.path());
-            //std::cout << "Processing file: " << entry.path() << " [Stored as: " << relative_path << "]\n";
-            ++file_count;
-            total_size += entry.file_size();
-		}
+// Files up to this size are read with a single read() and hashed in one update
+constexpr size_t small_file_limit = 16 << 10;
+constexpr size_t read_buffer_size = 64 << 10;
+
+// Files this small are keyed by their content in fingerprint mode
+constexpr uintmax_t inline_key_limit = 16;
+
+// OpenSSL 3 looks the algorithm up on every init unless it is fetched once
+const EVP_MD* md5_algorithm() {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static const EVP_MD* md = EVP_MD_fetch(nullptr, "MD5", nullptr);
+    return md ? md : EVP_md5();
+#else
+    return EVP_md5();
+#endif
+}
+
+struct ContextDeleter {
+    void operator()(EVP_MD_CTX* context) const { EVP_MD_CTX_free(context); }
+};
+
+// One digest context per thread, reinitialized for every file
+EVP_MD_CTX* thread_context() {
+    thread_local std::unique_ptr<EVP_MD_CTX, ContextDeleter> context(EVP_MD_CTX_new());
+    if (!context) {
+        throw std::runtime_error("Failed to create EVP_MD_CTX");
+    }
+    return context.get();
+}
+
+char* thread_read_buffer() {
+    thread_local std::unique_ptr<char[]> buffer(new char[read_buffer_size]);
+    return buffer.get();
+}
+
+// Reads until the buffer is full or the file ends; -1 on error
+ssize_t read_some(int fd, char* buffer, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = ::read(fd, buffer + total, size - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    return static_cast<ssize_t>(total);
+}
+
+} // namespace
+
+FileHashMapper::FileHashMapper(bool expand_archives, bool fingerprint_first)
+    : expand_archives(expand_archives), fingerprint_first(fingerprint_first), file_count(0), total_size(0) {
+    // Archive members arrive with MD5 digests only, which a fingerprint key
+    // could never be matched against
+    if (expand_archives && fingerprint_first) {
+        throw std::runtime_error("fingerprint_first cannot be combined with expand_archives");
+    }
+}
+
+void FileHashMapper::set_filter(FileFilter filter) {
+    this->filter = std::move(filter);
+}
+
+void FileHashMapper::set_cancellation(const CancellationToken* token) {
+    cancel = token;
+}
+
+bool FileHashMapper::is_complete() const {
+    return complete;
+}
+
+std::vector<std::string> FileHashMapper::get_incomplete_files() const {
+    return incomplete_files;
+}
+
+void FileHashMapper::process_directory(const fs::path& dir, const std::string& key_prefix,
+                                       const std::vector<std::string>& exclude_folders) {
+    bool filtering = !filter.empty();
+    for (auto it = fs::recursive_directory_iterator(dir); it != fs::recursive_directory_iterator(); ++it) {
+        const fs::directory_entry& entry = *it;
+        if (cancel && cancel->stop_requested()) {
+            complete = false;
+            return;
+        }
+        if (!exclude_folders.empty() && entry.is_directory()) {
+            std::string name = entry.path().filename().string();
+            if (std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end()) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (filtering && entry.is_regular_file()) {
+            // Metadata only: a rejected file is never opened
+            bool accepted;
+            {
+                ScopedPhase stat(Phase::Stat, Operation::Stat);
+                accepted = filter.matches(entry.path().lexically_relative(dir), entry.file_size(),
+                                          filter.needs_mtime() ? entry.last_write_time() : FileFilter::Time());
+            }
+            if (!accepted) {
+                ++filtered_count;
+                continue;
+            }
+        }
+        // A stop partway through a file or archive member leaves it out and
+        // ends the walk; members finished before it are kept
+        try {
+            if (expand_archives && entry.is_regular_file() && is_tar_archive(entry.path()) &&
+                add_archive_members(entry.path(), entry.path().lexically_relative(dir), key_prefix)) {
+                continue;
+            }
+            if (entry.is_regular_file()) {
+                // Store relative paths for consistent comparison
+                PathString relative_path(key_prefix + entry.path().lexically_relative(dir).string());
+                uintmax_t size;
+                {
+                    ScopedPhase stat(Phase::Stat, Operation::Stat);
+                    size = entry.file_size();
+                }
+                if (fingerprint_first) {
+                    add_fingerprinted(std::move(relative_path), entry.path(), size);
+                } else {
+                    file_hashes[relative_path] = compute_md5(entry.path(), cancel);
+                    ++strong_hash_count;
+                }
+                //std::cout << "Processing file: " << entry.path() << " [Stored as: " << relative_path << "]\n";
+                ++file_count;
+                total_size += size;
+                progress::add_file(size);
+            }
+        } catch (const OperationCancelled&) {
+            incomplete_files.push_back(key_prefix + entry.path().lexically_relative(dir).string());
+            complete = false;
+            return;
+        }
         //} else {
             //std::cout << "Skipping non-regular file: " << entry.path() << "\n";
         //}
     }
 }
 
+bool FileHashMapper::add_archive_members(const fs::path& path, const fs::path& archive,
+                                         const std::string& key_prefix) {
+    // Members are held back until the archive has been read through, so a
+    // corrupt one is hashed as a plain file without leaving members behind
+    std::vector<std::pair<PathString, TarMember>> members;
+    auto keep_members = [&] {
+        for (auto& [key, member] : members) {
+            file_hashes[std::move(key)] = std::move(member.digest);
+            ++file_count;
+            total_size += member.size;
+            progress::add_file(member.size);
+        }
+    };
+    try {
+        for_each_tar_member(path, [&](const TarMember& member) {
+            members.emplace_back(PathString(key_prefix + archive_member_path(archive, member.path).string()), member);
+        }, cancel);
+    } catch (const OperationCancelled&) {
+        keep_members();
+        throw;
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Warning: " << e.what() << "; hashing it as a plain file\n";
+        return false;
+    }
+    keep_members();
+    return true;
+}
+
+void FileHashMapper::add_fingerprinted(PathString key, const fs::path& path, uintmax_t size) {
+    // A tiny file is its own key: "=" and the content in hex, which no MD5
+    // or fingerprint key resembles, so it never needs confirming
+    if (size <= inline_key_limit) {
+        unsigned char content[inline_key_limit + 1];
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open file: " + path.string());
+        }
+        ssize_t n;
+        {
+            ScopedPhase read(Phase::Read);
+            n = read_some(fd, reinterpret_cast<char*>(content), sizeof(content));
+        }
+        ::close(fd);
+        if (n < 0) {
+            throw std::runtime_error("Unable to read file: " + path.string());
+        }
+        if (static_cast<uintmax_t>(n) <= inline_key_limit) {
+            file_hashes[key] = DigestString("=" + to_hex(content, static_cast<size_t>(n)));
+            return;
+        }
+        size = static_cast<uintmax_t>(n);   // grew since the stat; fingerprint it instead
+    }
+
+    // Whether a file is sampled depends on its size alone, so equal sizes
+    // always carry comparable fingerprints
+    bool sampled = size >= sample_min_size;
+    uint64_t fingerprint = sampled ? Fingerprint64::of_samples(path, size, cancel)
+                                   : Fingerprint64::of_file(path, cancel);
+    uintmax_t unread = 0;
+    if (sampled) {
+        uintmax_t sampled_bytes = sample_offsets(size).size() * sample_block_size;
+        ++sample_stats.files;
+        sample_stats.bytes_sampled += sampled_bytes;
+        unread = size - sampled_bytes;
+    }
+    auto [it, inserted] = fingerprints.try_emplace({size, fingerprint});
+    FingerprintOwner& owner = it->second;
+    if (inserted) {
+        std::ostringstream weak;
+        weak << std::hex << std::setw(16) << std::setfill('0') << fingerprint << ":" << std::dec << size;
+        file_hashes[key] = DigestString(weak.str());
+        owner.key = std::move(key);
+        owner.path = path;
+        owner.unread = unread;
+        if (unread) {
+            ++sample_stats.unread;
+            sample_stats.bytes_not_read += unread;
+        }
+        return;
+    }
+    if (!owner.confirmed) {
+        file_hashes[owner.key] = compute_md5(owner.path, cancel);
+        ++strong_hash_count;
+        owner.confirmed = true;
+        owner.path.clear();
+        if (owner.unread) {
+            --sample_stats.unread;
+            sample_stats.bytes_not_read -= owner.unread;
+            owner.unread = 0;
+        }
+    }
+    file_hashes[key] = compute_md5(path, cancel);
+    ++strong_hash_count;
+}
+
 size_t FileHashMapper::get_file_count() const {
     return file_count;
 }
@@ -36,48 +275,108 @@ uintmax_t FileHashMapper::get_total_size() const {
     return total_size;
 }
 
+size_t FileHashMapper::get_filtered_count() const {
+    return filtered_count;
+}
+
+size_t FileHashMapper::get_strong_hash_count() const {
+    return strong_hash_count;
+}
+
+SampleStats FileHashMapper::get_sample_stats() const {
+    return sample_stats;
+}
+
 std::unordered_map<std::string, std::string> FileHashMapper::get_file_hashes() const {
-    return file_hashes;
+    std::unordered_map<std::string, std::string> hashes;
+    hashes.reserve(file_hashes.size());
+    for (const auto& [path, digest] : file_hashes) {
+        hashes.emplace(path, digest);
+    }
+    return hashes;
 }
-std::string FileHashMapper::compute_md5(const fs::path& file_path) {
+std::string FileHashMapper::compute_md5(const fs::path& file_path, const CancellationToken* cancel) {
+    TraceSpan span("file", file_path);
     unsigned char md[EVP_MAX_MD_SIZE];
     unsigned int md_len = 0;
 
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
+    int fd;
+    {
+        ScopedPhase open(Phase::Read, Operation::Open);
+        fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
         throw std::runtime_error("Unable to open file: " + file_path.string());
     }
-
-    EVP_MD_CTX* md_ctx = EVP_MD_CTX_new();
-    if (!md_ctx) {
-        throw std::runtime_error("Failed to create EVP_MD_CTX");
+    // The size is only needed, and only fetched, while tree hashing is on
+    if (tree_hash::threshold()) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && tree_hash::applies(static_cast<uintmax_t>(st.st_size))) {
+            ::close(fd);
+            return tree_hash_file(file_path, 0, cancel);
+        }
     }
 
-    try {
-        if (!EVP_DigestInit_ex(md_ctx, EVP_md5(), nullptr)) {
-            throw std::runtime_error("EVP_DigestInit_ex failed");
-        }
+    // Read and hash latency is counted per file from the phase totals, so
+    // the chunk loop takes no extra timestamps
+    PhaseTimes opened = instrumentation::thread_phase_times();
+    uint64_t bytes_read = 0;
+    EVP_MD_CTX* md_ctx = thread_context();
+    char* buffer = thread_read_buffer();
 
-        char buffer[8192];
-        while (file.read(buffer, sizeof(buffer)) || file.gcount()) {
-            if (!EVP_DigestUpdate(md_ctx, buffer, file.gcount())) {
-                throw std::runtime_error("EVP_DigestUpdate failed");
-            }
+    // The first read asks for one byte past the small-file limit: a file
+    // that fits is then known to be complete and is hashed in one update
+    size_t chunk = small_file_limit + 1;
+    bool ok = EVP_DigestInit_ex(md_ctx, md5_algorithm(), nullptr);
+    while (ok) {
+        ssize_t n;
+        {
+            ScopedPhase read(Phase::Read);
+            n = read_some(fd, buffer, chunk);
         }
-
-        if (!EVP_DigestFinal_ex(md_ctx, md, &md_len)) {
-            throw std::runtime_error("EVP_DigestFinal_ex failed");
+        if (n < 0) {
+            ::close(fd);
+            throw std::runtime_error("Unable to read file: " + file_path.string());
         }
-    } catch (...) {
-        EVP_MD_CTX_free(md_ctx);
-        throw;
+        if (n > 0) {
+            ScopedPhase hash(Phase::Hash);
+            ok = EVP_DigestUpdate(md_ctx, buffer, static_cast<size_t>(n));
+            bytes_read += static_cast<uint64_t>(n);
+        }
+        if (static_cast<size_t>(n) < chunk) {
+            break;
+        }
+        if (cancel && cancel->stop_requested()) {
+            ::close(fd);
+            throw OperationCancelled();
+        }
+        chunk = read_buffer_size;
+    }
+    ::close(fd);
+    {
+        ScopedPhase hash(Phase::Hash);
+        ok = ok && EVP_DigestFinal_ex(md_ctx, md, &md_len);
+    }
+    if (!ok) {
+        throw std::runtime_error("MD5 digest failed");
     }
 
-    EVP_MD_CTX_free(md_ctx);
+    if (instrumentation::stats_enabled()) {
+        PhaseTimes spent = instrumentation::thread_phase_times() - opened;
+        instrumentation::record(Operation::Read, spent[Phase::Read], bytes_read);
+        instrumentation::record(Operation::Hash, spent[Phase::Hash], bytes_read);
+    }
+    return to_hex(md, md_len);
+}
+
+std::string FileHashMapper::compute_md5_of_buffer(const void* data, size_t size) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
 
-    std::ostringstream oss;
-    for (unsigned int i = 0; i < md_len; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(md[i]);
+    EVP_MD_CTX* md_ctx = thread_context();
+    if (!EVP_DigestInit_ex(md_ctx, md5_algorithm(), nullptr) || !EVP_DigestUpdate(md_ctx, data, size) ||
+        !EVP_DigestFinal_ex(md_ctx, md, &md_len)) {
+        throw std::runtime_error("EVP_Digest failed");
     }
-    return oss.str();
+    return to_hex(md, md_len);
 }
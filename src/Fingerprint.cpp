@@ -0,0 +1,271 @@
+#include "Fingerprint.hpp"
+#include "Instrumentation.hpp"
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+constexpr size_t read_buffer_size = 64 << 10;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t load64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t load32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t lane_round(uint64_t lane, uint64_t input) {
+    lane += input * prime2;
+    lane = rotl(lane, 31);
+    return lane * prime1;
+}
+
+inline uint64_t merge_round(uint64_t hash, uint64_t lane) {
+    hash ^= lane_round(0, lane);
+    return hash * prime1 + prime4;
+}
+
+// Consumes whole 32-byte stripes; the lanes carry no dependency on each
+// other, so the four multiplies of a stripe issue in parallel
+inline const unsigned char* consume_stripes(uint64_t* lanes, const unsigned char* p, const unsigned char* end) {
+    uint64_t l0 = lanes[0], l1 = lanes[1], l2 = lanes[2], l3 = lanes[3];
+    for (; end - p >= 32; p += 32) {
+        l0 = lane_round(l0, load64(p));
+        l1 = lane_round(l1, load64(p + 8));
+        l2 = lane_round(l2, load64(p + 16));
+        l3 = lane_round(l3, load64(p + 24));
+    }
+    lanes[0] = l0;
+    lanes[1] = l1;
+    lanes[2] = l2;
+    lanes[3] = l3;
+    return p;
+}
+
+// SplitMix64, a small generator whose output depends only on its state
+inline uint64_t split_mix(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+} // namespace
+
+std::vector<uintmax_t> sample_offsets(uintmax_t size) {
+    std::vector<uintmax_t> offsets;
+    if (size < 2 * sample_block_size) {
+        return {0};
+    }
+    offsets.push_back(0);
+    // Interior blocks are block-aligned and never overlap the head or tail
+    uintmax_t slots = size / sample_block_size;
+    if (slots > 2) {
+        uint64_t state = size;
+        for (size_t i = 0; i < sample_interior_blocks; ++i) {
+            offsets.push_back((1 + split_mix(state) % (slots - 2)) * sample_block_size);
+        }
+    }
+    offsets.push_back(size - sample_block_size);
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    return offsets;
+}
+
+Fingerprint64::Fingerprint64(uint64_t seed)
+    : lanes{seed + prime1 + prime2, seed + prime2, seed, seed - prime1}, seed(seed) {}
+
+void Fingerprint64::update(const void* data, size_t size) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    total += size;
+
+    if (pending_size + size < sizeof(pending)) {
+        std::memcpy(pending + pending_size, p, size);
+        pending_size += size;
+        return;
+    }
+    if (pending_size) {
+        size_t fill = sizeof(pending) - pending_size;
+        std::memcpy(pending + pending_size, p, fill);
+        consume_stripes(lanes, pending, pending + sizeof(pending));
+        p += fill;
+        pending_size = 0;
+    }
+    p = consume_stripes(lanes, p, end);
+    pending_size = static_cast<size_t>(end - p);
+    std::memcpy(pending, p, pending_size);
+}
+
+uint64_t Fingerprint64::digest() const {
+    uint64_t hash;
+    if (total >= 32) {
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (uint64_t lane : lanes) {
+            hash = merge_round(hash, lane);
+        }
+    } else {
+        hash = seed + prime5;
+    }
+    hash += total;
+
+    const unsigned char* p = pending;
+    const unsigned char* end = pending + pending_size;
+    for (; end - p >= 8; p += 8) {
+        hash ^= lane_round(0, load64(p));
+        hash = rotl(hash, 27) * prime1 + prime4;
+    }
+    if (end - p >= 4) {
+        hash ^= static_cast<uint64_t>(load32(p)) * prime1;
+        hash = rotl(hash, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        hash ^= static_cast<uint64_t>(*p) * prime5;
+        hash = rotl(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t Fingerprint64::of_buffer(const void* data, size_t size, uint64_t seed) {
+    Fingerprint64 fingerprint(seed);
+    fingerprint.update(data, size);
+    return fingerprint.digest();
+}
+
+uint64_t Fingerprint64::of_file(const fs::path& path, const CancellationToken* cancel) {
+    TraceSpan span("fingerprint", path);
+    int fd;
+    {
+        ScopedPhase open(Phase::Read, Operation::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open file: " + path.string());
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    PhaseTimes opened = instrumentation::thread_phase_times();
+    uint64_t bytes_read = 0;
+    Fingerprint64 fingerprint;
+    // Thread-local so the hot path does no allocation per file
+    thread_local std::unique_ptr<char[]> buffer(new char[read_buffer_size]);
+    for (;;) {
+        ssize_t n;
+        {
+            ScopedPhase read(Phase::Read);
+            n = ::read(fd, buffer.get(), read_buffer_size);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ::close(fd);
+            throw std::runtime_error("Unable to read file: " + path.string());
+        }
+        if (n == 0) {
+            break;
+        }
+        if (cancel && cancel->stop_requested()) {
+            ::close(fd);
+            throw OperationCancelled();
+        }
+        ScopedPhase hash(Phase::Hash);
+        fingerprint.update(buffer.get(), static_cast<size_t>(n));
+        bytes_read += static_cast<uint64_t>(n);
+    }
+    ::close(fd);
+
+    if (instrumentation::stats_enabled()) {
+        PhaseTimes spent = instrumentation::thread_phase_times() - opened;
+        instrumentation::record(Operation::Read, spent[Phase::Read], bytes_read);
+        instrumentation::record(Operation::Hash, spent[Phase::Hash], bytes_read);
+    }
+    return fingerprint.digest();
+}
+
+uint64_t Fingerprint64::of_samples(const fs::path& path, uintmax_t size, const CancellationToken* cancel) {
+    TraceSpan span("sample", path);
+    int fd;
+    {
+        ScopedPhase open(Phase::Read, Operation::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open file: " + path.string());
+    }
+    // The blocks are scattered, so readahead past each one would be wasted
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    PhaseTimes opened = instrumentation::thread_phase_times();
+    uint64_t bytes_read = 0;
+    Fingerprint64 fingerprint(size);
+    thread_local std::unique_ptr<char[]> buffer(new char[sample_block_size]);
+    for (uintmax_t offset : sample_offsets(size)) {
+        if (cancel && cancel->stop_requested()) {
+            ::close(fd);
+            throw OperationCancelled();
+        }
+        size_t length = static_cast<size_t>(std::min<uintmax_t>(sample_block_size, size - offset));
+        size_t got = 0;
+        {
+            ScopedPhase read(Phase::Read);
+            while (got < length) {
+                ssize_t n = ::pread(fd, buffer.get() + got, length - got, static_cast<off_t>(offset + got));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                got += static_cast<size_t>(n);
+            }
+        }
+        if (got < length) {
+            ::close(fd);
+            throw std::runtime_error("Unable to read file: " + path.string());
+        }
+        ScopedPhase hash(Phase::Hash);
+        fingerprint.update(buffer.get(), length);
+        bytes_read += length;
+    }
+    ::close(fd);
+
+    if (instrumentation::stats_enabled()) {
+        PhaseTimes spent = instrumentation::thread_phase_times() - opened;
+        instrumentation::record(Operation::Read, spent[Phase::Read], bytes_read);
+        instrumentation::record(Operation::Hash, spent[Phase::Hash], bytes_read);
+    }
+    return fingerprint.digest();
+}
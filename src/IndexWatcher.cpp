@@ -0,0 +1,328 @@
+#include "IndexWatcher.hpp"
+#include "FileHashMapper.hpp"
+
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// IN_MODIFY catches writers that keep the file open, such as logs and mmap
+// writers, which never send IN_CLOSE_WRITE; the debounce coalesces their
+// stream of events, and max_debounce_intervals bounds how stale they get
+const uint32_t watch_mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                            IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_ONLYDIR;
+
+// A path that keeps changing is still rehashed after this many intervals
+const int max_debounce_intervals = 10;
+
+int64_t mtime_of(const fs::directory_entry& entry, std::error_code& ec) {
+    return static_cast<int64_t>(entry.last_write_time(ec).time_since_epoch().count());
+}
+
+} // namespace
+
+IndexWatcher::IndexWatcher(
+    std::vector<fs::path> roots,
+    std::vector<std::string> exclude_folders,
+    std::chrono::milliseconds debounce
+) : roots(std::move(roots)),
+    exclude_folders(std::move(exclude_folders)),
+    debounce(debounce),
+    inotify_fd(-1),
+    wake_fd(-1),
+    needs_resync(false),
+    running(false),
+    rehashed_file_count(0) {}
+
+IndexWatcher::~IndexWatcher() {
+    stop();
+}
+
+void IndexWatcher::start() {
+    if (running) {
+        return;
+    }
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        throw std::runtime_error(std::string("inotify_init1 failed: ") + std::strerror(errno));
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+        throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(errno));
+    }
+
+    // Watches go in before the walk so nothing created meanwhile is missed
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& root : roots) {
+        if (!fs::is_directory(root)) {
+            stop();
+            throw std::runtime_error("Not a directory: " + root.string());
+        }
+        std::vector<fs::path> files;
+        add_tree(root, files);
+        for (const auto& file : files) {
+            mark_pending(file.string(), now);
+        }
+    }
+    flush(true);
+
+    running = true;
+    watch_thread = std::thread(&IndexWatcher::run, this);
+}
+
+void IndexWatcher::stop() {
+    if (running) {
+        running = false;
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write(wake_fd, &one, sizeof(one));
+        watch_thread.join();
+    }
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+        wake_fd = -1;
+    }
+    watch_paths.clear();
+    watch_descriptors.clear();
+}
+
+void IndexWatcher::set_update_callback(std::function<void(const WatchUpdate&)> callback) {
+    update_callback = std::move(callback);
+}
+
+const DuplicateIndex& IndexWatcher::index() const {
+    return file_index;
+}
+
+size_t IndexWatcher::get_rehashed_file_count() const {
+    return rehashed_file_count;
+}
+
+void IndexWatcher::run() {
+    while (running) {
+        int timeout = pending.empty() && !needs_resync ? -1 : static_cast<int>(debounce.count());
+        pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            read_events();
+        }
+        if (needs_resync) {
+            resync();
+        }
+        flush(false);
+    }
+}
+
+void IndexWatcher::read_events() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    auto now = std::chrono::steady_clock::now();
+
+    for (;;) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+
+        for (char* p = buffer; p < buffer + length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                needs_resync = true;
+                continue;
+            }
+
+            auto watched = watch_paths.find(event->wd);
+            if (watched == watch_paths.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watch_descriptors.erase(watched->second);
+                watch_paths.erase(watched);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+
+            std::string name = event->name;
+            std::string path = (fs::path(watched->second) / name).string();
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    if (std::find(exclude_folders.begin(), exclude_folders.end(), name) == exclude_folders.end()) {
+                        std::vector<fs::path> files;
+                        add_tree(path, files);
+                        for (const auto& file : files) {
+                            mark_pending(file.string(), now);
+                        }
+                    }
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    remove_tree(path);
+                }
+            } else {
+                mark_pending(path, now);
+            }
+        }
+    }
+}
+
+void IndexWatcher::add_tree(const fs::path& dir, std::vector<fs::path>& files) {
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(), watch_mask);
+    if (wd < 0) {
+        // Out of watches or the directory vanished; a later resync covers it
+        return;
+    }
+    auto old = watch_paths.find(wd);
+    if (old != watch_paths.end() && old->second != dir.string()) {
+        watch_descriptors.erase(old->second);
+    }
+    watch_paths[wd] = dir.string();
+    watch_descriptors[dir.string()] = wd;
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.is_directory(ec)) {
+            std::string name = entry.path().filename().string();
+            if (!entry.is_symlink(ec) &&
+                std::find(exclude_folders.begin(), exclude_folders.end(), name) == exclude_folders.end()) {
+                add_tree(entry.path(), files);
+            }
+        } else if (entry.is_regular_file(ec)) {
+            files.push_back(entry.path());
+        }
+    }
+}
+
+void IndexWatcher::remove_tree(const std::string& dir) {
+    size_t removed = file_index.remove_under(dir);
+
+    std::string prefix = dir + '/';
+    for (auto it = pending.begin(); it != pending.end();) {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? pending.erase(it) : std::next(it);
+    }
+
+    // A moved-away directory keeps its watches; drop them so events under
+    // the old name are not misattributed
+    for (auto it = watch_descriptors.begin(); it != watch_descriptors.end();) {
+        if (it->first == dir || it->first.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(inotify_fd, it->second);
+            watch_paths.erase(it->second);
+            it = watch_descriptors.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (removed > 0 && update_callback) {
+        update_callback({0, removed, file_index.file_count(), file_index.duplicate_group_count()});
+    }
+}
+
+void IndexWatcher::mark_pending(const std::string& path, std::chrono::steady_clock::time_point now) {
+    auto [it, inserted] = pending.try_emplace(path, PendingChange{now, now});
+    if (!inserted) {
+        it->second.last_event = now;
+    }
+}
+
+// After an event queue overflow nothing about the tree can be trusted: walk
+// it again and let the size/mtime check in refresh_file skip unchanged files
+void IndexWatcher::resync() {
+    needs_resync = false;
+    auto now = std::chrono::steady_clock::now();
+
+    std::unordered_set<std::string> seen;
+    for (const auto& root : roots) {
+        std::vector<fs::path> files;
+        add_tree(root, files);
+        for (const auto& file : files) {
+            seen.insert(file.string());
+            mark_pending(file.string(), now);
+        }
+        for (const auto& path : file_index.paths_under(root.string())) {
+            if (!seen.count(path)) {
+                mark_pending(path, now);
+            }
+        }
+    }
+}
+
+void IndexWatcher::flush(bool force) {
+    auto now = std::chrono::steady_clock::now();
+    WatchUpdate update;
+
+    for (auto it = pending.begin(); it != pending.end();) {
+        bool quiet = now - it->second.last_event >= debounce;
+        bool overdue = now - it->second.first_event >= debounce * max_debounce_intervals;
+        if (!force && !quiet && !overdue) {
+            ++it;
+            continue;
+        }
+
+        if (refresh_file(it->first)) {
+            ++update.rehashed;
+        } else if (!fs::exists(it->first) && file_index.remove(it->first)) {
+            ++update.removed;
+        }
+        it = pending.erase(it);
+    }
+
+    if ((update.rehashed > 0 || update.removed > 0) && update_callback) {
+        update.file_count = file_index.file_count();
+        update.duplicate_groups = file_index.duplicate_group_count();
+        update_callback(update);
+    }
+}
+
+// Returns true when the file was read again
+bool IndexWatcher::refresh_file(const std::string& path) {
+    std::error_code ec;
+    fs::directory_entry entry(path, ec);
+    if (ec || !entry.is_regular_file(ec)) {
+        return false;
+    }
+
+    IndexedFile file;
+    file.size = entry.file_size(ec);
+    file.mtime = mtime_of(entry, ec);
+    if (ec) {
+        return false;
+    }
+
+    auto existing = file_index.find(path);
+    if (existing && existing->size == file.size && existing->mtime == file.mtime) {
+        return false;
+    }
+
+    try {
+        file.digest = FileHashMapper::compute_md5(path);
+    } catch (const std::exception&) {
+        // Removed or unreadable between the event and now
+        return false;
+    }
+    file_index.update(path, file);
+    ++rehashed_file_count;
+    return true;
+}
@@ -0,0 +1,236 @@
+#include "Instrumentation.hpp"
+#include "ThreadSlots.hpp"
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+thread_local PhaseTimes thread_times;
+thread_local PhaseCounters thread_counters_by_phase;
+
+#if FSF_STATS
+
+std::atomic<bool> stats_on(false);
+
+struct OperationCounters {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> total_nanoseconds{0};
+    std::atomic<uint64_t> max_nanoseconds{0};
+    std::array<std::atomic<uint64_t>, latency_bucket_count> buckets{};
+};
+
+// One per thread; the atomics let collect_stats() read while scans run
+struct ThreadCounters {
+    std::array<OperationCounters, operation_count> operations;
+};
+
+using CounterSlots = ThreadSlots<ThreadCounters>;
+
+size_t latency_bucket(uint64_t nanoseconds) {
+    if (nanoseconds == 0) {
+        return 0;
+    }
+    size_t bucket = 64 - static_cast<size_t>(__builtin_clzll(nanoseconds));
+    return std::min(bucket, latency_bucket_count - 1);
+}
+
+#endif
+
+} // namespace
+
+const char* phase_name(Phase phase) {
+    switch (phase) {
+        case Phase::Walk: return "walk";
+        case Phase::Stat: return "stat";
+        case Phase::Read: return "read";
+        case Phase::Hash: return "hash";
+        case Phase::Join: return "join";
+    }
+    return "unknown";
+}
+
+const char* operation_name(Operation operation) {
+    switch (operation) {
+        case Operation::Open: return "open";
+        case Operation::Stat: return "stat";
+        case Operation::Read: return "read";
+        case Operation::Hash: return "hash";
+    }
+    return "unknown";
+}
+
+PhaseTimes& PhaseTimes::operator+=(const PhaseTimes& other) {
+    for (size_t i = 0; i < phase_count; ++i) {
+        nanoseconds[i] += other.nanoseconds[i];
+    }
+    return *this;
+}
+
+PhaseTimes PhaseTimes::operator-(const PhaseTimes& other) const {
+    PhaseTimes difference;
+    for (size_t i = 0; i < phase_count; ++i) {
+        difference.nanoseconds[i] = nanoseconds[i] - other.nanoseconds[i];
+    }
+    return difference;
+}
+
+PerfSample PhaseCounters::total() const {
+    PerfSample sum;
+    for (const auto& sample : samples) {
+        sum += sample;
+    }
+    return sum;
+}
+
+PhaseCounters& PhaseCounters::operator+=(const PhaseCounters& other) {
+    for (size_t i = 0; i < phase_count; ++i) {
+        samples[i] += other.samples[i];
+    }
+    return *this;
+}
+
+PhaseCounters PhaseCounters::operator-(const PhaseCounters& other) const {
+    PhaseCounters difference;
+    for (size_t i = 0; i < phase_count; ++i) {
+        difference.samples[i] = samples[i] - other.samples[i];
+    }
+    return difference;
+}
+
+uint64_t OperationStats::percentile_nanoseconds(double p) const {
+    if (count == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < latency_bucket_count; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            uint64_t upper = b == 0 ? 0 : (uint64_t{1} << b) - 1;
+            return std::min(upper, max_nanoseconds);
+        }
+    }
+    return max_nanoseconds;
+}
+
+OperationStats& OperationStats::operator+=(const OperationStats& other) {
+    count += other.count;
+    bytes += other.bytes;
+    total_nanoseconds += other.total_nanoseconds;
+    max_nanoseconds = std::max(max_nanoseconds, other.max_nanoseconds);
+    for (size_t b = 0; b < latency_bucket_count; ++b) {
+        buckets[b] += other.buckets[b];
+    }
+    return *this;
+}
+
+ScopedPhase::ScopedPhase(Phase phase) : ScopedPhase(phase, Operation::Open) {
+    counted = false;
+}
+
+ScopedPhase::ScopedPhase(Phase phase, Operation operation)
+    : phase(phase),
+      operation(operation),
+      counted(true),
+      profiled(perf::read_thread_counters(start_counters)),
+      start(std::chrono::steady_clock::now()) {}
+
+ScopedPhase::~ScopedPhase() {
+    auto end = std::chrono::steady_clock::now();
+    auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    thread_times[phase] += elapsed;
+    if (counted) {
+        instrumentation::record(operation, elapsed);
+    }
+    if (trace::enabled()) {
+        trace::record(counted ? operation_name(operation) : phase_name(phase), start, end);
+    }
+    PerfSample end_counters;
+    if (profiled && perf::read_thread_counters(end_counters)) {
+        thread_counters_by_phase[phase] += end_counters - start_counters;
+    }
+}
+
+namespace instrumentation {
+
+PhaseTimes thread_phase_times() {
+    return thread_times;
+}
+
+void add_phase_time(Phase phase, uint64_t nanoseconds) {
+    thread_times[phase] += nanoseconds;
+}
+
+PhaseCounters thread_phase_counters() {
+    return thread_counters_by_phase;
+}
+
+void add_phase_counters(Phase phase, const PerfSample& sample) {
+    thread_counters_by_phase[phase] += sample;
+}
+
+#if FSF_STATS
+
+void set_stats_enabled(bool enabled) {
+    stats_on.store(enabled, std::memory_order_relaxed);
+}
+
+bool stats_enabled() {
+    return stats_on.load(std::memory_order_relaxed);
+}
+
+void record(Operation operation, uint64_t nanoseconds, uint64_t bytes) {
+    if (!stats_enabled()) {
+        return;
+    }
+    OperationCounters& counters = CounterSlots::local().operations[static_cast<size_t>(operation)];
+    single_writer_add(counters.count, 1);
+    single_writer_add(counters.bytes, bytes);
+    single_writer_add(counters.total_nanoseconds, nanoseconds);
+    single_writer_add(counters.buckets[latency_bucket(nanoseconds)], 1);
+    if (nanoseconds > counters.max_nanoseconds.load(std::memory_order_relaxed)) {
+        counters.max_nanoseconds.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+ScanStats collect_stats() {
+    ScanStats stats;
+    CounterSlots::for_each([&stats](const ThreadCounters& slot) {
+        for (size_t op = 0; op < operation_count; ++op) {
+            const OperationCounters& counters = slot.operations[op];
+            OperationStats snapshot;
+            snapshot.count = counters.count.load(std::memory_order_relaxed);
+            snapshot.bytes = counters.bytes.load(std::memory_order_relaxed);
+            snapshot.total_nanoseconds = counters.total_nanoseconds.load(std::memory_order_relaxed);
+            snapshot.max_nanoseconds = counters.max_nanoseconds.load(std::memory_order_relaxed);
+            for (size_t b = 0; b < latency_bucket_count; ++b) {
+                snapshot.buckets[b] = counters.buckets[b].load(std::memory_order_relaxed);
+            }
+            stats.operations[op] += snapshot;
+        }
+    });
+    return stats;
+}
+
+void reset_stats() {
+    CounterSlots::for_each([](ThreadCounters& slot) {
+        for (auto& counters : slot.operations) {
+            counters.count.store(0, std::memory_order_relaxed);
+            counters.bytes.store(0, std::memory_order_relaxed);
+            counters.total_nanoseconds.store(0, std::memory_order_relaxed);
+            counters.max_nanoseconds.store(0, std::memory_order_relaxed);
+            for (auto& bucket : counters.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    });
+}
+
+#endif
+
+} // namespace instrumentation
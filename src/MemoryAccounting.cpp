@@ -0,0 +1,86 @@
+#include "MemoryAccounting.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <string>
+
+namespace {
+
+struct CategoryCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> deallocations{0};
+    std::atomic<uint64_t> live_bytes{0};
+    std::atomic<uint64_t> peak_bytes{0};
+};
+
+// Shared rather than per thread: memory is often freed by a different
+// thread than allocated it, and an allocation already costs far more than
+// these few atomics
+std::array<CategoryCounters, memory_category_count> counters;
+
+// Reads a "Key:   123 kB" line from /proc/self/status
+uint64_t status_kilobytes(const std::string& key) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':') {
+            return std::stoull(line.substr(key.size() + 1));
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+const char* memory_category_name(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::Paths: return "paths";
+        case MemoryCategory::Digests: return "digests";
+        case MemoryCategory::Index: return "index";
+        case MemoryCategory::Buffers: return "buffers";
+    }
+    return "unknown";
+}
+
+namespace memory {
+
+void note_allocation(MemoryCategory category, size_t bytes) {
+    CategoryCounters& c = counters[static_cast<size_t>(category)];
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    uint64_t live = c.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    uint64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !c.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void note_deallocation(MemoryCategory category, size_t bytes) {
+    CategoryCounters& c = counters[static_cast<size_t>(category)];
+    c.deallocations.fetch_add(1, std::memory_order_relaxed);
+    c.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemoryUsage usage() {
+    MemoryUsage result;
+    for (size_t i = 0; i < memory_category_count; ++i) {
+        result.categories[i].allocations = counters[i].allocations.load(std::memory_order_relaxed);
+        result.categories[i].deallocations = counters[i].deallocations.load(std::memory_order_relaxed);
+        result.categories[i].live_bytes = counters[i].live_bytes.load(std::memory_order_relaxed);
+        result.categories[i].peak_bytes = counters[i].peak_bytes.load(std::memory_order_relaxed);
+    }
+    result.peak_rss_bytes = status_kilobytes("VmHWM") * 1024;
+    result.current_rss_bytes = status_kilobytes("VmRSS") * 1024;
+    return result;
+}
+
+void reset_peaks() {
+    for (auto& c : counters) {
+        c.peak_bytes.store(c.live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    // Writing 5 resets VmHWM (Linux 4.0+); harmless where unsupported
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if (clear_refs) {
+        clear_refs << "5";
+    }
+}
+
+} // namespace memory
@@ -0,0 +1,543 @@
+#include "MerkleTree.hpp"
+#include "FileFilter.hpp"
+#include "FileHashMapper.hpp"
+#include "Instrumentation.hpp"
+#include "Progress.hpp"
+#include "SharedExtents.hpp"
+#include "TarArchive.hpp"
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const manifest_magic = "fsf-manifest";
+const int manifest_version = 1;
+
+// Children are length-prefixed so names containing newlines or digits cannot
+// make two different listings serialize to the same bytes.
+std::string directory_digest(const MerkleNode& node) {
+    std::string listing;
+    for (const auto& child : node.children) {
+        listing += child->is_directory ? 'd' : 'f';
+        listing += std::to_string(child->name.size());
+        listing += ':';
+        listing += child->name;
+        listing += child->digest;
+        listing += '\n';
+    }
+    return FileHashMapper::compute_md5_of_buffer(listing.data(), listing.size());
+}
+
+bool is_excluded(const std::string& name, const std::vector<std::string>& exclude_folders) {
+    return std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end();
+}
+
+// Judged on metadata alone, before anything is opened
+bool accepted(const FileFilter& filter, const fs::path& root, const fs::directory_entry& entry) {
+    ScopedPhase stat(Phase::Stat, Operation::Stat);
+    return filter.matches(entry.path().lexically_relative(root), entry.file_size(),
+                          filter.needs_mtime() ? entry.last_write_time() : FileFilter::Time());
+}
+
+// Sorts and totals a directory assembled out of order, then digests it
+void finish_directory(MerkleNode& node) {
+    node.size = 0;
+    node.file_count = 0;
+    for (auto& child : node.children) {
+        if (child->is_directory) {
+            finish_directory(*child);
+        }
+        node.size += child->size;
+        node.file_count += child->file_count;
+    }
+    std::sort(node.children.begin(), node.children.end(),
+              [](const auto& a, const auto& b) { return a->name < b->name; });
+    ScopedPhase hash(Phase::Hash);
+    node.digest = directory_digest(node);
+}
+
+// The members of a tar archive as a directory tree. Members arrive in
+// archive order, so directories are looked up by path while it is built; a
+// member stored twice keeps its last copy, as extraction would. A stop
+// partway keeps the members finished so far and marks the archive and
+// every directory in it incomplete, since any of them may lack members.
+std::unique_ptr<MerkleNode> build_archive(const fs::path& archive, std::string name, size_t& hashed_file_count,
+                                          const CancellationToken* cancel) {
+    auto node = std::make_unique<MerkleNode>();
+    node->name = std::move(name);
+    node->is_directory = true;
+
+    std::unordered_map<std::string, MerkleNode*> nodes;
+    try {
+        for_each_tar_member(archive, [&](const TarMember& member) {
+            MerkleNode* parent = node.get();
+            std::string prefix;
+            fs::path member_path(member.path);
+            auto last = std::prev(member_path.end());
+            for (auto it = member_path.begin(); it != last; ++it) {
+                prefix += prefix.empty() ? it->string() : '/' + it->string();
+                MerkleNode*& dir = nodes[prefix];
+                if (!dir) {
+                    auto child = std::make_unique<MerkleNode>();
+                    child->name = it->string();
+                    child->is_directory = true;
+                    dir = child.get();
+                    parent->children.push_back(std::move(child));
+                } else if (!dir->is_directory) {
+                    return;
+                }
+                parent = dir;
+            }
+
+            MerkleNode*& file = nodes[member.path];
+            if (file && file->is_directory) {
+                return;
+            }
+            if (!file) {
+                auto child = std::make_unique<MerkleNode>();
+                child->name = last->string();
+                file = child.get();
+                parent->children.push_back(std::move(child));
+            }
+            file->file_count = 1;
+            file->size = member.size;
+            file->mtime = member.mtime;
+            file->digest = member.digest;
+            ++hashed_file_count;
+            progress::add_file(member.size);
+        }, cancel);
+    } catch (const OperationCancelled&) {
+        node->complete = false;
+        for (auto& [path, member] : nodes) {
+            if (member && member->is_directory) {
+                member->complete = false;
+            }
+        }
+    }
+
+    finish_directory(*node);
+    return node;
+}
+
+std::unique_ptr<MerkleNode> build_directory(
+    const fs::path& root,
+    const fs::path& dir,
+    std::string name,
+    const std::vector<std::string>& exclude_folders,
+    const MerkleNode* previous,
+    size_t& hashed_file_count,
+    size_t& filtered_file_count,
+    const TreeBuildOptions& options
+) {
+    TraceSpan span("directory", dir);
+    auto node = std::make_unique<MerkleNode>();
+    node->name = std::move(name);
+    node->is_directory = true;
+
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (options.cancel && options.cancel->stop_requested()) {
+            node->complete = false;
+            break;
+        }
+        std::string child_name = entry.path().filename().string();
+        const MerkleNode* previous_child = previous ? previous->find_child(child_name) : nullptr;
+
+        if (entry.is_directory()) {
+            // Directory symlinks are skipped like recursive_directory_iterator does
+            if (entry.is_symlink() || is_excluded(child_name, exclude_folders)) {
+                continue;
+            }
+            if (previous_child && !previous_child->is_directory) {
+                previous_child = nullptr;
+            }
+            auto child = build_directory(root, entry.path(), child_name, exclude_folders,
+                                         previous_child, hashed_file_count, filtered_file_count, options);
+            node->size += child->size;
+            node->file_count += child->file_count;
+            bool stopped = !child->complete;
+            node->children.push_back(std::move(child));
+            if (stopped) {
+                node->complete = false;
+                break;
+            }
+        } else if (options.filter && entry.is_regular_file() && !accepted(*options.filter, root, entry)) {
+            ++filtered_file_count;
+        } else if (entry.is_regular_file()) {
+            if (options.expand_archives && is_tar_archive(entry.path())) {
+                // An archive that cannot be read as tar is hashed as the plain file it is
+                std::unique_ptr<MerkleNode> child;
+                size_t hashed_before = hashed_file_count;
+                try {
+                    child = build_archive(entry.path(), child_name + archive_member_separator, hashed_file_count,
+                                          options.cancel);
+                } catch (const std::runtime_error& e) {
+                    std::cerr << "Warning: " << e.what() << "; hashing it as a plain file\n";
+                    hashed_file_count = hashed_before;
+                }
+                if (child) {
+                    node->size += child->size;
+                    node->file_count += child->file_count;
+                    bool stopped = !child->complete;
+                    node->children.push_back(std::move(child));
+                    if (stopped) {
+                        node->complete = false;
+                        break;
+                    }
+                    continue;
+                }
+            }
+
+            auto child = std::make_unique<MerkleNode>();
+            child->name = std::move(child_name);
+            child->file_count = 1;
+            {
+                ScopedPhase stat(Phase::Stat, Operation::Stat);
+                child->size = entry.file_size();
+                child->mtime = static_cast<int64_t>(entry.last_write_time().time_since_epoch().count());
+            }
+
+            // A file stopped partway is left out rather than given a wrong digest
+            try {
+                if (previous_child && !previous_child->is_directory &&
+                    previous_child->size == child->size && previous_child->mtime == child->mtime) {
+                    child->digest = previous_child->digest;
+                } else if (options.shared_extents) {
+                    bool read = false;
+                    child->digest = options.shared_extents->digest(entry.path(), child->size, read, options.cancel);
+                    hashed_file_count += read;
+                } else {
+                    child->digest = FileHashMapper::compute_md5(entry.path(), options.cancel);
+                    ++hashed_file_count;
+                }
+            } catch (const OperationCancelled&) {
+                node->complete = false;
+                break;
+            }
+
+            progress::add_file(child->size);
+            node->size += child->size;
+            ++node->file_count;
+            node->children.push_back(std::move(child));
+        }
+    }
+
+    progress::add_directory();
+    std::sort(node->children.begin(), node->children.end(),
+              [](const auto& a, const auto& b) { return a->name < b->name; });
+    ScopedPhase hash(Phase::Hash);
+    node->digest = directory_digest(*node);
+    return node;
+}
+
+std::string escape_name(std::string_view name) {
+    std::string escaped;
+    escaped.reserve(name.size());
+    for (char c : name) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; break;
+            case '\t': escaped += "\\t"; break;
+            case '\n': escaped += "\\n"; break;
+            default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+std::string unescape_name(const std::string& escaped) {
+    std::string name;
+    name.reserve(escaped.size());
+    for (size_t i = 0; i < escaped.size(); ++i) {
+        if (escaped[i] == '\\' && i + 1 < escaped.size()) {
+            char next = escaped[++i];
+            name += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            name += escaped[i];
+        }
+    }
+    return name;
+}
+
+void save_node(std::ostream& out, const MerkleNode& node, size_t depth) {
+    out << depth << '\t' << (node.is_directory ? 'd' : 'f') << '\t'
+        << node.size << '\t' << node.mtime << '\t' << node.digest << '\t'
+        << escape_name(node.name) << '\n';
+    for (const auto& child : node.children) {
+        save_node(out, *child, depth + 1);
+    }
+}
+
+} // namespace
+
+const MerkleNode* MerkleNode::find_child(std::string_view child_name) const {
+    auto it = std::lower_bound(children.begin(), children.end(), child_name,
+                               [](const auto& child, std::string_view n) { return std::string_view(child->name) < n; });
+    if (it == children.end() || std::string_view((*it)->name) != child_name) {
+        return nullptr;
+    }
+    return it->get();
+}
+
+void* MerkleNode::operator new(size_t size) {
+    void* p = ::operator new(size);
+    memory::note_allocation(MemoryCategory::Index, size);
+    return p;
+}
+
+void MerkleNode::operator delete(void* p, size_t size) noexcept {
+    memory::note_deallocation(MemoryCategory::Index, size);
+    ::operator delete(p);
+}
+
+MerkleTree::MerkleTree()
+    : root_node(std::make_unique<MerkleNode>()), hashed_file_count(0), filtered_file_count(0) {
+    root_node->is_directory = true;
+}
+
+MerkleTree MerkleTree::build(
+    const fs::path& root,
+    const std::vector<std::string>& exclude_folders,
+    const MerkleTree* previous,
+    const TreeBuildOptions& options
+) {
+    if (!fs::is_directory(root)) {
+        throw std::runtime_error("Not a directory: " + root.string());
+    }
+
+    // Enumeration is interleaved with everything else, so walk time is
+    // whatever the build spent outside the stat, read and hash phases
+    auto start = std::chrono::steady_clock::now();
+    PhaseTimes before = instrumentation::thread_phase_times();
+    PhaseCounters counters_before = instrumentation::thread_phase_counters();
+    PerfSample start_counters;
+    bool profiled = perf::read_thread_counters(start_counters);
+
+    MerkleTree tree;
+    tree.root_directory = root;
+    tree.root_node = build_directory(root, root, "", exclude_folders,
+                                     previous ? previous->root_node.get() : nullptr,
+                                     tree.hashed_file_count, tree.filtered_file_count, options);
+
+    PhaseTimes spent = instrumentation::thread_phase_times() - before;
+    auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    uint64_t accounted = spent[Phase::Stat] + spent[Phase::Read] + spent[Phase::Hash];
+    instrumentation::add_phase_time(Phase::Walk, elapsed > accounted ? elapsed - accounted : 0);
+
+    PerfSample end_counters;
+    if (profiled && perf::read_thread_counters(end_counters)) {
+        PhaseCounters spent_counters = instrumentation::thread_phase_counters() - counters_before;
+        PerfSample walk = end_counters - start_counters;
+        for (Phase phase : {Phase::Stat, Phase::Read, Phase::Hash}) {
+            for (size_t i = 0; i < perf_event_count; ++i) {
+                uint64_t inner = spent_counters[phase].values[i];
+                walk.values[i] = walk.values[i] > inner ? walk.values[i] - inner : 0;
+            }
+        }
+        instrumentation::add_phase_counters(Phase::Walk, walk);
+    }
+    return tree;
+}
+
+// Manifest format: a header line, then one line per node in pre-order:
+// depth, kind, size, mtime, digest and the escaped name, tab separated.
+void MerkleTree::save_manifest(const fs::path& manifest_path) const {
+    std::ofstream out(manifest_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to write manifest: " + manifest_path.string());
+    }
+    out << manifest_magic << '\t' << manifest_version << '\t'
+        << escape_name(root_directory.string()) << '\n';
+    save_node(out, *root_node, 0);
+}
+
+MerkleTree MerkleTree::load_manifest(const fs::path& manifest_path) {
+    std::ifstream in(manifest_path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open manifest: " + manifest_path.string());
+    }
+
+    std::string line;
+    std::getline(in, line);
+    std::string expected_header = std::string(manifest_magic) + '\t' + std::to_string(manifest_version) + '\t';
+    if (line.compare(0, expected_header.size(), expected_header) != 0) {
+        throw std::runtime_error("Not a manifest: " + manifest_path.string());
+    }
+
+    MerkleTree tree;
+    tree.root_directory = unescape_name(line.substr(expected_header.size()));
+    tree.root_node.reset();
+
+    std::vector<MerkleNode*> stack;
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (int i = 0; i < 5; ++i) {
+            size_t tab = line.find('\t', start);
+            if (tab == std::string::npos) {
+                throw std::runtime_error("Corrupt manifest: " + manifest_path.string());
+            }
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+
+        size_t depth = std::stoul(fields[0]);
+        auto node = std::make_unique<MerkleNode>();
+        node->is_directory = fields[1] == "d";
+        node->size = std::stoull(fields[2]);
+        node->mtime = std::stoll(fields[3]);
+        node->digest = fields[4];
+        node->name = unescape_name(line.substr(start));
+        node->file_count = node->is_directory ? 0 : 1;
+
+        if (depth == 0) {
+            if (tree.root_node) {
+                throw std::runtime_error("Corrupt manifest: " + manifest_path.string());
+            }
+            tree.root_node = std::move(node);
+            stack.assign(1, tree.root_node.get());
+            continue;
+        }
+        if (depth > stack.size() || !stack[depth - 1]->is_directory) {
+            throw std::runtime_error("Corrupt manifest: " + manifest_path.string());
+        }
+        stack.resize(depth);
+        MerkleNode* raw = node.get();
+        stack.back()->children.push_back(std::move(node));
+        stack.push_back(raw);
+    }
+
+    if (!tree.root_node) {
+        throw std::runtime_error("Corrupt manifest: " + manifest_path.string());
+    }
+
+    std::function<void(MerkleNode&)> count_files = [&](MerkleNode& node) {
+        for (auto& child : node.children) {
+            count_files(*child);
+            if (child->is_directory) {
+                node.file_count += child->file_count;
+            }
+        }
+        if (node.is_directory) {
+            node.file_count += std::count_if(node.children.begin(), node.children.end(),
+                                             [](const auto& c) { return !c->is_directory; });
+        }
+    };
+    count_files(*tree.root_node);
+    return tree;
+}
+
+const MerkleNode& MerkleTree::root() const {
+    return *root_node;
+}
+
+const fs::path& MerkleTree::root_path() const {
+    return root_directory;
+}
+
+const DigestString& MerkleTree::digest() const {
+    return root_node->digest;
+}
+
+size_t MerkleTree::get_hashed_file_count() const {
+    return hashed_file_count;
+}
+
+size_t MerkleTree::get_filtered_file_count() const {
+    return filtered_file_count;
+}
+
+bool MerkleTree::is_complete() const {
+    return root_node->complete;
+}
+
+std::vector<DuplicateDirectoryGroup> MerkleTree::find_duplicate_directories(
+    const std::vector<const MerkleTree*>& trees
+) {
+    // Empty directories all share one digest and are not worth reporting
+    std::unordered_map<std::string_view, size_t> digest_counts;
+    std::function<void(const MerkleNode&)> count = [&](const MerkleNode& node) {
+        if (node.file_count == 0) {
+            return;
+        }
+        // A stopped directory's digest covers only part of it
+        if (node.complete) {
+            ++digest_counts[node.digest];
+        }
+        for (const auto& child : node.children) {
+            if (child->is_directory) {
+                count(*child);
+            }
+        }
+    };
+    for (const auto* tree : trees) {
+        count(tree->root());
+    }
+
+    struct Occurrence {
+        const MerkleNode* node;
+        fs::path path;
+        std::string_view parent_digest;     // empty unless the parent is duplicated
+    };
+    std::unordered_map<std::string_view, std::vector<Occurrence>> occurrences;
+    std::function<void(const MerkleNode&, const fs::path&, std::string_view)> collect =
+        [&](const MerkleNode& node, const fs::path& path, std::string_view parent_digest) {
+            if (node.file_count == 0) {
+                return;
+            }
+            bool duplicated = node.complete && digest_counts[node.digest] > 1;
+            if (duplicated) {
+                occurrences[node.digest].push_back({&node, path, parent_digest});
+            }
+            for (const auto& child : node.children) {
+                if (child->is_directory) {
+                    collect(*child, path / child->name,
+                            duplicated ? std::string_view(node.digest) : std::string_view());
+                }
+            }
+        };
+    for (const auto* tree : trees) {
+        collect(tree->root(), tree->root_path(), {});
+    }
+
+    // A group is covered by its parents' group only when its members are
+    // one to one the children of that single group's members; parents that
+    // are duplicated with other partners do not cover it
+    std::vector<DuplicateDirectoryGroup> groups;
+    for (auto& [digest, members] : occurrences) {
+        std::string_view parent_digest = members.front().parent_digest;
+        bool all_nested = !parent_digest.empty() && members.size() == occurrences.at(parent_digest).size() &&
+                          std::all_of(members.begin(), members.end(), [&](const Occurrence& o) {
+                              return o.parent_digest == parent_digest;
+                          });
+        if (all_nested) {
+            continue;
+        }
+        DuplicateDirectoryGroup group;
+        group.digest = std::string(digest);
+        group.file_count = members.front().node->file_count;
+        group.size = members.front().node->size;
+        for (const auto& member : members) {
+            group.directories.push_back(member.path);
+        }
+        std::sort(group.directories.begin(), group.directories.end());
+        groups.push_back(std::move(group));
+    }
+
+    std::sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) {
+        if (a.size != b.size) {
+            return a.size > b.size;
+        }
+        return a.directories.front() < b.directories.front();
+    });
+    return groups;
+}
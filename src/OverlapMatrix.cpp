@@ -0,0 +1,177 @@
+#include "OverlapMatrix.hpp"
+#include "Json.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Bits set in x. Branch-free shifts, masks and adds on 64-bit lanes, so
+// the compiler turns loops over it into SSE2/AVX2 code without needing a
+// popcount instruction.
+inline uint64_t count_bits(uint64_t x) {
+    constexpr uint64_t m1 = 0x5555555555555555ULL;
+    constexpr uint64_t m2 = 0x3333333333333333ULL;
+    constexpr uint64_t m4 = 0x0F0F0F0F0F0F0F0FULL;
+    x -= (x >> 1) & m1;
+    x = (x & m2) + ((x >> 2) & m2);
+    x = (x + (x >> 4)) & m4;
+    x += x >> 8;
+    x += x >> 16;
+    x += x >> 32;
+    return x & 0x7f;
+}
+
+// Bits set in a & b
+uint64_t shared_bits(const uint64_t* a, const uint64_t* b, size_t words) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < words; ++i) {
+        total += count_bits(a[i] & b[i]);
+    }
+    return total;
+}
+
+// One distinct content as held by one root
+struct Holding {
+    uint32_t content;
+    uint32_t files;
+    uint64_t bytes;
+};
+
+// Files and bytes of the row root's holdings whose bits are set in
+// row & column. The holdings are sorted by content, and rank[i] counts the
+// row bits before word i, so a set bit's holding is found by counting the
+// row bits below it. Words the two roots share nothing in cost one AND.
+void add_shared_weights(const uint64_t* row, const uint64_t* column, const uint32_t* rank,
+                        const std::vector<Holding>& holdings, size_t words, OverlapCell& cell) {
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t shared = row[i] & column[i];
+        while (shared) {
+            uint64_t below = (shared & (0 - shared)) - 1;
+            const Holding& holding = holdings[rank[i] + count_bits(row[i] & below)];
+            cell.files += holding.files;
+            cell.bytes += holding.bytes;
+            shared &= shared - 1;
+        }
+    }
+}
+
+std::string csv_field(const std::string& value) {
+    if (value.find_first_of(",\"\n\r") == std::string::npos) {
+        return value;
+    }
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+} // namespace
+
+OverlapMatrix::OverlapMatrix(std::vector<fs::path> roots, const std::vector<ScannedFile>& files)
+    : roots(std::move(roots)), cells(this->roots.size() * this->roots.size()) {
+    size_t n = this->roots.size();
+
+    // Number the distinct contents and total each root's files per content
+    std::unordered_map<std::string, uint32_t> content_ids;
+    content_ids.reserve(files.size());
+    std::vector<std::unordered_map<uint32_t, size_t>> holding_index(n);
+    std::vector<std::vector<Holding>> holdings(n);
+    for (const auto& file : files) {
+        if (file.root >= n) {
+            throw std::runtime_error("Scanned file refers to an unknown root");
+        }
+        auto [id, added] = content_ids.try_emplace(file.digest, static_cast<uint32_t>(content_ids.size()));
+        auto [slot, first] = holding_index[file.root].try_emplace(id->second, holdings[file.root].size());
+        if (first) {
+            holdings[file.root].push_back({id->second, 0, 0});
+        }
+        Holding& holding = holdings[file.root][slot->second];
+        ++holding.files;
+        holding.bytes += file.size;
+    }
+    holding_index.clear();
+
+    size_t words = (content_ids.size() + 63) / 64;
+    std::vector<uint64_t> bits(n * words, 0);
+    std::vector<uint32_t> ranks(n * words, 0);
+    for (size_t root = 0; root < n; ++root) {
+        std::sort(holdings[root].begin(), holdings[root].end(),
+                  [](const Holding& x, const Holding& y) { return x.content < y.content; });
+        uint64_t* row = bits.data() + root * words;
+        for (const Holding& holding : holdings[root]) {
+            row[holding.content >> 6] |= uint64_t(1) << (holding.content & 63);
+        }
+        uint32_t* rank = ranks.data() + root * words;
+        for (size_t i = 1; i < words; ++i) {
+            rank[i] = rank[i - 1] + static_cast<uint32_t>(count_bits(row[i - 1]));
+        }
+    }
+
+    for (size_t a = 0; a < n; ++a) {
+        const uint64_t* row = bits.data() + a * words;
+        for (size_t b = 0; b < n; ++b) {
+            const uint64_t* column = bits.data() + b * words;
+            OverlapCell& cell = cells[a * n + b];
+            cell.contents = shared_bits(row, column, words);
+            add_shared_weights(row, column, ranks.data() + a * words, holdings[a], words, cell);
+        }
+    }
+}
+
+OverlapMatrix OverlapMatrix::scan(std::vector<fs::path> roots, std::vector<std::string> exclude_folders,
+                                  PipelineOptions options) {
+    ScanPipeline pipeline(roots, std::move(exclude_folders), std::move(options));
+    std::vector<ScannedFile> files = pipeline.run();
+    return OverlapMatrix(std::move(roots), files);
+}
+
+void OverlapMatrix::write_csv(std::ostream& out) const {
+    out << "from,to,files,bytes,contents\n";
+    for (size_t a = 0; a < roots.size(); ++a) {
+        for (size_t b = 0; b < roots.size(); ++b) {
+            const OverlapCell& entry = cell(a, b);
+            out << csv_field(roots[a].string()) << ',' << csv_field(roots[b].string()) << ','
+                << entry.files << ',' << entry.bytes << ',' << entry.contents << '\n';
+        }
+    }
+}
+
+void OverlapMatrix::write_json(std::ostream& out) const {
+    std::string json = "{\"roots\":[";
+    for (size_t i = 0; i < roots.size(); ++i) {
+        if (i) {
+            json += ',';
+        }
+        append_json_string(json, roots[i].string());
+    }
+    json += ']';
+    auto append_matrix = [&](const char* name, uint64_t OverlapCell::*field) {
+        json += ",\"";
+        json += name;
+        json += "\":[";
+        for (size_t a = 0; a < roots.size(); ++a) {
+            json += a ? ",[" : "[";
+            for (size_t b = 0; b < roots.size(); ++b) {
+                if (b) {
+                    json += ',';
+                }
+                json += std::to_string(cell(a, b).*field);
+            }
+            json += ']';
+        }
+        json += ']';
+    };
+    append_matrix("files", &OverlapCell::files);
+    append_matrix("bytes", &OverlapCell::bytes);
+    append_matrix("contents", &OverlapCell::contents);
+    json += "}\n";
+    out << json;
+}
@@ -0,0 +1,170 @@
+#include "PerfCounters.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<bool> profiling_on(false);
+
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+const std::array<EventConfig, perf_event_count> event_configs = {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+}};
+
+int open_event(const EventConfig& event, int group_fd, bool exclude_kernel) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = exclude_kernel ? 1 : 0;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+// One counter group per thread. The first event that opens leads the group
+// so a single read() returns every member's count.
+class ThreadGroup {
+public:
+    ~ThreadGroup() {
+        for (int fd : fds) {
+            close(fd);
+        }
+    }
+
+    void open() {
+        if (opened) {
+            return;
+        }
+        opened = true;
+        for (size_t i = 0; i < perf_event_count; ++i) {
+            int group_fd = fds.empty() ? -1 : fds.front();
+            int fd = open_event(event_configs[i], group_fd, false);
+            if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+                // perf_event_paranoid >= 2 still allows user-space counting
+                fd = open_event(event_configs[i], group_fd, true);
+            }
+            if (fd < 0) {
+                if (!reason.empty()) {
+                    reason += "; ";
+                }
+                reason += std::string(perf_event_name(static_cast<PerfEvent>(i))) + ": " + std::strerror(errno);
+                continue;
+            }
+            fds.push_back(fd);
+            members.push_back(static_cast<PerfEvent>(i));
+        }
+    }
+
+    bool read(PerfSample& sample) {
+        open();
+        if (fds.empty()) {
+            return false;
+        }
+        // PERF_FORMAT_GROUP layout: the member count, then one value each
+        uint64_t buffer[1 + perf_event_count];
+        ssize_t n = ::read(fds.front(), buffer, sizeof(buffer));
+        if (n < static_cast<ssize_t>(sizeof(uint64_t)) || buffer[0] != members.size()) {
+            return false;
+        }
+        sample = PerfSample();
+        for (size_t i = 0; i < members.size(); ++i) {
+            sample[members[i]] = buffer[1 + i];
+        }
+        return true;
+    }
+
+    bool has(PerfEvent event) {
+        open();
+        for (PerfEvent member : members) {
+            if (member == event) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::string& why_missing() {
+        open();
+        return reason;
+    }
+
+private:
+    bool opened = false;
+    std::vector<int> fds;
+    std::vector<PerfEvent> members;
+    std::string reason;
+};
+
+thread_local ThreadGroup thread_group;
+
+} // namespace
+
+const char* perf_event_name(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles: return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::CacheMisses: return "llc-misses";
+        case PerfEvent::ContextSwitches: return "context-switches";
+    }
+    return "unknown";
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other) {
+    for (size_t i = 0; i < perf_event_count; ++i) {
+        values[i] += other.values[i];
+    }
+    return *this;
+}
+
+PerfSample PerfSample::operator-(const PerfSample& other) const {
+    PerfSample difference;
+    for (size_t i = 0; i < perf_event_count; ++i) {
+        difference.values[i] = values[i] - other.values[i];
+    }
+    return difference;
+}
+
+namespace perf {
+
+void set_profiling_enabled(bool enabled) {
+    profiling_on.store(enabled, std::memory_order_relaxed);
+}
+
+bool profiling_enabled() {
+    return profiling_on.load(std::memory_order_relaxed);
+}
+
+bool read_thread_counters(PerfSample& sample) {
+    if (!profiling_enabled()) {
+        return false;
+    }
+    return thread_group.read(sample);
+}
+
+bool event_available(PerfEvent event) {
+    return thread_group.has(event);
+}
+
+std::string unavailable_reason() {
+    return thread_group.why_missing();
+}
+
+} // namespace perf
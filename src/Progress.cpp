@@ -0,0 +1,257 @@
+#include "Progress.hpp"
+#include "ThreadSlots.hpp"
+#include "rang.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct ProgressCounters {
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> directories{0};
+};
+
+using ProgressSlots = ThreadSlots<ProgressCounters>;
+
+std::atomic<uint64_t> queue_depth(0);
+
+// Only a status line on an actual terminal is rewritten in place
+bool is_terminal(const std::ostream& out) {
+    if (out.rdbuf() == std::cerr.rdbuf()) {
+        return isatty(STDERR_FILENO);
+    }
+    if (out.rdbuf() == std::cout.rdbuf()) {
+        return isatty(STDOUT_FILENO);
+    }
+    return false;
+}
+
+std::string format_duration(double seconds) {
+    auto total = static_cast<uint64_t>(seconds + 0.5);
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%02llu:%02llu:%02llu",
+                  static_cast<unsigned long long>(total / 3600),
+                  static_cast<unsigned long long>(total / 60 % 60),
+                  static_cast<unsigned long long>(total % 60));
+    return buffer;
+}
+
+} // namespace
+
+namespace progress {
+
+void add_directory() {
+    single_writer_add(ProgressSlots::local().directories, 1);
+}
+
+void add_file(uint64_t bytes) {
+    ProgressCounters& counters = ProgressSlots::local();
+    single_writer_add(counters.files, 1);
+    single_writer_add(counters.bytes, bytes);
+}
+
+void set_queue_depth(uint64_t depth) {
+    queue_depth.store(depth, std::memory_order_relaxed);
+}
+
+ProgressSnapshot snapshot() {
+    ProgressSnapshot sum;
+    ProgressSlots::for_each([&sum](const ProgressCounters& counters) {
+        sum.files += counters.files.load(std::memory_order_relaxed);
+        sum.bytes += counters.bytes.load(std::memory_order_relaxed);
+        sum.directories += counters.directories.load(std::memory_order_relaxed);
+    });
+    sum.queue_depth = queue_depth.load(std::memory_order_relaxed);
+    return sum;
+}
+
+} // namespace progress
+
+ProgressReporter::ProgressReporter(
+    std::vector<fs::path> roots,
+    std::vector<std::string> exclude_folders,
+    ProgressFormat format,
+    std::ostream& out,
+    std::chrono::milliseconds interval,
+    size_t passes
+) : roots(std::move(roots)),
+    exclude_folders(std::move(exclude_folders)),
+    format(format),
+    out(out),
+    interval(interval),
+    passes(std::max<size_t>(passes, 1)),
+    stopping(false),
+    estimate_complete(false),
+    estimated_files(0),
+    estimated_bytes(0),
+    last_line_length(0),
+    overwrite(format == ProgressFormat::Terminal && is_terminal(out)) {}
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+void ProgressReporter::start() {
+    started = std::chrono::steady_clock::now();
+    last_sample_time = started;
+    baseline = progress::snapshot();
+    last_sample = baseline;
+    stopping = false;
+    estimate_thread = std::thread(&ProgressReporter::estimate, this);
+    reporter_thread = std::thread(&ProgressReporter::run, this);
+}
+
+void ProgressReporter::stop() {
+    if (!reporter_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    reporter_thread.join();
+    estimate_thread.join();
+    report(true);
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, interval, [this] { return stopping.load(); })) {
+        lock.unlock();
+        report(false);
+        lock.lock();
+    }
+}
+
+void ProgressReporter::estimate() {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    for (const auto& root : roots) {
+        std::error_code ec;
+        fs::recursive_directory_iterator it(root, ec), end;
+        for (; !ec && it != end && !stopping; it.increment(ec)) {
+            if (it->is_directory(ec)) {
+                std::string name = it->path().filename().string();
+                if (std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end()) {
+                    it.disable_recursion_pending();
+                }
+            } else if (it->is_regular_file(ec)) {
+                ++files;
+                bytes += it->file_size(ec);
+            }
+        }
+    }
+    estimated_files = files * passes;
+    estimated_bytes = bytes * passes;
+    estimate_complete = !stopping;
+}
+
+void ProgressReporter::report(bool final) {
+    auto now = std::chrono::steady_clock::now();
+    ProgressSnapshot sample = progress::snapshot();
+    double elapsed = std::chrono::duration<double>(now - started).count();
+    double window = std::chrono::duration<double>(now - last_sample_time).count();
+
+    uint64_t files = sample.files - baseline.files;
+    uint64_t bytes = sample.bytes - baseline.bytes;
+    uint64_t directories = sample.directories - baseline.directories;
+    // The last line of a run shows the average, the others the recent rate
+    double rate_window = final ? elapsed : window;
+    uint64_t window_files = final ? files : sample.files - last_sample.files;
+    uint64_t window_bytes = final ? bytes : sample.bytes - last_sample.bytes;
+    double files_per_second = rate_window > 0 ? window_files / rate_window : 0.0;
+    double mb_per_second = rate_window > 0 ? window_bytes / rate_window / 1e6 : 0.0;
+    last_sample = sample;
+    last_sample_time = now;
+
+    // ETA from the average byte rate so far, or the file rate for trees of
+    // empty files
+    bool have_eta = estimate_complete && !final && elapsed > 0;
+    double eta = 0.0;
+    double fraction = 0.0;
+    if (estimate_complete) {
+        uint64_t total_bytes = estimated_bytes;
+        uint64_t total_files = estimated_files;
+        if (total_bytes > 0) {
+            fraction = std::min(1.0, static_cast<double>(bytes) / total_bytes);
+            have_eta = have_eta && bytes > 0;
+            eta = have_eta ? (total_bytes > bytes ? (total_bytes - bytes) / (bytes / elapsed) : 0.0) : 0.0;
+        } else if (total_files > 0) {
+            fraction = std::min(1.0, static_cast<double>(files) / total_files);
+            have_eta = have_eta && files > 0;
+            eta = have_eta ? (total_files > files ? (total_files - files) / (files / elapsed) : 0.0) : 0.0;
+        }
+    }
+    if (final) {
+        fraction = 1.0;
+    }
+
+    char buffer[256];
+    if (format == ProgressFormat::JsonLines) {
+        std::snprintf(buffer, sizeof(buffer),
+                      "{\"elapsed_s\":%.3f,\"files\":%llu,\"bytes\":%llu,\"directories\":%llu,"
+                      "\"files_per_s\":%.1f,\"mb_per_s\":%.3f,\"queue_depth\":%llu,",
+                      elapsed, static_cast<unsigned long long>(files),
+                      static_cast<unsigned long long>(bytes),
+                      static_cast<unsigned long long>(directories),
+                      files_per_second, mb_per_second,
+                      static_cast<unsigned long long>(sample.queue_depth));
+        std::string line = buffer;
+        if (estimate_complete) {
+            std::snprintf(buffer, sizeof(buffer),
+                          "\"estimated_files\":%llu,\"estimated_bytes\":%llu,",
+                          static_cast<unsigned long long>(estimated_files.load()),
+                          static_cast<unsigned long long>(estimated_bytes.load()));
+            line += buffer;
+        }
+        if (have_eta) {
+            std::snprintf(buffer, sizeof(buffer), "\"eta_s\":%.1f,", eta);
+            line += buffer;
+        } else {
+            line += "\"eta_s\":null,";
+        }
+        line += final ? "\"done\":true}" : "\"done\":false}";
+        out << line << std::endl;
+        return;
+    }
+
+    std::snprintf(buffer, sizeof(buffer),
+                  "%llu files  %llu dirs  %.0f files/s  %.1f MB/s",
+                  static_cast<unsigned long long>(files),
+                  static_cast<unsigned long long>(directories),
+                  files_per_second, mb_per_second);
+    std::string line = buffer;
+    if (sample.queue_depth > 0) {
+        line += "  queue " + std::to_string(sample.queue_depth);
+    }
+    std::string eta_text = final ? "done in " + format_duration(elapsed)
+                         : have_eta ? "ETA " + format_duration(eta)
+                         : estimate_complete ? "ETA --:--:--"
+                         : "estimating";
+
+    std::snprintf(buffer, sizeof(buffer), "[%3.0f%%] ", fraction * 100);
+    size_t length = std::string(buffer).size() + line.size() + 2 + eta_text.size();
+    if (overwrite) {
+        out << '\r';
+    }
+    out << rang::fg::cyan << buffer << rang::style::reset << line << "  "
+        << (final ? rang::fg::green : rang::fg::yellow) << eta_text << rang::style::reset;
+    // Blank out the tail of a longer previous line
+    if (overwrite && last_line_length > length) {
+        out << std::string(last_line_length - length, ' ');
+    }
+    if (overwrite && !final) {
+        out << std::flush;
+    } else {
+        out << std::endl;
+    }
+    last_line_length = length;
+}
@@ -0,0 +1,345 @@
+#include "QueryServer.hpp"
+#include "Json.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Longest request line accepted before the connection is dropped
+const size_t max_request_length = 64 * 1024;
+
+void append_path_array(std::string& out, const std::vector<std::string>& paths) {
+    out += "\"paths\":[";
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (i > 0) {
+            out += ',';
+        }
+        append_json_string(out, paths[i]);
+    }
+    out += ']';
+}
+
+std::string path_list_response(const std::vector<std::string>& paths) {
+    std::string out = "{\"ok\":true,";
+    append_path_array(out, paths);
+    out += '}';
+    return out;
+}
+
+std::string error_response(const std::string& message) {
+    std::string out = "{\"ok\":false,\"error\":";
+    append_json_string(out, message);
+    out += '}';
+    return out;
+}
+
+// Parses a flat JSON object whose values are all strings, which is all the
+// protocol needs. Throws std::runtime_error on anything else.
+std::unordered_map<std::string, std::string> parse_request(const std::string& line) {
+    size_t pos = 0;
+    auto skip_space = [&] {
+        while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) {
+            ++pos;
+        }
+    };
+    auto expect = [&](char c) {
+        skip_space();
+        if (pos >= line.size() || line[pos] != c) {
+            throw std::runtime_error(std::string("expected '") + c + "'");
+        }
+        ++pos;
+    };
+    auto parse_string = [&] {
+        expect('"');
+        std::string value;
+        while (pos < line.size() && line[pos] != '"') {
+            char c = line[pos++];
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (pos >= line.size()) {
+                break;
+            }
+            char escaped = line[pos++];
+            switch (escaped) {
+                case 'n': value += '\n'; break;
+                case 't': value += '\t'; break;
+                case 'r': value += '\r'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'u': {
+                    if (pos + 4 > line.size()) {
+                        throw std::runtime_error("bad \\u escape");
+                    }
+                    unsigned long code = std::stoul(line.substr(pos, 4), nullptr, 16);
+                    pos += 4;
+                    if (code < 0x80) {
+                        value += static_cast<char>(code);
+                    } else if (code < 0x800) {
+                        value += static_cast<char>(0xC0 | (code >> 6));
+                        value += static_cast<char>(0x80 | (code & 0x3F));
+                    } else {
+                        value += static_cast<char>(0xE0 | (code >> 12));
+                        value += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                        value += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: value += escaped; break;
+            }
+        }
+        expect('"');
+        return value;
+    };
+
+    std::unordered_map<std::string, std::string> fields;
+    expect('{');
+    skip_space();
+    if (pos < line.size() && line[pos] == '}') {
+        return fields;
+    }
+    for (;;) {
+        std::string key = parse_string();
+        expect(':');
+        fields[key] = parse_string();
+        skip_space();
+        if (pos < line.size() && line[pos] == ',') {
+            ++pos;
+            continue;
+        }
+        expect('}');
+        return fields;
+    }
+}
+
+// Index keys are the normalized paths the roots were walked with
+std::string normalize(const std::string& path) {
+    std::string normal = fs::path(path).lexically_normal().string();
+    while (normal.size() > 1 && normal.back() == '/') {
+        normal.pop_back();
+    }
+    return normal;
+}
+
+} // namespace
+
+QueryServer::QueryServer(const DuplicateIndex& index, fs::path socket_path, size_t max_connections)
+    : index(index), socket_path(std::move(socket_path)), max_connections(std::max<size_t>(max_connections, 1)),
+      listen_fd(-1),
+      running(false), request_count(0) {}
+
+QueryServer::~QueryServer() {
+    stop();
+}
+
+void QueryServer::start() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::string path = socket_path.string();
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // A socket left behind by a previous server would make bind fail
+    std::error_code ec;
+    if (fs::is_socket(socket_path, ec)) {
+        fs::remove(socket_path, ec);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+    }
+    // bind creates the socket file with the umask applied, so it is made
+    // owner-only from the start rather than chmod'ed after others could connect
+    mode_t previous_umask = umask(0177);
+    bool bound = bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    int bind_error = errno;
+    umask(previous_umask);
+    errno = bind_error;
+    if (!bound || listen(listen_fd, SOMAXCONN) < 0) {
+        std::string error = std::strerror(errno);
+        close(listen_fd);
+        listen_fd = -1;
+        throw std::runtime_error("Unable to listen on " + path + ": " + error);
+    }
+
+    running = true;
+    accept_thread = std::thread(&QueryServer::accept_loop, this);
+}
+
+void QueryServer::stop() {
+    if (!running) {
+        return;
+    }
+    {
+        std::lock_guard lock(connections_mutex);
+        running = false;
+    }
+    connections_done.notify_all();
+    shutdown(listen_fd, SHUT_RDWR);
+    accept_thread.join();
+    close(listen_fd);
+    listen_fd = -1;
+
+    std::unique_lock lock(connections_mutex);
+    for (int fd : client_fds) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    connections_done.wait(lock, [this] { return client_fds.empty(); });
+    lock.unlock();
+
+    std::error_code ec;
+    fs::remove(socket_path, ec);
+}
+
+size_t QueryServer::get_request_count() const {
+    return request_count;
+}
+
+void QueryServer::accept_loop() {
+    while (running) {
+        {
+            std::unique_lock lock(connections_mutex);
+            connections_done.wait(lock, [this] { return !running || client_fds.size() < max_connections; });
+            if (!running) {
+                return;
+            }
+        }
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        std::lock_guard lock(connections_mutex);
+        if (!running) {
+            close(client_fd);
+            return;
+        }
+        client_fds.push_back(client_fd);
+        std::thread(&QueryServer::serve_connection, this, client_fd).detach();
+    }
+}
+
+void QueryServer::serve_connection(int client_fd) {
+    std::string buffer;
+    char chunk[4096];
+
+    for (;;) {
+        ssize_t received = recv(client_fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            break;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+
+        size_t start = 0;
+        size_t newline;
+        std::string responses;
+        while ((newline = buffer.find('\n', start)) != std::string::npos) {
+            responses += handle_request(buffer.substr(start, newline - start));
+            responses += '\n';
+            start = newline + 1;
+        }
+        buffer.erase(0, start);
+
+        bool sent = true;
+        for (size_t offset = 0; offset < responses.size() && sent;) {
+            ssize_t written = send(client_fd, responses.data() + offset,
+                                   responses.size() - offset, MSG_NOSIGNAL);
+            sent = written > 0;
+            offset += sent ? static_cast<size_t>(written) : 0;
+        }
+        if (!sent || buffer.size() > max_request_length) {
+            break;
+        }
+    }
+
+    std::lock_guard lock(connections_mutex);
+    close(client_fd);
+    client_fds.erase(std::find(client_fds.begin(), client_fds.end(), client_fd));
+    connections_done.notify_all();
+}
+
+std::string QueryServer::handle_request(const std::string& line) {
+    ++request_count;
+
+    std::unordered_map<std::string, std::string> request;
+    try {
+        request = parse_request(line);
+    } catch (const std::exception& e) {
+        return error_response(std::string("malformed request: ") + e.what());
+    }
+
+    auto field = [&](const char* name) -> const std::string* {
+        auto it = request.find(name);
+        return it == request.end() ? nullptr : &it->second;
+    };
+
+    const std::string* op = field("op");
+    if (!op) {
+        return error_response("missing op");
+    }
+
+    if (*op == "lookup") {
+        const std::string* digest = field("digest");
+        if (!digest) {
+            return error_response("lookup needs a digest");
+        }
+        return path_list_response(index.paths_with_digest(*digest));
+    }
+
+    if (*op == "duplicates") {
+        const std::string* path = field("path");
+        if (!path) {
+            return error_response("duplicates needs a path");
+        }
+        std::string key = normalize(*path);
+        auto file = index.find(key);
+        if (!file) {
+            return error_response("not indexed: " + key);
+        }
+        auto paths = index.paths_with_digest(file->digest);
+        paths.erase(std::remove(paths.begin(), paths.end(), key), paths.end());
+
+        std::string out = "{\"ok\":true,\"digest\":";
+        append_json_string(out, file->digest);
+        out += ',';
+        append_path_array(out, paths);
+        out += '}';
+        return out;
+    }
+
+    if (*op == "unique") {
+        const std::string* root = field("root");
+        if (!root) {
+            return error_response("unique needs a root");
+        }
+        return path_list_response(index.unique_under(normalize(*root)));
+    }
+
+    if (*op == "stats") {
+        return "{\"ok\":true,\"files\":" + std::to_string(index.file_count()) +
+               ",\"bytes\":" + std::to_string(index.total_size()) +
+               ",\"duplicate_groups\":" + std::to_string(index.duplicate_group_count()) +
+               ",\"requests\":" + std::to_string(request_count.load()) + "}";
+    }
+
+    return error_response("unknown op: " + *op);
+}
@@ -0,0 +1,315 @@
+#include "ScanPipeline.hpp"
+#include "Coroutine.hpp"
+#include "FileHashMapper.hpp"
+#include "Instrumentation.hpp"
+#include "Progress.hpp"
+#include "TreeHash.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// One file on its way through the stages
+struct Item {
+    size_t root = 0;
+    fs::path path;
+    fs::path relative_path;
+    uintmax_t size = 0;
+    uint64_t device = 0;
+    FileFilter::Time mtime;
+    bool prefetched = false;
+    std::vector<char> data;
+    std::string digest;
+};
+
+using ItemChannel = Channel<Item>;
+using SteadyClock = std::chrono::steady_clock;
+
+std::vector<char> read_whole_file(const fs::path& path, uintmax_t size_hint) {
+    int fd;
+    {
+        ScopedPhase open(Phase::Read, Operation::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open file: " + path.string());
+    }
+    ScopedPhase read_phase(Phase::Read);
+    // One byte spare, so a file that grew since the stat is read to its end
+    std::vector<char> data(static_cast<size_t>(size_hint) + 1);
+    size_t total = 0;
+    for (;;) {
+        if (total == data.size()) {
+            data.resize(data.size() * 2);
+        }
+        ssize_t n = ::read(fd, data.data() + total, data.size() - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ::close(fd);
+            throw std::runtime_error("Unable to read file: " + path.string());
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    data.resize(total);
+    return data;
+}
+
+// Every stage follows the same shape: take items until the input closes,
+// pass them on, and release its share of the output. A send that is
+// refused means a later stage failed, so the stage closes its input to stop
+// the stages before it. An error closes both sides and is recorded once.
+
+Task enumerate_stage(Executor& executor, const std::vector<fs::path>& roots,
+                     const std::vector<std::string>& exclude_folders, ItemChannel& out, PipelineStats& stats) {
+    try {
+        for (size_t root = 0; root < roots.size(); ++root) {
+            for (fs::recursive_directory_iterator it(roots[root]), end; it != end; ++it) {
+                if (it->is_directory()) {
+                    std::string name = it->path().filename().string();
+                    if (std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end()) {
+                        it.disable_recursion_pending();
+                    } else {
+                        ++stats.directories;
+                        progress::add_directory();
+                    }
+                    continue;
+                }
+                Item item;
+                item.root = root;
+                item.path = it->path();
+                if (!co_await out.send(std::move(item))) {
+                    out.producer_done();
+                    co_return;
+                }
+            }
+        }
+    } catch (...) {
+        executor.fail(std::current_exception());
+        out.close();
+    }
+    out.producer_done();
+}
+
+Task stat_stage(Executor& executor, const std::vector<fs::path>& roots, ItemChannel& in, ItemChannel& out) {
+    try {
+        while (auto item = co_await in.receive()) {
+            {
+                ScopedPhase stat(Phase::Stat, Operation::Stat);
+                struct stat st;
+                if (::stat(item->path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                    continue;
+                }
+                item->size = static_cast<uintmax_t>(st.st_size);
+                item->device = static_cast<uint64_t>(st.st_dev);
+                auto since_epoch = std::chrono::seconds(st.st_mtim.tv_sec) + std::chrono::nanoseconds(st.st_mtim.tv_nsec);
+                item->mtime = std::chrono::file_clock::from_sys(
+                    std::chrono::system_clock::time_point(
+                        std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch)));
+            }
+            item->relative_path = item->path.lexically_relative(roots[item->root]);
+            if (!co_await out.send(std::move(*item))) {
+                in.close();
+                break;
+            }
+        }
+    } catch (...) {
+        executor.fail(std::current_exception());
+        in.close();
+        out.close();
+    }
+    out.producer_done();
+}
+
+Task filter_stage(Executor& executor, const PipelineOptions& options, ItemChannel& in, ItemChannel& out,
+                  PipelineStats& stats) {
+    try {
+        while (auto item = co_await in.receive()) {
+            if ((options.filter && !options.filter(item->relative_path, item->size)) ||
+                !options.file_filter.matches(item->relative_path, item->size, item->mtime)) {
+                ++stats.filtered;
+                continue;
+            }
+            if (!co_await out.send(std::move(*item))) {
+                in.close();
+                break;
+            }
+        }
+    } catch (...) {
+        executor.fail(std::current_exception());
+        in.close();
+        out.close();
+    }
+    out.producer_done();
+}
+
+// With a controller, each file's I/O holds one of its device's permits and
+// reports its bytes and latency when done. The I/O itself runs on the
+// blocking pool, so the permits, not the executor's threads, bound how many
+// reads are in flight.
+Task read_stage(Executor& executor, const PipelineOptions& options, ConcurrencyController* controller,
+                BlockingPool* io, ItemChannel& in, ItemChannel& out) {
+    try {
+        while (auto item = co_await in.receive()) {
+            // A file due for tree hashing is read by its own threads instead
+            if (item->size <= options.prefetch_limit && !tree_hash::applies(item->size)) {
+                if (controller) {
+                    co_await controller->acquire(item->device);
+                }
+                SteadyClock::time_point start = SteadyClock::now();
+                auto read = [&item] { item->data = read_whole_file(item->path, item->size); };
+                try {
+                    if (io) {
+                        co_await io->run(read);
+                    } else {
+                        read();
+                    }
+                } catch (...) {
+                    if (controller) {
+                        controller->release(item->device, 0, SteadyClock::now() - start);
+                    }
+                    throw;
+                }
+                if (controller) {
+                    controller->release(item->device, item->data.size(), SteadyClock::now() - start);
+                }
+                item->prefetched = true;
+            }
+            if (!co_await out.send(std::move(*item))) {
+                in.close();
+                break;
+            }
+        }
+    } catch (...) {
+        executor.fail(std::current_exception());
+        in.close();
+        out.close();
+    }
+    out.producer_done();
+}
+
+Task hash_stage(Executor& executor, ConcurrencyController* controller, BlockingPool* io, ItemChannel& in,
+                ItemChannel& out) {
+    try {
+        while (auto item = co_await in.receive()) {
+            if (item->prefetched) {
+                ScopedPhase hash(Phase::Hash);
+                item->digest = FileHashMapper::compute_md5_of_buffer(item->data.data(), item->data.size());
+                std::vector<char>().swap(item->data);
+            } else {
+                if (controller) {
+                    co_await controller->acquire(item->device);
+                }
+                SteadyClock::time_point start = SteadyClock::now();
+                auto stream = [&item] { item->digest = FileHashMapper::compute_md5(item->path); };
+                try {
+                    if (io) {
+                        co_await io->run(stream);
+                    } else {
+                        stream();
+                    }
+                } catch (...) {
+                    if (controller) {
+                        controller->release(item->device, 0, SteadyClock::now() - start);
+                    }
+                    throw;
+                }
+                if (controller) {
+                    controller->release(item->device, item->size, SteadyClock::now() - start);
+                }
+            }
+            if (!co_await out.send(std::move(*item))) {
+                in.close();
+                break;
+            }
+        }
+    } catch (...) {
+        executor.fail(std::current_exception());
+        in.close();
+        out.close();
+    }
+    out.producer_done();
+}
+
+Task aggregate_stage(const std::vector<ItemChannel*>& channels, ItemChannel& in,
+                     std::vector<ScannedFile>& files, PipelineStats& stats) {
+    while (auto item = co_await in.receive()) {
+        size_t depth = 0;
+        for (const ItemChannel* channel : channels) {
+            depth += channel->depth();
+        }
+        stats.peak_queue_depth = std::max(stats.peak_queue_depth, depth);
+        progress::set_queue_depth(depth);
+        progress::add_file(item->size);
+        ++stats.files;
+        stats.bytes += item->size;
+        files.push_back({item->root, std::move(item->relative_path), item->size, std::move(item->digest)});
+    }
+    progress::set_queue_depth(0);
+}
+
+} // namespace
+
+ScanPipeline::ScanPipeline(std::vector<fs::path> roots, std::vector<std::string> exclude_folders,
+                           PipelineOptions options)
+    : roots(std::move(roots)), exclude_folders(std::move(exclude_folders)), options(std::move(options)) {}
+
+std::vector<ScannedFile> ScanPipeline::run() {
+    stats = PipelineStats();
+    // The executor only runs the stages' CPU work, so it has one thread per
+    // hardware thread whether or not the run is adaptive. Adaptive reads run
+    // on a blocking pool that grows with the reads the controller lets
+    // through, up to its max_limit; readers park on their permits meanwhile.
+    Executor executor(options.threads);
+    unsigned readers = options.readers ? options.readers
+                                       : options.adaptive ? options.controller.max_limit : executor.thread_count();
+    unsigned hashers = options.hashers ? options.hashers : executor.thread_count();
+    std::optional<ConcurrencyController> controller;
+    std::optional<BlockingPool> io;
+    if (options.adaptive) {
+        controller.emplace(executor, options.controller, options.decision_log);
+        io.emplace(executor, options.controller.max_limit);
+    }
+    ConcurrencyController* gate = controller ? &*controller : nullptr;
+    BlockingPool* blocking = io ? &*io : nullptr;
+    size_t capacity = std::max<size_t>(options.channel_capacity, 1);
+
+    ItemChannel enumerated(executor, capacity);
+    ItemChannel statted(executor, capacity);
+    ItemChannel filtered(executor, capacity);
+    ItemChannel read(executor, capacity, readers);
+    ItemChannel hashed(executor, capacity, hashers);
+    std::vector<ItemChannel*> channels = {&enumerated, &statted, &filtered, &read, &hashed};
+
+    std::vector<ScannedFile> files;
+    executor.spawn(enumerate_stage(executor, roots, exclude_folders, enumerated, stats));
+    executor.spawn(stat_stage(executor, roots, enumerated, statted));
+    executor.spawn(filter_stage(executor, options, statted, filtered, stats));
+    for (unsigned i = 0; i < readers; ++i) {
+        executor.spawn(read_stage(executor, options, gate, blocking, filtered, read));
+    }
+    for (unsigned i = 0; i < hashers; ++i) {
+        executor.spawn(hash_stage(executor, gate, blocking, read, hashed));
+    }
+    executor.spawn(aggregate_stage(channels, hashed, files, stats));
+    executor.run();
+    if (controller) {
+        stats.decisions = controller->decisions();
+    }
+    return files;
+}
@@ -0,0 +1,383 @@
+#include "Sharding.hpp"
+#include "FileHashMapper.hpp"
+#include "Progress.hpp"
+#include "TreeHash.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <set>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char partial_magic[8] = {'F', 'S', 'F', 'P', 'A', 'R', 'T', '2'};
+
+struct FileRecord {
+    uint64_t size = 0;
+    std::string digest;   // 32 hex characters
+    uint32_t root = 0;
+    std::string path;     // generic form, relative to the root
+};
+
+bool content_less(const FileRecord& a, const FileRecord& b) {
+    if (a.size != b.size) {
+        return a.size < b.size;
+    }
+    if (a.digest != b.digest) {
+        return a.digest < b.digest;
+    }
+    if (a.root != b.root) {
+        return a.root < b.root;
+    }
+    return a.path < b.path;
+}
+
+bool path_less(const FileRecord& a, const FileRecord& b) {
+    if (a.path != b.path) {
+        return a.path < b.path;
+    }
+    return a.root < b.root;
+}
+
+struct PartialHeader {
+    ShardSpec shard;
+    uint64_t tree_hash_threshold = 0;  // large files' digests depend on it
+    std::vector<std::string> roots;
+    uint64_t record_count = 0;
+    uint64_t path_section = 0;    // file offset of the path-ordered records
+    uint64_t content_section = 0;
+};
+
+template <typename T>
+void write_value(std::ostream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T read_value(std::istream& in) {
+    T value{};
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+void write_string(std::ostream& out, const std::string& s) {
+    write_value<uint32_t>(out, static_cast<uint32_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+std::string read_string(std::istream& in) {
+    std::string s(read_value<uint32_t>(in), '\0');
+    in.read(s.data(), static_cast<std::streamsize>(s.size()));
+    return s;
+}
+
+void write_record(std::ostream& out, const FileRecord& record) {
+    write_value(out, record.size);
+    out.write(record.digest.data(), 32);
+    write_value(out, record.root);
+    write_string(out, record.path);
+}
+
+void read_record(std::istream& in, FileRecord& record) {
+    record.size = read_value<uint64_t>(in);
+    record.digest.resize(32);
+    in.read(record.digest.data(), 32);
+    record.root = read_value<uint32_t>(in);
+    record.path = read_string(in);
+}
+
+PartialHeader read_header(std::istream& in, const fs::path& path) {
+    char magic[sizeof(partial_magic)];
+    in.read(magic, sizeof(magic));
+    if (!in || !std::equal(magic, magic + sizeof(magic), partial_magic)) {
+        throw std::runtime_error("Not a partial result file: " + path.string());
+    }
+    PartialHeader header;
+    header.shard.index = read_value<uint32_t>(in);
+    header.shard.count = read_value<uint32_t>(in);
+    uint32_t key = read_value<uint32_t>(in);
+    // Indexes later size and address per-shard tables, so they are checked
+    // before anything trusts them
+    if (in && (header.shard.count == 0 || header.shard.index >= header.shard.count ||
+               key > static_cast<uint32_t>(ShardKey::PathHash))) {
+        throw std::runtime_error("Corrupt partial result file: " + path.string());
+    }
+    header.shard.key = static_cast<ShardKey>(key);
+    header.tree_hash_threshold = read_value<uint64_t>(in);
+    uint32_t root_count = read_value<uint32_t>(in);
+    for (uint32_t i = 0; i < root_count && in; ++i) {
+        header.roots.push_back(read_string(in));
+    }
+    header.record_count = read_value<uint64_t>(in);
+    header.path_section = read_value<uint64_t>(in);
+    header.content_section = static_cast<uint64_t>(in.tellg());
+    if (!in) {
+        throw std::runtime_error("Truncated partial result file: " + path.string());
+    }
+    return header;
+}
+
+// One section of one partial, read a record at a time
+struct SectionCursor {
+    std::ifstream in;
+    uint64_t remaining = 0;
+    FileRecord current;
+
+    SectionCursor(const fs::path& path, bool path_order) : in(path, std::ios::binary) {
+        PartialHeader header = read_header(in, path);
+        in.seekg(static_cast<std::streamoff>(path_order ? header.path_section : header.content_section));
+        remaining = header.record_count;
+    }
+
+    bool advance() {
+        if (remaining == 0) {
+            return false;
+        }
+        --remaining;
+        read_record(in, current);
+        if (!in) {
+            throw std::runtime_error("Truncated partial result file");
+        }
+        return true;
+    }
+};
+
+// K-way merge of one section across all partials
+template <typename Less, typename Sink>
+void merge_sections(const std::vector<fs::path>& partials, bool path_order, Less less, Sink sink) {
+    std::vector<std::unique_ptr<SectionCursor>> cursors;
+    for (const auto& partial : partials) {
+        cursors.push_back(std::make_unique<SectionCursor>(partial, path_order));
+    }
+    auto greater = [&](size_t a, size_t b) { return less(cursors[b]->current, cursors[a]->current); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        if (cursors[i]->advance()) {
+            heap.push(i);
+        }
+    }
+    while (!heap.empty()) {
+        size_t i = heap.top();
+        heap.pop();
+        sink(cursors[i]->current);
+        if (cursors[i]->advance()) {
+            heap.push(i);
+        }
+    }
+}
+
+// FNV-1a, spread over the shards by range rather than modulo
+size_t shard_of(const std::string& key, size_t count) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return static_cast<size_t>((static_cast<unsigned __int128>(hash) * count) >> 64);
+}
+
+} // namespace
+
+ShardSpec ShardSpec::parse(const std::string& text, ShardKey key) {
+    size_t slash = text.find('/');
+    ShardSpec spec;
+    spec.key = key;
+    try {
+        if (slash == std::string::npos) {
+            throw std::invalid_argument(text);
+        }
+        spec.index = std::stoul(text.substr(0, slash));
+        spec.count = std::stoul(text.substr(slash + 1));
+    } catch (const std::logic_error&) {
+        throw std::runtime_error("Invalid shard \"" + text + "\", expected <index>/<count>");
+    }
+    if (spec.count == 0 || spec.index >= spec.count) {
+        throw std::runtime_error("Invalid shard \"" + text + "\", index must be below count");
+    }
+    return spec;
+}
+
+bool ShardSpec::owns(const fs::path& relative_path) const {
+    if (count <= 1) {
+        return true;
+    }
+    std::string key_text = key == ShardKey::Subtree
+        ? relative_path.begin()->generic_string()
+        : relative_path.generic_string();
+    return shard_of(key_text, count) == index;
+}
+
+PartialSummary write_partial(
+    const std::vector<fs::path>& directories,
+    const std::vector<std::string>& exclude_folders,
+    const ShardSpec& shard,
+    const fs::path& output
+) {
+    PartialSummary summary;
+    std::vector<FileRecord> records;
+    for (size_t root = 0; root < directories.size(); ++root) {
+        const fs::path& dir = directories[root];
+        for (fs::recursive_directory_iterator it(dir), end; it != end; ++it) {
+            fs::path relative = it->path().lexically_relative(dir);
+            if (it->is_directory()) {
+                std::string name = it->path().filename().string();
+                bool excluded = std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end();
+                // Subtrees owned by other shards are never walked
+                if (excluded || (shard.key == ShardKey::Subtree && it.depth() == 0 && !shard.owns(relative))) {
+                    it.disable_recursion_pending();
+                } else {
+                    progress::add_directory();
+                }
+                continue;
+            }
+            if (!it->is_regular_file() || !shard.owns(relative)) {
+                continue;
+            }
+            FileRecord record;
+            record.size = it->file_size();
+            record.digest = FileHashMapper::compute_md5(it->path());
+            record.root = static_cast<uint32_t>(root);
+            record.path = relative.generic_string();
+            records.push_back(std::move(record));
+            ++summary.files;
+            summary.bytes += records.back().size;
+            progress::add_file(records.back().size);
+        }
+    }
+
+    // Written under a temporary name so a crashed shard never leaves a
+    // partial that looks complete
+    fs::path temporary = output;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Unable to write partial result: " + output.string());
+        }
+        out.write(partial_magic, sizeof(partial_magic));
+        write_value<uint32_t>(out, static_cast<uint32_t>(shard.index));
+        write_value<uint32_t>(out, static_cast<uint32_t>(shard.count));
+        write_value<uint32_t>(out, static_cast<uint32_t>(shard.key));
+        write_value<uint64_t>(out, tree_hash::threshold());
+        write_value<uint32_t>(out, static_cast<uint32_t>(directories.size()));
+        for (const auto& dir : directories) {
+            write_string(out, dir.generic_string());
+        }
+        write_value<uint64_t>(out, records.size());
+        auto path_section_field = out.tellp();
+        write_value<uint64_t>(out, 0);
+
+        std::sort(records.begin(), records.end(), content_less);
+        for (const auto& record : records) {
+            write_record(out, record);
+        }
+        auto path_section = static_cast<uint64_t>(out.tellp());
+        std::sort(records.begin(), records.end(), path_less);
+        for (const auto& record : records) {
+            write_record(out, record);
+        }
+        out.seekp(path_section_field);
+        write_value<uint64_t>(out, path_section);
+        if (!out.flush()) {
+            throw std::runtime_error("Unable to write partial result: " + output.string());
+        }
+    }
+    fs::rename(temporary, output);
+    return summary;
+}
+
+PartialMerger::PartialMerger(std::vector<fs::path> partials) : partials(std::move(partials)) {
+    if (this->partials.empty()) {
+        throw std::runtime_error("No partial result files to merge");
+    }
+    std::vector<bool> seen;
+    PartialHeader first;
+    for (size_t i = 0; i < this->partials.size(); ++i) {
+        const fs::path& path = this->partials[i];
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Unable to open partial result: " + path.string());
+        }
+        PartialHeader header = read_header(in, path);
+        if (i == 0) {
+            first = header;
+            seen.assign(header.shard.count, false);
+        } else if (header.roots != first.roots || header.shard.count != first.shard.count ||
+                   header.shard.key != first.shard.key || header.tree_hash_threshold != first.tree_hash_threshold) {
+            throw std::runtime_error("Partial " + path.string() + " belongs to a different sharded scan");
+        }
+        if (seen[header.shard.index]) {
+            throw std::runtime_error("Shard " + std::to_string(header.shard.index) + " given twice");
+        }
+        seen[header.shard.index] = true;
+    }
+    for (size_t shard = 0; shard < seen.size(); ++shard) {
+        if (!seen[shard]) {
+            throw std::runtime_error("Missing partial for shard " + std::to_string(shard) + " of " +
+                                     std::to_string(seen.size()));
+        }
+    }
+    roots.assign(first.roots.begin(), first.roots.end());
+}
+
+const std::vector<fs::path>& PartialMerger::directories() const {
+    return roots;
+}
+
+void PartialMerger::merge_groups(const std::function<void(const ExternalGroup&)>& on_group, bool include_unique) const {
+    ExternalGroup group;
+    bool open = false;
+    auto flush = [&]() {
+        if (open && (group.members.size() > 1 || include_unique)) {
+            on_group(group);
+        }
+    };
+    merge_sections(partials, false, content_less, [&](const FileRecord& record) {
+        if (!open || record.size != group.size || record.digest != group.digest) {
+            flush();
+            group.size = record.size;
+            group.digest = record.digest;
+            group.members.clear();
+            open = true;
+        }
+        group.members.push_back({record.root, record.path});
+    });
+    flush();
+}
+
+void PartialMerger::merge_entries(const std::function<void(const ComparisonEntry&)>& on_entry) const {
+    ComparisonEntry entry;
+    std::string first_digest;
+    size_t present_count = 0;
+    bool open = false;
+    auto flush = [&]() {
+        if (!open) {
+            return;
+        }
+        if (present_count == 1) {
+            entry.status = EntryStatus::Unique;
+        }
+        on_entry(entry);
+    };
+    merge_sections(partials, true, path_less, [&](const FileRecord& record) {
+        if (!open || record.path != entry.relative_path.generic_string()) {
+            flush();
+            entry.relative_path = record.path;
+            entry.status = EntryStatus::Same;
+            entry.file_count = 1;
+            entry.present.assign(roots.size(), false);
+            first_digest = record.digest;
+            present_count = 0;
+            open = true;
+        }
+        entry.present[record.root] = true;
+        ++present_count;
+        if (record.digest != first_digest) {
+            entry.status = EntryStatus::Different;
+        }
+    });
+    flush();
+}
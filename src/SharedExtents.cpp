@@ -0,0 +1,153 @@
+#include "SharedExtents.hpp"
+#include "FileHashMapper.hpp"
+#include "Instrumentation.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr unsigned extents_per_call = 64;
+
+// Extents whose physical address says nothing about the data
+constexpr uint32_t untrusted_flags = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC |
+                                     FIEMAP_EXTENT_ENCODED | FIEMAP_EXTENT_DATA_ENCRYPTED |
+                                     FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE |
+                                     FIEMAP_EXTENT_DATA_TAIL;
+
+template <typename T>
+void append_value(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} // namespace
+
+bool read_extent_map(const fs::path& path, ExtentMap& map) {
+    ScopedPhase stat_phase(Phase::Stat);
+    map = ExtentMap();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    map.links = st.st_nlink;
+
+    std::vector<char> storage(sizeof(struct fiemap) + extents_per_call * sizeof(struct fiemap_extent));
+    auto* request = reinterpret_cast<struct fiemap*>(storage.data());
+    std::string signature;
+    bool trusted = true;
+    bool unsettled = false;
+    auto query = [&](uint32_t flags) {
+        signature.clear();
+        append_value<uint64_t>(signature, st.st_dev);
+        append_value<uint64_t>(signature, static_cast<uint64_t>(st.st_size));
+        trusted = true;
+        unsettled = false;
+        map.shared = false;
+        bool last = false;
+        uint64_t start = 0;
+        while (!last) {
+            std::memset(storage.data(), 0, storage.size());
+            request->fm_flags = flags;
+            request->fm_start = start;
+            request->fm_length = FIEMAP_MAX_OFFSET - start;
+            request->fm_extent_count = extents_per_call;
+            if (::ioctl(fd, FS_IOC_FIEMAP, request) != 0) {
+                return false;
+            }
+            if (request->fm_mapped_extents == 0) {
+                break;
+            }
+            for (unsigned i = 0; i < request->fm_mapped_extents; ++i) {
+                const struct fiemap_extent& extent = request->fm_extents[i];
+                trusted = trusted && !(extent.fe_flags & untrusted_flags);
+                unsettled = unsettled || (extent.fe_flags & (FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_UNKNOWN));
+                map.shared = map.shared || (extent.fe_flags & FIEMAP_EXTENT_SHARED);
+                append_value(signature, extent.fe_logical);
+                append_value(signature, extent.fe_physical);
+                append_value(signature, extent.fe_length);
+                last = extent.fe_flags & FIEMAP_EXTENT_LAST;
+                start = extent.fe_logical + extent.fe_length;
+            }
+        }
+        return true;
+    };
+    // A read-only scan should not force writeback of the whole tree, so
+    // only a file with data still waiting for allocation is synced, and
+    // queried again for the layout it settles into
+    bool queried = query(0);
+    if (queried && unsettled) {
+        queried = query(FIEMAP_FLAG_SYNC);
+    }
+    if (!queried) {
+        ::close(fd);
+        return false;
+    }
+    ::close(fd);
+    // Files with no extents at all (empty, or data held inline) share nothing
+    if (trusted && signature.size() > 2 * sizeof(uint64_t)) {
+        map.signature = std::move(signature);
+    }
+    return true;
+}
+
+std::string SharedExtentCache::digest(const fs::path& path, uintmax_t size, bool& read,
+                                      const CancellationToken* cancel) {
+    ExtentMap map;
+    bool mapped = read_extent_map(path, map);
+    bool candidate = mapped && !map.signature.empty() && (map.shared || map.links > 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++counters.files_queried;
+        counters.unsupported += !mapped;
+        if (candidate) {
+            auto it = by_signature.find(map.signature);
+            if (it != by_signature.end()) {
+                it->second.paths.push_back(path);
+                ++counters.files_shared;
+                counters.bytes_avoided += size;
+                read = false;
+                return it->second.digest;
+            }
+        }
+    }
+
+    std::string digest = FileHashMapper::compute_md5(path, cancel);
+    read = true;
+    if (candidate) {
+        std::lock_guard<std::mutex> lock(mutex);
+        by_signature.emplace(map.signature, Entry{digest, {path}});
+    }
+    return digest;
+}
+
+SharedExtentStats SharedExtentCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+std::vector<std::vector<fs::path>> SharedExtentCache::shared_groups() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::vector<fs::path>> groups;
+    for (const auto& [signature, entry] : by_signature) {
+        if (entry.paths.size() > 1) {
+            groups.push_back(entry.paths);
+        }
+    }
+    std::sort(groups.begin(), groups.end());
+    return groups;
+}
@@ -0,0 +1,339 @@
+#include "TarArchive.hpp"
+#include "Hex.hpp"
+#include "Instrumentation.hpp"
+#include "Tracer.hpp"
+#include "TreeHash.hpp"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if FSF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t block_size = 512;
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The archive as a byte stream. With zlib, gzread also passes plain files
+// through unchanged, so one reader serves both.
+class ArchiveSource {
+public:
+    explicit ArchiveSource(const fs::path& path) : path(path) {
+        ScopedPhase open(Phase::Read, Operation::Open);
+#if FSF_HAVE_ZLIB
+        file = gzopen(path.c_str(), "rb");
+        if (!file) {
+            throw std::runtime_error("Unable to open archive: " + path.string());
+        }
+        gzbuffer(file, 128 << 10);
+#else
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open archive: " + path.string());
+        }
+#endif
+    }
+
+    ~ArchiveSource() {
+#if FSF_HAVE_ZLIB
+        gzclose(file);
+#else
+        ::close(fd);
+#endif
+    }
+
+    ArchiveSource(const ArchiveSource&) = delete;
+    ArchiveSource& operator=(const ArchiveSource&) = delete;
+
+    // Fills buffer completely; false only at a clean end of input
+    bool read(void* buffer, size_t size) {
+        ScopedPhase read(Phase::Read);
+        char* p = static_cast<char*>(buffer);
+        size_t total = 0;
+        while (total < size) {
+#if FSF_HAVE_ZLIB
+            int n = gzread(file, p + total, static_cast<unsigned>(size - total));
+            if (n < 0) {
+                int code = 0;
+                throw std::runtime_error("Unable to read archive " + path.string() + ": " + gzerror(file, &code));
+            }
+#else
+            ssize_t n = ::read(fd, p + total, size - total);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                throw std::runtime_error("Unable to read archive " + path.string() + ": " + std::strerror(errno));
+            }
+#endif
+            if (n == 0) {
+                if (total == 0) {
+                    return false;
+                }
+                throw std::runtime_error("Truncated archive: " + path.string());
+            }
+            total += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void skip(uintmax_t size) {
+        char buffer[block_size * 16];
+        while (size > 0) {
+            size_t chunk = static_cast<size_t>(std::min<uintmax_t>(size, sizeof(buffer)));
+            if (!read(buffer, chunk)) {
+                throw std::runtime_error("Truncated archive: " + path.string());
+            }
+            size -= chunk;
+        }
+    }
+
+private:
+    fs::path path;
+#if FSF_HAVE_ZLIB
+    gzFile file;
+#else
+    int fd;
+#endif
+};
+
+std::string field_string(const char* field, size_t size) {
+    return std::string(field, std::find(field, field + size, '\0'));
+}
+
+// Octal, or base-256 big-endian when the top bit is set (GNU, for values
+// that do not fit the octal field)
+uintmax_t field_number(const char* field, size_t size) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(field);
+    uintmax_t value = 0;
+    if (bytes[0] & 0x80) {
+        value = bytes[0] & 0x7f;
+        for (size_t i = 1; i < size; ++i) {
+            value = value << 8 | bytes[i];
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < size && (field[i] == ' ' || field[i] == '\0')) {
+        ++i;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; ++i) {
+        value = value << 3 | static_cast<uintmax_t>(field[i] - '0');
+    }
+    return value;
+}
+
+bool checksum_matches(const char* header) {
+    uintmax_t stored = field_number(header + 148, 8);
+    uintmax_t sum = 0;
+    for (size_t i = 0; i < block_size; ++i) {
+        sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(header[i]);
+    }
+    return sum == stored;
+}
+
+// Records of a pax extended header: "<length> <key>=<value>\n"
+void parse_pax(const std::string& data, std::string& path, uintmax_t& size, bool& has_size, int64_t& mtime, bool& has_mtime) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t space = data.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+        size_t length = std::strtoull(data.c_str() + pos, nullptr, 10);
+        if (length == 0 || pos + length > data.size()) {
+            break;
+        }
+        std::string record = data.substr(space + 1, pos + length - space - 2);
+        size_t equals = record.find('=');
+        if (equals != std::string::npos) {
+            std::string key = record.substr(0, equals);
+            std::string value = record.substr(equals + 1);
+            if (key == "path") {
+                path = value;
+            } else if (key == "size") {
+                size = std::strtoull(value.c_str(), nullptr, 10);
+                has_size = true;
+            } else if (key == "mtime") {
+                mtime = std::strtoll(value.c_str(), nullptr, 10);
+                has_mtime = true;
+            }
+        }
+        pos += length;
+    }
+}
+
+// Member names are made relative and may not climb out of the archive
+std::string normalize_member(const std::string& name) {
+    fs::path normal = fs::path(name).lexically_normal().relative_path();
+    std::string text = normal.generic_string();
+    while (!text.empty() && text.back() == '/') {
+        text.pop_back();
+    }
+    if (text.empty() || text == "." || normal.begin()->string() == "..") {
+        return {};
+    }
+    return text;
+}
+
+std::string read_member_data(ArchiveSource& source, uintmax_t size) {
+    std::string data(static_cast<size_t>(size), '\0');
+    if (size > 0 && !source.read(data.data(), data.size())) {
+        throw std::runtime_error("Truncated archive");
+    }
+    uintmax_t padding = (block_size - size % block_size) % block_size;
+    source.skip(padding);
+    return field_string(data.data(), data.size());
+}
+
+} // namespace
+
+bool is_tar_archive(const fs::path& path) {
+    std::string name = path.filename().string();
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (ends_with(name, ".tar")) {
+        return true;
+    }
+#if FSF_HAVE_ZLIB
+    return ends_with(name, ".tar.gz") || ends_with(name, ".tgz");
+#else
+    return false;
+#endif
+}
+
+fs::path archive_member_path(const fs::path& archive, const std::string& member) {
+    fs::path path = archive;
+    path += archive_member_separator;
+    return path / member;
+}
+
+void for_each_tar_member(const fs::path& archive, const std::function<void(const TarMember&)>& on_member,
+                         const CancellationToken* cancel) {
+    TraceSpan span("archive", archive);
+    ArchiveSource source(archive);
+
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> md_ctx(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    if (!md_ctx) {
+        throw std::runtime_error("Failed to create EVP_MD_CTX");
+    }
+
+    // Overrides from a preceding pax or GNU long-name header
+    std::string next_path;
+    uintmax_t next_size = 0;
+    bool has_next_size = false;
+    int64_t next_mtime = 0;
+    bool has_next_mtime = false;
+
+    char header[block_size];
+    std::vector<char> buffer(64 << 10);
+    while (source.read(header, sizeof(header))) {
+        throw_if_stopped(cancel);
+        // The archive ends with zero blocks
+        if (std::all_of(header, header + block_size, [](char c) { return c == '\0'; })) {
+            break;
+        }
+        if (!checksum_matches(header)) {
+            throw std::runtime_error("Corrupt tar header in " + archive.string());
+        }
+
+        char type = header[156];
+        uintmax_t size = field_number(header + 124, 12);
+        if (type == 'x') {
+            parse_pax(read_member_data(source, size), next_path, next_size, has_next_size,
+                      next_mtime, has_next_mtime);
+            continue;
+        }
+        if (type == 'L') {
+            next_path = read_member_data(source, size);
+            continue;
+        }
+
+        // Only POSIX ustar has a name prefix; old GNU headers, magic
+        // "ustar  \0", keep atime and ctime there instead
+        std::string name = field_string(header, 100);
+        if (std::memcmp(header + 257, "ustar", 6) == 0 && header[345] != '\0') {
+            name = field_string(header + 345, 155) + "/" + name;
+        }
+        TarMember member;
+        member.path = normalize_member(next_path.empty() ? name : next_path);
+        member.size = has_next_size ? next_size : size;
+        member.mtime = has_next_mtime ? next_mtime : static_cast<int64_t>(field_number(header + 136, 12));
+        next_path.clear();
+        has_next_size = false;
+        has_next_mtime = false;
+
+        // Hard links, symlinks and directories carry no data; anything else
+        // that is not a regular file is skipped over
+        uintmax_t padded = (member.size + block_size - 1) / block_size * block_size;
+        bool regular = type == '0' || type == '\0' || type == '7';
+        if (!regular || member.path.empty()) {
+            source.skip(type == '1' || type == '2' || type == '5' ? 0 : padded);
+            continue;
+        }
+
+        // A member large enough is tree hashed, streamed in order, so it
+        // matches the same content outside an archive
+        PhaseTimes started = instrumentation::thread_phase_times();
+        std::optional<TreeHasher> tree;
+        if (tree_hash::applies(member.size)) {
+            tree.emplace();
+        } else if (!EVP_DigestInit_ex(md_ctx.get(), EVP_md5(), nullptr)) {
+            throw std::runtime_error("EVP_DigestInit_ex failed");
+        }
+        uintmax_t remaining = member.size;
+        while (remaining > 0) {
+            size_t chunk = static_cast<size_t>(std::min<uintmax_t>(remaining, buffer.size()));
+            throw_if_stopped(cancel);
+            if (!source.read(buffer.data(), chunk)) {
+                throw std::runtime_error("Truncated archive: " + archive.string());
+            }
+            ScopedPhase hash(Phase::Hash);
+            if (tree) {
+                tree->update(buffer.data(), chunk);
+            } else if (!EVP_DigestUpdate(md_ctx.get(), buffer.data(), chunk)) {
+                throw std::runtime_error("EVP_DigestUpdate failed");
+            }
+            remaining -= chunk;
+        }
+        if (tree) {
+            ScopedPhase hash(Phase::Hash);
+            member.digest = tree->finish();
+        } else {
+            unsigned char md[EVP_MAX_MD_SIZE];
+            unsigned int md_len = 0;
+            {
+                ScopedPhase hash(Phase::Hash);
+                if (!EVP_DigestFinal_ex(md_ctx.get(), md, &md_len)) {
+                    throw std::runtime_error("EVP_DigestFinal_ex failed");
+                }
+            }
+            member.digest = to_hex(md, md_len);
+        }
+        source.skip(padded - member.size);
+
+        if (instrumentation::stats_enabled()) {
+            PhaseTimes spent = instrumentation::thread_phase_times() - started;
+            instrumentation::record(Operation::Read, spent[Phase::Read], member.size);
+            instrumentation::record(Operation::Hash, spent[Phase::Hash], member.size);
+        }
+        on_member(member);
+    }
+}
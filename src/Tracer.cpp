@@ -0,0 +1,218 @@
+#include "Tracer.hpp"
+#include "Json.hpp"
+#include "MemoryAccounting.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::atomic<bool> tracing(false);
+std::atomic<size_t> capacity(trace::default_capacity);
+
+struct TraceEvent {
+    const char* name;
+    int64_t begin_ns;
+    int64_t end_ns;
+    char detail[96];
+};
+
+// Only the owning thread writes events; written is published with release
+// so write() sees complete slots
+struct ThreadTrace {
+    explicit ThreadTrace(size_t size) : events(size), tid(static_cast<uint32_t>(syscall(SYS_gettid))) {}
+
+    std::vector<TraceEvent, CountingAllocator<TraceEvent, MemoryCategory::Buffers>> events;
+    std::atomic<uint64_t> written{0};
+    uint32_t tid;
+};
+
+class TraceRegistry {
+public:
+    ThreadTrace* add(size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_unique<ThreadTrace>(size));
+        return buffers.back().get();
+    }
+
+    template <typename F>
+    void for_each(F&& f) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& buffer : buffers) {
+            f(*buffer);
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadTrace>> buffers;
+};
+
+// Buffers outlive their threads so events survive until written
+TraceRegistry& registry() {
+    static TraceRegistry* instance = new TraceRegistry;
+    return *instance;
+}
+
+thread_local ThreadTrace* thread_trace = nullptr;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+int64_t since_epoch(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count();
+}
+
+fs::path exit_path;
+
+void write_exit_trace() {
+    try {
+        trace::write(exit_path);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Warning: %s\n", e.what());
+    }
+}
+
+void append_microseconds(std::string& out, int64_t nanoseconds) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", nanoseconds / 1e3);
+    out += buffer;
+}
+
+} // namespace
+
+namespace trace {
+
+void start(size_t capacity_per_thread) {
+    capacity.store(std::max<size_t>(capacity_per_thread, 1), std::memory_order_relaxed);
+    tracing.store(true, std::memory_order_relaxed);
+}
+
+void stop() {
+    tracing.store(false, std::memory_order_relaxed);
+}
+
+bool enabled() {
+    return tracing.load(std::memory_order_relaxed);
+}
+
+void record(
+    const char* name,
+    std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end,
+    const char* detail
+) {
+    if (!enabled()) {
+        return;
+    }
+    if (!thread_trace) {
+        thread_trace = registry().add(capacity.load(std::memory_order_relaxed));
+    }
+
+    uint64_t index = thread_trace->written.load(std::memory_order_relaxed);
+    TraceEvent& event = thread_trace->events[index % thread_trace->events.size()];
+    event.name = name;
+    event.begin_ns = since_epoch(begin);
+    event.end_ns = since_epoch(end);
+    event.detail[0] = '\0';
+    if (detail) {
+        // The end of a path says more than its start
+        size_t length = std::strlen(detail);
+        size_t keep = std::min(length, sizeof(event.detail) - 1);
+        std::memcpy(event.detail, detail + length - keep, keep);
+        event.detail[keep] = '\0';
+    }
+    thread_trace->written.store(index + 1, std::memory_order_release);
+}
+
+size_t write(const fs::path& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to write trace: " + path.string());
+    }
+
+    std::string pid = std::to_string(getpid());
+    size_t count = 0;
+    uint64_t dropped = 0;
+    std::string line;
+    const char* separator = "\n";
+
+    out << "{\"traceEvents\":[";
+    registry().for_each([&](const ThreadTrace& buffer) {
+        uint64_t written = buffer.written.load(std::memory_order_acquire);
+        uint64_t size = buffer.events.size();
+        uint64_t first = written > size ? written - size : 0;
+        dropped += first;
+
+        std::string tid = std::to_string(buffer.tid);
+        line = separator;
+        line += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid +
+                ",\"args\":{\"name\":\"fsf-" + tid + "\"}}";
+        out << line;
+        separator = ",\n";
+
+        for (uint64_t i = first; i < written; ++i) {
+            const TraceEvent& event = buffer.events[i % size];
+            line = ",\n{\"name\":";
+            append_json_string(line, event.name);
+            line += ",\"cat\":\"scan\",\"ph\":\"X\",\"ts\":";
+            append_microseconds(line, event.begin_ns);
+            line += ",\"dur\":";
+            append_microseconds(line, event.end_ns - event.begin_ns);
+            line += ",\"pid\":" + pid + ",\"tid\":" + tid;
+            if (event.detail[0]) {
+                line += ",\"args\":{\"path\":";
+                append_json_string(line, event.detail);
+                line += '}';
+            }
+            line += '}';
+            out << line;
+            ++count;
+        }
+    });
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << dropped << "}}\n";
+    return count;
+}
+
+void write_at_exit(const fs::path& path) {
+    bool first = exit_path.empty();
+    exit_path = path;
+    if (first) {
+        std::atexit(write_exit_trace);
+    }
+}
+
+void clear() {
+    registry().for_each([](ThreadTrace& buffer) {
+        buffer.written.store(0, std::memory_order_release);
+    });
+}
+
+} // namespace trace
+
+TraceSpan::TraceSpan(const char* name, const fs::path& detail)
+    : name(name), detail(nullptr) {
+    if (trace::enabled()) {
+        this->detail = &detail;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (detail) {
+        trace::record(name, start, std::chrono::steady_clock::now(), detail->c_str());
+    }
+}
@@ -0,0 +1,250 @@
+#include "TreeHash.hpp"
+#include "Hex.hpp"
+#include "Instrumentation.hpp"
+#include "Tracer.hpp"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t leaf_size = 16;
+constexpr char domain[] = "fsf-tree-md5";
+
+std::atomic<uintmax_t> threshold_bytes(0);
+std::atomic<unsigned> thread_limit(0);
+
+struct ContextDeleter {
+    void operator()(EVP_MD_CTX* context) const { EVP_MD_CTX_free(context); }
+};
+
+using Context = std::unique_ptr<EVP_MD_CTX, ContextDeleter>;
+
+Context new_context() {
+    Context context(EVP_MD_CTX_new());
+    if (!context) {
+        throw std::runtime_error("Failed to create EVP_MD_CTX");
+    }
+    return context;
+}
+
+void md5(EVP_MD_CTX* context, const void* data, size_t size, unsigned char* out) {
+    unsigned int length = 0;
+    if (!EVP_DigestInit_ex(context, EVP_md5(), nullptr) || !EVP_DigestUpdate(context, data, size) ||
+        !EVP_DigestFinal_ex(context, out, &length)) {
+        throw std::runtime_error("MD5 digest failed");
+    }
+}
+
+void put_le64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+// The root over the leaf digests, as documented in TreeHash.hpp
+std::string combine(const std::vector<unsigned char>& leaves, uint64_t size) {
+    unsigned char header[sizeof(domain) + 16];
+    std::memcpy(header, domain, sizeof(domain));
+    put_le64(header + sizeof(domain), tree_hash_chunk_size);
+    put_le64(header + sizeof(domain) + 8, size);
+
+    Context context = new_context();
+    unsigned char root[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (!EVP_DigestInit_ex(context.get(), EVP_md5(), nullptr) ||
+        !EVP_DigestUpdate(context.get(), header, sizeof(header)) ||
+        !EVP_DigestUpdate(context.get(), leaves.data(), leaves.size()) ||
+        !EVP_DigestFinal_ex(context.get(), root, &length)) {
+        throw std::runtime_error("MD5 digest failed");
+    }
+    return to_hex(root, length);
+}
+
+// Reads size bytes at offset, or fewer only at end of file; -1 on error
+ssize_t pread_full(int fd, char* buffer, size_t size, uint64_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = ::pread(fd, buffer + total, size - total, static_cast<off_t>(offset + total));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    return static_cast<ssize_t>(total);
+}
+
+} // namespace
+
+TreeHasher::TreeHasher() {
+    pending.reserve(tree_hash_chunk_size);
+}
+
+void TreeHasher::update(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        size_t take = std::min(size, tree_hash_chunk_size - pending.size());
+        pending.insert(pending.end(), bytes, bytes + take);
+        bytes += take;
+        size -= take;
+        total += take;
+        if (pending.size() == tree_hash_chunk_size) {
+            close_leaf();
+        }
+    }
+}
+
+void TreeHasher::close_leaf() {
+    thread_local Context context = new_context();
+    leaves.resize(leaves.size() + leaf_size);
+    md5(context.get(), pending.data(), pending.size(), leaves.data() + leaves.size() - leaf_size);
+    pending.clear();
+}
+
+std::string TreeHasher::finish() {
+    if (!pending.empty()) {
+        close_leaf();
+    }
+    std::string digest = combine(leaves, total);
+    leaves.clear();
+    total = 0;
+    return digest;
+}
+
+std::string tree_hash_file(const fs::path& path, unsigned threads, const CancellationToken* cancel) {
+    TraceSpan span("tree-hash", path);
+    int fd;
+    {
+        ScopedPhase open(Phase::Read, Operation::Open);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open file: " + path.string());
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Unable to stat file: " + path.string());
+    }
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    size_t chunk_count = static_cast<size_t>((size + tree_hash_chunk_size - 1) / tree_hash_chunk_size);
+    std::vector<unsigned char> leaves(chunk_count * leaf_size);
+
+    if (!threads) {
+        threads = tree_hash::threads();
+    }
+    unsigned thread_count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    thread_count = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(thread_count, chunk_count)));
+    std::vector<std::exception_ptr> errors(thread_count);
+    std::vector<PhaseTimes> spent(thread_count);
+
+    // Workers claim chunks in order, so reads stay roughly sequential on
+    // disk while each core hashes its own chunk
+    std::atomic<size_t> next_chunk(0);
+    auto worker = [&](unsigned id) {
+        PhaseTimes started = instrumentation::thread_phase_times();
+        try {
+            Context context = new_context();
+            std::unique_ptr<char[]> buffer(new char[tree_hash_chunk_size]);
+            for (;;) {
+                size_t chunk = next_chunk.fetch_add(1);
+                if (chunk >= chunk_count) {
+                    break;
+                }
+                throw_if_stopped(cancel);
+                uint64_t offset = static_cast<uint64_t>(chunk) * tree_hash_chunk_size;
+                size_t length = static_cast<size_t>(std::min<uint64_t>(tree_hash_chunk_size, size - offset));
+                ssize_t n;
+                {
+                    ScopedPhase read(Phase::Read);
+                    n = pread_full(fd, buffer.get(), length, offset);
+                }
+                if (n < 0) {
+                    throw std::runtime_error("Unable to read file: " + path.string());
+                }
+                if (static_cast<size_t>(n) < length) {
+                    throw std::runtime_error("File shrank while hashing: " + path.string());
+                }
+                ScopedPhase hash(Phase::Hash);
+                md5(context.get(), buffer.get(), length, leaves.data() + chunk * leaf_size);
+            }
+        } catch (...) {
+            errors[id] = std::current_exception();
+            next_chunk.store(chunk_count);
+        }
+        spent[id] = instrumentation::thread_phase_times() - started;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned id = 1; id < thread_count; ++id) {
+        workers.emplace_back(worker, id);
+    }
+    worker(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    ::close(fd);
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Helper threads' time is charged to the calling thread, so phase
+    // totals cover the whole file as they would for a plain MD5
+    PhaseTimes total;
+    for (unsigned id = 0; id < thread_count; ++id) {
+        total += spent[id];
+        if (id) {
+            instrumentation::add_phase_time(Phase::Read, spent[id][Phase::Read]);
+            instrumentation::add_phase_time(Phase::Hash, spent[id][Phase::Hash]);
+        }
+    }
+    if (instrumentation::stats_enabled()) {
+        instrumentation::record(Operation::Read, total[Phase::Read], size);
+        instrumentation::record(Operation::Hash, total[Phase::Hash], size);
+    }
+
+    ScopedPhase hash(Phase::Hash);
+    return combine(leaves, size);
+}
+
+namespace tree_hash {
+
+void set_threshold(uintmax_t bytes) {
+    threshold_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+uintmax_t threshold() {
+    return threshold_bytes.load(std::memory_order_relaxed);
+}
+
+void set_threads(unsigned threads) {
+    thread_limit.store(threads, std::memory_order_relaxed);
+}
+
+unsigned threads() {
+    return thread_limit.load(std::memory_order_relaxed);
+}
+
+} // namespace tree_hash
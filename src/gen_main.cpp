@@ -0,0 +1,121 @@
+#include "CorpusGenerator.hpp"
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <output-directory>\n"
+              << "Options:\n"
+              << "  --seed <n>              random seed (1)\n"
+              << "  --files <n>             number of files (1000)\n"
+              << "  --depth <n>             maximum directory depth (3)\n"
+              << "  --fanout <n>            subdirectories per level (8)\n"
+              << "  --min-size <size>       smallest regular file (0)\n"
+              << "  --max-size <size>       largest regular file (64K)\n"
+              << "  --huge-ratio <r>        fraction of dense files of --huge-size (0)\n"
+              << "  --sparse-ratio <r>      fraction of sparse files of --huge-size (0)\n"
+              << "  --huge-size <size>      size of huge and sparse files (1G)\n"
+              << "  --dup-ratio <r>         fraction of exact copies (0.1)\n"
+              << "  --hardlink-ratio <r>    fraction of hardlinks (0)\n"
+              << "  --near-dup-ratio <r>    fraction of copies with flipped bytes (0)\n"
+              << "  --mutations <n>         bytes flipped per near duplicate (1)\n"
+              << "  --threads <n>           writer threads (hardware concurrency)\n"
+              << "Sizes accept K, M, G and T suffixes.\n";
+}
+
+uintmax_t parse_size(const std::string& text) {
+    size_t consumed = 0;
+    uintmax_t value = std::stoull(text, &consumed);
+    if (consumed < text.size()) {
+        switch (std::toupper(static_cast<unsigned char>(text[consumed]))) {
+            case 'K': value <<= 10; break;
+            case 'M': value <<= 20; break;
+            case 'G': value <<= 30; break;
+            case 'T': value <<= 40; break;
+            default: throw std::invalid_argument("bad size suffix in " + text);
+        }
+    }
+    return value;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    CorpusSpec spec;
+    std::filesystem::path output;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                print_usage(argv[0]);
+                return 0;
+            }
+            if (arg.rfind("--", 0) != 0) {
+                output = arg;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " requires a value\n";
+                return 1;
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--seed") spec.seed = std::stoull(value);
+            else if (arg == "--files") spec.file_count = std::stoull(value);
+            else if (arg == "--depth") spec.depth = std::stoull(value);
+            else if (arg == "--fanout") spec.fanout = std::stoull(value);
+            else if (arg == "--min-size") spec.min_size = parse_size(value);
+            else if (arg == "--max-size") spec.max_size = parse_size(value);
+            else if (arg == "--huge-ratio") spec.huge_ratio = std::stod(value);
+            else if (arg == "--sparse-ratio") spec.sparse_ratio = std::stod(value);
+            else if (arg == "--huge-size") spec.huge_size = parse_size(value);
+            else if (arg == "--dup-ratio") spec.duplicate_ratio = std::stod(value);
+            else if (arg == "--hardlink-ratio") spec.hardlink_ratio = std::stod(value);
+            else if (arg == "--near-dup-ratio") spec.near_duplicate_ratio = std::stod(value);
+            else if (arg == "--mutations") spec.near_duplicate_mutations = std::stoull(value);
+            else if (arg == "--threads") spec.threads = static_cast<unsigned>(std::stoul(value));
+            else {
+                std::cerr << "Error: Unknown option " << arg << "\n";
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: Invalid option value (" << e.what() << ")\n";
+        return 1;
+    }
+
+    if (output.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        CorpusStats stats = CorpusGenerator(spec).generate(output);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "Generated " << stats.files << " files in " << output.string() << "\n"
+                  << "  unique:          " << stats.unique << "\n"
+                  << "  duplicates:      " << stats.duplicates << "\n"
+                  << "  near duplicates: " << stats.near_duplicates << "\n"
+                  << "  hardlinks:       " << stats.hardlinks << "\n"
+                  << "  huge / sparse:   " << stats.huge << " / " << stats.sparse << "\n"
+                  << "  logical bytes:   " << stats.logical_bytes << "\n"
+                  << "  written bytes:   " << stats.written_bytes << "\n"
+                  << std::fixed << std::setprecision(3)
+                  << "  elapsed:         " << seconds << " s ("
+                  << (seconds > 0 ? stats.written_bytes / seconds / (1 << 20) : 0.0) << " MB/s)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -1,26 +1,51 @@
+#include "Cancellation.hpp"
+#include "Deduplicator.hpp"
 #include "DirectoryComparer.hpp"
+#include "ExternalDuplicateFinder.hpp"
+#include "FileHashMapper.hpp"
+#include "IndexWatcher.hpp"
+#include "Json.hpp"
+#include "OverlapMatrix.hpp"
+#include "Progress.hpp"
+#include "QueryServer.hpp"
+#include "ScanPipeline.hpp"
+#include "Sharding.hpp"
+#include "Tracer.hpp"
+#include "TreeHash.hpp"
 #include <iostream>
 #include <filesystem>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <iomanip>
 #include <numeric>
 #include <cmath>
 #include <fstream>
 #include <ctime>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <thread>
+#include <map>
+#include <memory>
+#include <optional>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Performance measurement structure
 struct PerformanceResult {
     double total_time_ms = 0.0;
     std::vector<double> individual_times;
+    ComparisonResult comparison;
 };
 
 // Run comparison and measure performance
 PerformanceResult run_comparison_with_timing(
     const std::vector<std::filesystem::path>& directories, 
     ComparisonMode mode, 
-    const std::vector<std::string>& exclude_folders
+    const std::vector<std::string>& exclude_folders,
+    const ComparisonOptions& options
 ) {
     PerformanceResult results;
     
@@ -28,7 +53,7 @@ PerformanceResult run_comparison_with_timing(
     auto start = std::chrono::high_resolution_clock::now();
     
     try {
-        DirectoryComparer::compare_directories(directories, mode, exclude_folders);
+        results.comparison = DirectoryComparer::compare_directories(directories, mode, exclude_folders, options);
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << '\n';
@@ -45,6 +70,358 @@ PerformanceResult run_comparison_with_timing(
     return results;
 }
 
+// Summary of a series of run times. Percentiles are nearest-rank, so every
+// reported value is one that was actually measured.
+struct TimingSummary {
+    double mean = 0.0;
+    double stdev = 0.0;
+    double min = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+TimingSummary summarize(std::vector<double> times) {
+    TimingSummary summary;
+    if (times.empty()) {
+        return summary;
+    }
+    std::sort(times.begin(), times.end());
+    auto percentile = [&times](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * times.size()));
+        return times[std::max<size_t>(rank, 1) - 1];
+    };
+
+    summary.mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    if (times.size() > 1) {
+        double sq_sum = 0.0;
+        for (double time : times) {
+            sq_sum += std::pow(time - summary.mean, 2);
+        }
+        summary.stdev = std::sqrt(sq_sum / (times.size() - 1));
+    }
+    summary.min = times.front();
+    summary.p50 = percentile(50);
+    summary.p90 = percentile(90);
+    summary.p99 = percentile(99);
+    summary.max = times.back();
+    return summary;
+}
+
+// Ask the kernel to drop cached pages of every file under the directories so
+// the next run reads from the device. Dirty pages are not dropped, so this
+// only gives a cold cache for data that has already been written back.
+size_t evict_page_cache(
+    const std::vector<std::filesystem::path>& directories,
+    const std::vector<std::string>& exclude_folders
+) {
+    size_t evicted = 0;
+    for (const auto& dir : directories) {
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator it(dir, ec), end;
+        for (; !ec && it != end; it.increment(ec)) {
+            if (it->is_directory(ec)) {
+                std::string name = it->path().filename().string();
+                if (std::find(exclude_folders.begin(), exclude_folders.end(), name) != exclude_folders.end()) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+            if (!it->is_regular_file(ec)) {
+                continue;
+            }
+            int fd = ::open(it->path().c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                continue;
+            }
+            if (::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0) {
+                ++evicted;
+            }
+            ::close(fd);
+        }
+    }
+    return evicted;
+}
+
+const char* mode_name(ComparisonMode mode) {
+    switch (mode) {
+        case ComparisonMode::All: return "all";
+        case ComparisonMode::OnlyDifferent: return "different";
+        case ComparisonMode::OnlySame: return "same";
+        case ComparisonMode::OnlyUnique: return "unique";
+    }
+    return "unknown";
+}
+
+void append_summary(std::string& out, const TimingSummary& summary) {
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\"mean\":%.3f,\"stdev\":%.3f,\"min\":%.3f,\"p50\":%.3f,"
+                  "\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                  summary.mean, summary.stdev, summary.min, summary.p50,
+                  summary.p90, summary.p99, summary.max);
+    out += buffer;
+}
+
+void append_times(std::string& out, const std::vector<double>& times) {
+    out += '[';
+    char buffer[32];
+    for (size_t i = 0; i < times.size(); ++i) {
+        std::snprintf(buffer, sizeof(buffer), "%s%.3f", i ? "," : "", times[i]);
+        out += buffer;
+    }
+    out += ']';
+}
+
+// Write the measured runs to path: one CSV row per run when the name ends in
+// .csv, otherwise a JSON document with summaries and the raw samples
+void write_benchmark_results(
+    const std::filesystem::path& path,
+    const std::vector<std::filesystem::path>& directories,
+    ComparisonMode mode,
+    int warmup,
+    bool cold_cache,
+    const std::vector<double>& wall_times,
+    const std::vector<PhaseTimes>& phase_times,
+    const MemoryUsage& memory_usage
+) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to write benchmark results: " + path.string());
+    }
+
+    if (path.extension() == ".csv") {
+        out << "run,wall_ms";
+        for (size_t p = 0; p < phase_count; ++p) {
+            out << ',' << phase_name(static_cast<Phase>(p)) << "_ms";
+        }
+        out << '\n' << std::fixed << std::setprecision(3);
+        for (size_t i = 0; i < wall_times.size(); ++i) {
+            out << i << ',' << wall_times[i];
+            for (size_t p = 0; p < phase_count; ++p) {
+                out << ',' << phase_times[i].milliseconds(static_cast<Phase>(p));
+            }
+            out << '\n';
+        }
+        return;
+    }
+
+    std::time_t now = std::time(nullptr);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::string json = "{\"timestamp\":";
+    append_json_string(json, timestamp);
+    json += ",\"mode\":";
+    append_json_string(json, mode_name(mode));
+    json += ",\"directories\":[";
+    for (size_t i = 0; i < directories.size(); ++i) {
+        if (i) {
+            json += ',';
+        }
+        append_json_string(json, directories[i].string());
+    }
+    json += "],\"warmup\":" + std::to_string(warmup);
+    json += ",\"repetitions\":" + std::to_string(wall_times.size());
+    json += ",\"cold_cache\":";
+    json += cold_cache ? "true" : "false";
+    json += ",\"wall_ms\":";
+    append_summary(json, summarize(wall_times));
+    json += ",\"runs_ms\":";
+    append_times(json, wall_times);
+    json += ",\"phases_ms\":{";
+    for (size_t p = 0; p < phase_count; ++p) {
+        Phase phase = static_cast<Phase>(p);
+        std::vector<double> samples;
+        for (const auto& times : phase_times) {
+            samples.push_back(times.milliseconds(phase));
+        }
+        if (p) {
+            json += ',';
+        }
+        append_json_string(json, phase_name(phase));
+        json += ":{\"summary\":";
+        append_summary(json, summarize(samples));
+        json += ",\"runs\":";
+        append_times(json, samples);
+        json += '}';
+    }
+    json += "},\"memory\":{\"peak_rss_bytes\":" + std::to_string(memory_usage.peak_rss_bytes);
+    for (size_t c = 0; c < memory_category_count; ++c) {
+        const CategoryUsage& category = memory_usage.categories[c];
+        json += ",";
+        append_json_string(json, memory_category_name(static_cast<MemoryCategory>(c)));
+        json += ":{\"allocations\":" + std::to_string(category.allocations) +
+                ",\"peak_bytes\":" + std::to_string(category.peak_bytes) + "}";
+    }
+    json += "}}\n";
+    out << json;
+}
+
+// Count, volume and latency distribution of each instrumented operation
+void print_operation_stats(const ScanStats& stats) {
+    std::cout << "\nOperation Stats:\n";
+    std::cout << "  " << std::left << std::setw(6) << "op" << std::right
+              << std::setw(10) << "count" << std::setw(14) << "bytes"
+              << std::setw(11) << "mean us" << std::setw(11) << "p50 us"
+              << std::setw(11) << "p99 us" << std::setw(11) << "max us" << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t op = 0; op < operation_count; ++op) {
+        Operation operation = static_cast<Operation>(op);
+        const OperationStats& s = stats[operation];
+        std::cout << "  " << std::left << std::setw(6) << operation_name(operation) << std::right
+                  << std::setw(10) << s.count << std::setw(14) << s.bytes
+                  << std::setw(11) << s.mean_nanoseconds() / 1e3
+                  << std::setw(11) << s.percentile_nanoseconds(50) / 1e3
+                  << std::setw(11) << s.percentile_nanoseconds(99) / 1e3
+                  << std::setw(11) << s.max_nanoseconds / 1e3 << "\n";
+    }
+}
+
+// Counter totals per phase, then per file and per byte scanned. Events the
+// kernel would not open are shown as n/a rather than as zero.
+void print_perf_counters(const PhaseCounters& counters, size_t files, uintmax_t bytes) {
+    std::cout << "\nPerf Counters:\n";
+    std::string reason = perf::unavailable_reason();
+    if (!reason.empty()) {
+        std::cout << "  unavailable: " << reason << "\n";
+    }
+
+    bool any_available = false;
+    std::cout << "  " << std::left << std::setw(10) << "phase" << std::right;
+    for (size_t e = 0; e < perf_event_count; ++e) {
+        std::cout << std::setw(18) << perf_event_name(static_cast<PerfEvent>(e));
+        any_available = any_available || perf::event_available(static_cast<PerfEvent>(e));
+    }
+    std::cout << "\n";
+    if (!any_available) {
+        return;
+    }
+
+    auto print_row = [](const std::string& label, auto value_of) {
+        std::cout << "  " << std::left << std::setw(10) << label << std::right;
+        for (size_t e = 0; e < perf_event_count; ++e) {
+            PerfEvent event = static_cast<PerfEvent>(e);
+            if (perf::event_available(event)) {
+                std::cout << std::setw(18) << value_of(event);
+            } else {
+                std::cout << std::setw(18) << "n/a";
+            }
+        }
+        std::cout << "\n";
+    };
+
+    for (size_t p = 0; p < phase_count; ++p) {
+        Phase phase = static_cast<Phase>(p);
+        print_row(phase_name(phase), [&](PerfEvent event) { return counters[phase][event]; });
+    }
+    PerfSample total = counters.total();
+    print_row("total", [&](PerfEvent event) { return total[event]; });
+    std::cout << std::fixed << std::setprecision(3);
+    print_row("per file", [&](PerfEvent event) {
+        return files ? static_cast<double>(total[event]) / files : 0.0;
+    });
+    print_row("per byte", [&](PerfEvent event) {
+        return bytes ? static_cast<double>(total[event]) / bytes : 0.0;
+    });
+}
+
+// Peak RSS and, per category, allocation count and live and peak bytes
+void print_memory_usage(const MemoryUsage& usage) {
+    std::cout << std::fixed << std::setprecision(1)
+              << "  Memory: peak RSS " << usage.peak_rss_bytes / 1e6 << " MB, current "
+              << usage.current_rss_bytes / 1e6 << " MB\n";
+    for (size_t c = 0; c < memory_category_count; ++c) {
+        const CategoryUsage& category = usage.categories[c];
+        std::cout << "    " << std::left << std::setw(8) << memory_category_name(static_cast<MemoryCategory>(c))
+                  << std::right << std::setw(12) << category.allocations << " allocs"
+                  << std::setw(12) << category.peak_bytes << " peak bytes"
+                  << std::setw(12) << category.live_bytes << " live\n";
+    }
+}
+
+// Print one comparison entry as "<status> <path>"
+void print_entry(const ComparisonEntry& entry, const std::vector<std::filesystem::path>& directories) {
+    const char* status = "";
+    switch (entry.status) {
+        case EntryStatus::Same: status = "same"; break;
+        case EntryStatus::Different: status = "different"; break;
+        case EntryStatus::Unique: status = "unique"; break;
+    }
+
+    std::cout << std::left << std::setw(11) << status << entry.relative_path.string();
+    if (entry.is_directory) {
+        std::cout << "/ (" << entry.file_count << " files)";
+    }
+    if (entry.incomplete) {
+        std::cout << " (incomplete)";
+    }
+
+    // Name the directories holding the entry unless it is in all of them
+    if (std::find(entry.present.begin(), entry.present.end(), false) != entry.present.end()) {
+        std::cout << " [";
+        const char* separator = "";
+        for (size_t i = 0; i < entry.present.size(); ++i) {
+            if (entry.present[i]) {
+                std::cout << separator << directories[i].string();
+                separator = ", ";
+            }
+        }
+        std::cout << "]";
+    }
+    std::cout << "\n";
+}
+
+// Print one line per comparison entry, then any duplicated directories
+void print_comparison_result(
+    const ComparisonResult& result,
+    const std::vector<std::filesystem::path>& directories
+) {
+    for (const auto& entry : result.entries) {
+        print_entry(entry, directories);
+    }
+
+    if (!result.duplicate_directories.empty()) {
+        std::cout << "\nDuplicate directories:\n";
+        for (const auto& group : result.duplicate_directories) {
+            std::cout << "  " << group.directories.size() << " copies of "
+                      << group.file_count << " files, " << group.size << " bytes each:\n";
+            for (const auto& dir : group.directories) {
+                std::cout << "    " << dir.string() << "\n";
+            }
+        }
+    }
+
+    if (!result.already_deduplicated.empty()) {
+        std::cout << "\nAlready deduplicated (shared extents):\n";
+        for (const auto& group : result.already_deduplicated) {
+            std::cout << "  " << group.size() << " files sharing storage:\n";
+            for (const auto& path : group) {
+                std::cout << "    " << path.string() << "\n";
+            }
+        }
+    }
+
+    if (!result.complete) {
+        std::cout << "\nScan stopped early: partial results; entries marked (incomplete) were not fully compared\n";
+    }
+
+    std::cout << "\nFiles hashed: " << result.files_hashed
+              << ", settled by subtree match: " << result.files_pruned << "\n";
+    if (result.files_filtered > 0) {
+        std::cout << "Files filtered out unread: " << result.files_filtered << "\n";
+    }
+    if (result.shared_extents.files_queried > 0) {
+        std::cout << "Shared extents: " << result.shared_extents.files_shared << " files, "
+                  << result.shared_extents.bytes_avoided << " bytes not read";
+        if (result.shared_extents.unsupported > 0) {
+            std::cout << " (" << result.shared_extents.unsupported << " files could not be mapped)";
+        }
+        std::cout << "\n";
+    }
+}
+
 // Function to log times to file
 void log_times_to_file(
     int repetitions, 
@@ -67,14 +444,7 @@ void log_times_to_file(
     char timestamp[26];
     std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
 
-    // Convert mode to string
-    std::string mode_str;
-    switch (mode) {
-        case ComparisonMode::All: mode_str = "all"; break;
-        case ComparisonMode::OnlyDifferent: mode_str = "different"; break;
-        case ComparisonMode::OnlySame: mode_str = "same"; break;
-        case ComparisonMode::OnlyUnique: mode_str = "unique"; break;
-    }
+    std::string mode_str = mode_name(mode);
 
     // Construct directory list string
     std::string dir_list;
@@ -101,6 +471,280 @@ void log_times_to_file(
     }
 }
 
+std::atomic<bool> stop_requested(false);
+
+void request_stop(int) {
+    stop_requested = true;
+}
+
+// Keep the duplicate index of the directories current until interrupted
+int run_watch(
+    const std::vector<std::filesystem::path>& directories,
+    const std::vector<std::string>& exclude_folders,
+    std::chrono::milliseconds debounce
+) {
+    IndexWatcher watcher(directories, exclude_folders, debounce);
+    watcher.set_update_callback([](const WatchUpdate& update) {
+        std::cout << "Rehashed " << update.rehashed << ", removed " << update.removed
+                  << ": " << update.file_count << " files, "
+                  << update.duplicate_groups << " duplicate groups\n" << std::flush;
+    });
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+
+    watcher.start();
+    std::cout << "Watching " << watcher.index().file_count() << " files, "
+              << watcher.index().duplicate_group_count() << " duplicate groups\n" << std::flush;
+
+    while (!stop_requested) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    watcher.stop();
+    return 0;
+}
+
+// Serve queries against a live duplicate index until interrupted
+int run_server(
+    const std::vector<std::filesystem::path>& directories,
+    const std::vector<std::string>& exclude_folders,
+    std::chrono::milliseconds debounce,
+    const std::filesystem::path& socket_path
+) {
+    // Index keys are absolute so clients in any directory can query them
+    std::vector<std::filesystem::path> roots;
+    for (const auto& dir : directories) {
+        roots.push_back(std::filesystem::absolute(dir).lexically_normal());
+    }
+
+    IndexWatcher watcher(roots, exclude_folders, debounce);
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+
+    watcher.start();
+    QueryServer server(watcher.index(), socket_path);
+    server.start();
+    std::cout << "Serving " << watcher.index().file_count() << " files on "
+              << socket_path.string() << "\n" << std::flush;
+
+    while (!stop_requested) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    server.stop();
+    watcher.stop();
+    return 0;
+}
+
+// Content duplicates found within a memory budget. "all" lists every group
+// of identical files, "same" only contents found in more than one directory
+// and "unique" the files whose content is found in just one directory.
+int run_external(
+    const std::vector<std::filesystem::path>& directories,
+    ComparisonMode mode,
+    const std::vector<std::string>& exclude_folders,
+    const ExternalOptions& options
+) {
+    if (mode == ComparisonMode::OnlyDifferent) {
+        std::cerr << "Error: --memory-budget compares by content; use all, same or unique\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ExternalDuplicateFinder finder(directories, exclude_folders, options);
+    size_t groups = 0;
+    finder.run([&](const ExternalGroup& group) {
+        size_t roots = group.root_count();
+        if ((mode == ComparisonMode::OnlySame && roots < 2) ||
+            (mode == ComparisonMode::OnlyUnique && roots > 1)) {
+            return;
+        }
+        ++groups;
+        if (group.members.size() == 1) {
+            std::cout << "unique     " << (directories[group.members[0].root] / group.members[0].relative_path).string() << "\n";
+            return;
+        }
+        std::cout << group.members.size() << " copies, " << group.size << " bytes each"
+                  << (roots > 1 ? " (across directories)" : "") << ":\n";
+        for (const auto& member : group.members) {
+            std::cout << "    " << (directories[member.root] / member.relative_path).string() << "\n";
+        }
+    }, mode == ComparisonMode::OnlyUnique);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const ExternalStats& stats = finder.get_stats();
+    std::cout << "\nFiles hashed: " << stats.files << ", reported: " << groups
+              << ", runs spilled: " << stats.runs << ", merge passes: " << stats.merge_passes
+              << ", spilled bytes: " << stats.spilled_bytes << "\n";
+    std::cout << "Execution Time: " << std::fixed << std::setprecision(3) << elapsed << " ms\n";
+    print_memory_usage(memory::usage());
+    return 0;
+}
+
+// Combine the partial results of a sharded scan: the comparison entries the
+// mode asks for, then every group of identical files
+int run_merge(const std::vector<std::filesystem::path>& partials, ComparisonMode mode) {
+    PartialMerger merger(partials);
+    const auto& directories = merger.directories();
+    size_t entries = 0;
+    merger.merge_entries([&](const ComparisonEntry& entry) {
+        bool wanted = mode == ComparisonMode::All ||
+                      (mode == ComparisonMode::OnlySame && entry.status == EntryStatus::Same) ||
+                      (mode == ComparisonMode::OnlyDifferent && entry.status == EntryStatus::Different) ||
+                      (mode == ComparisonMode::OnlyUnique && entry.status == EntryStatus::Unique);
+        if (wanted) {
+            print_entry(entry, directories);
+            ++entries;
+        }
+    });
+
+    size_t groups = 0;
+    merger.merge_groups([&](const ExternalGroup& group) {
+        if (groups++ == 0) {
+            std::cout << "\nDuplicate files:\n";
+        }
+        std::cout << "  " << group.members.size() << " copies, " << group.size << " bytes each:\n";
+        for (const auto& member : group.members) {
+            std::cout << "    " << (directories[member.root] / member.relative_path).string() << "\n";
+        }
+    });
+    std::cout << "\nMerged " << partials.size() << " partials: " << entries << " entries, "
+              << groups << " duplicate groups\n";
+    return 0;
+}
+
+// Hash the directories, group identical files across all of them and hand
+// the groups to the deduplicator. The lexically first path of a group is
+// the copy that is kept. Files are fingerprinted first and only those that
+// could have a copy get an MD5; the deduplicator byte-compares in any case.
+// With use_pipeline the coroutine scan pipeline hashes every file instead,
+// reading and hashing on all threads. Unless options.threads fixes the
+// concurrency, it sizes each device's I/O depth itself; adaptive does so
+// even then and logs its decisions to stderr. A stopped
+// cancel token ends the scan early; the files hashed by then are still
+// deduplicated.
+int run_dedup(
+    const std::vector<std::filesystem::path>& directories,
+    const std::vector<std::string>& exclude_folders,
+    const DedupOptions& options,
+    const FileFilter& filter,
+    bool use_pipeline,
+    bool adaptive,
+    const CancellationToken* cancel
+) {
+    std::map<std::string, std::vector<std::filesystem::path>> paths_by_digest;
+    if (use_pipeline) {
+        PipelineOptions pipeline_options;
+        pipeline_options.threads = options.threads;
+        pipeline_options.adaptive = adaptive || !options.threads;
+        pipeline_options.decision_log = adaptive ? &std::cerr : nullptr;
+        pipeline_options.file_filter = filter;
+        ScanPipeline pipeline(directories, exclude_folders, pipeline_options);
+        for (auto& file : pipeline.run()) {
+            paths_by_digest[file.digest].push_back(directories[file.root] / file.relative_path);
+        }
+        const PipelineStats& stats = pipeline.get_stats();
+        std::cout << "Scanned " << stats.files << " files, " << stats.bytes << " bytes; peak queue depth "
+                  << stats.peak_queue_depth << "\n";
+        if (stats.filtered) {
+            std::cout << "Filtered out " << stats.filtered << " files unread\n";
+        }
+    } else {
+        // One mapper for all directories, so a fingerprint match between two
+        // directories is confirmed like any other; keys are "<index>/<relative>"
+        FileHashMapper mapper(false, true);
+        mapper.set_filter(filter);
+        mapper.set_cancellation(cancel);
+        for (size_t i = 0; i < directories.size() && mapper.is_complete(); ++i) {
+            mapper.process_directory(directories[i], std::to_string(i) + "/", exclude_folders);
+        }
+        for (const auto& [key, digest] : mapper.get_file_hashes()) {
+            size_t slash = key.find('/');
+            const auto& dir = directories[std::stoul(key.substr(0, slash))];
+            paths_by_digest[digest].push_back(dir / key.substr(slash + 1));
+        }
+        std::cout << "Fingerprinted " << mapper.get_file_count() << " files, "
+                  << mapper.get_strong_hash_count() << " needed MD5\n";
+        if (mapper.get_filtered_count()) {
+            std::cout << "Filtered out " << mapper.get_filtered_count() << " files unread\n";
+        }
+        SampleStats sampled = mapper.get_sample_stats();
+        if (sampled.files) {
+            std::cout << "Sampled " << sampled.files << " large files (" << sampled.bytes_sampled
+                      << " bytes); " << sampled.unread << " rejected without a full read, "
+                      << sampled.bytes_not_read << " bytes not read\n";
+        }
+        if (!mapper.is_complete()) {
+            std::cout << "Scan stopped early: only the files hashed so far are deduplicated\n";
+        }
+    }
+    std::vector<std::vector<std::filesystem::path>> groups;
+    for (auto& [digest, paths] : paths_by_digest) {
+        if (paths.size() > 1) {
+            std::sort(paths.begin(), paths.end());
+            groups.push_back(std::move(paths));
+        }
+    }
+
+    DedupReport report = Deduplicator(options).run(groups);
+    for (const auto& error : report.errors) {
+        std::cerr << "Skipped " << error << "\n";
+    }
+    std::cout << (options.dry_run ? "Would replace " : "Replaced ") << report.replaced << " copies with "
+              << (options.method == DedupMethod::Hardlink ? "hard links" : "reflinks") << " in "
+              << report.groups << " groups, reclaiming " << report.bytes_reclaimed << " bytes\n";
+    std::cout << "Already linked: " << report.already_linked << ", content differs: " << report.mismatched
+              << ", failed: " << report.failed << "\n";
+    return report.failed ? 1 : 0;
+}
+
+// Scan every directory once and report, for each ordered pair, how many of
+// the first one's files and bytes the second one also holds. With out the
+// matrix is written there as CSV when the name ends in .csv, otherwise JSON.
+// I/O depth is adaptive as in run_dedup's pipeline.
+int run_overlap(
+    const std::vector<std::filesystem::path>& directories,
+    const std::vector<std::string>& exclude_folders,
+    unsigned threads,
+    bool adaptive,
+    const FileFilter& filter,
+    const std::filesystem::path& out
+) {
+    PipelineOptions options;
+    options.threads = threads;
+    options.adaptive = adaptive || !threads;
+    options.decision_log = adaptive ? &std::cerr : nullptr;
+    options.file_filter = filter;
+    OverlapMatrix matrix = OverlapMatrix::scan(directories, exclude_folders, options);
+
+    for (size_t a = 0; a < matrix.root_count(); ++a) {
+        const OverlapCell& own = matrix.cell(a, a);
+        std::cout << directories[a].string() << ": " << own.files << " files, " << own.bytes << " bytes\n";
+        for (size_t b = 0; b < matrix.root_count(); ++b) {
+            if (b == a) {
+                continue;
+            }
+            const OverlapCell& shared = matrix.cell(a, b);
+            double percent = own.bytes ? 100.0 * shared.bytes / own.bytes : 0.0;
+            std::cout << "  in " << directories[b].string() << ": " << shared.files << " files, " << shared.bytes
+                      << " bytes (" << std::fixed << std::setprecision(1) << percent << "%)\n"
+                      << std::defaultfloat;
+        }
+    }
+
+    if (!out.empty()) {
+        std::ofstream file(out, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Unable to write overlap matrix: " + out.string());
+        }
+        if (out.extension() == ".csv") {
+            matrix.write_csv(file);
+        } else {
+            matrix.write_json(file);
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     // Default values
     int repetitions = 1;
@@ -108,12 +752,27 @@ int main(int argc, char* argv[]) {
     // Validate command-line arguments
     if (argc < 3) {
         std::cerr << "Usage: " << argv[0] 
-                  << " <mode> [-r <repetitions>] <directory1> [<directory2> ...]\n";
+                  << " <mode> [-r <repetitions>] [--warmup <runs>] [--cold-cache] [--bench-out <file>] [--stats] [--perf] [--archives] [--shared-extents] [--hardlink] [--dry-run] [--pipeline] [--adaptive] [--threads <n>] [--tree-hash <MB>] [--timeout <seconds>] [--trace <file>] [--progress terminal|json]"
+                  << " [--manifest-dir <dir>] [--debounce-ms <ms>] [--socket <path>]"
+                  << " [--memory-budget <MB>] [--scratch-dir <dir>] [--overlap-out <file>]"
+                  << " [--min-size <size>] [--max-size <size>] [--ext <ext,...>] [--modified-within <age>]"
+                  << " [--older-than <age>] [--path-regex <regex>]"
+                  << " [--shard <i>/<n> [--shard-by subtree|hash] --partial-out <file>]"
+                  << " <directory1> [<directory2> ...]\n";
         std::cerr << "Modes:\n";
         std::cerr << "  all\n";
         std::cerr << "  different\n";
         std::cerr << "  same\n";
         std::cerr << "  unique\n";
+        std::cerr << "  watch      keep a duplicate index current until interrupted\n";
+        std::cerr << "  serve      answer index queries on --socket until interrupted\n";
+        std::cerr << "  dedup      replace duplicate files with reflinks (--hardlink for hard links, --dry-run to preview)\n";
+        std::cerr << "  overlap    how much of each directory every other one holds (--overlap-out <file>.csv|.json)\n";
+        std::cerr << "Merging a sharded scan: " << argv[0] << " <mode> --merge <partial1> [<partial2> ...]\n";
+        std::cerr << "Concurrency: overlap and dedup --pipeline size each device's I/O depth from measured\n"
+                  << "  throughput and latency unless --threads fixes it; --adaptive (dedup: implies --pipeline)\n"
+                  << "  adapts even then and logs each change. The comparison modes and the default dedup\n"
+                  << "  scan read one file at a time and are not tuned.\n";
         return 1;
     }
 
@@ -122,19 +781,231 @@ int main(int argc, char* argv[]) {
     std::string mode_arg = argv[1];
     int dir_start_index = 2;
 
-    // Check for repetition flag
-    if (argc > 2 && std::string(argv[2]) == "-r") {
-        if (argc < 5) {
-            std::cerr << "Error: -r requires a number of repetitions\n";
+    ComparisonOptions options;
+    std::chrono::milliseconds debounce(500);
+    std::filesystem::path socket_path = "fsf.sock";
+    int warmup = 0;
+    bool cold_cache = false;
+    bool show_stats = false;
+    bool show_perf = false;
+    std::optional<ProgressFormat> progress_format;
+    std::filesystem::path bench_out;
+    std::optional<ExternalOptions> external;
+    std::string shard_text;
+    ShardKey shard_key = ShardKey::Subtree;
+    std::filesystem::path partial_out;
+    bool merge = false;
+    DedupOptions dedup_options;
+    bool use_pipeline = false;
+    bool adaptive = false;
+    std::filesystem::path overlap_out;
+    std::optional<std::chrono::milliseconds> timeout;
+
+    std::vector<std::string> given_flags;
+
+    // Parse flags preceding the directories
+    while (dir_start_index < argc && argv[dir_start_index][0] == '-') {
+        std::string flag = argv[dir_start_index];
+        given_flags.push_back(flag);
+        if (flag == "--cold-cache") {
+            cold_cache = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--stats") {
+            show_stats = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--perf") {
+            show_perf = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--shared-extents") {
+            options.detect_shared_extents = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--archives") {
+            options.expand_archives = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--hardlink") {
+            dedup_options.method = DedupMethod::Hardlink;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--dry-run") {
+            dedup_options.dry_run = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--pipeline") {
+            use_pipeline = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--adaptive") {
+            use_pipeline = true;
+            adaptive = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (flag == "--merge") {
+            merge = true;
+            ++dir_start_index;
+            continue;
+        }
+        if (dir_start_index + 1 >= argc) {
+            std::cerr << "Error: " << flag << " requires a value\n";
             return 1;
         }
-        try {
-            repetitions = std::stoi(argv[3]);
-        } catch (const std::exception& e) {
-            std::cerr << "Error: Invalid number of repetitions\n";
+        std::string value = argv[dir_start_index + 1];
+
+        if (flag == "-r") {
+            try {
+                repetitions = std::stoi(value);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid number of repetitions\n";
+                return 1;
+            }
+        } else if (flag == "--warmup") {
+            try {
+                warmup = std::stoi(value);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid number of warmup runs\n";
+                return 1;
+            }
+        } else if (flag == "--bench-out") {
+            bench_out = value;
+        } else if (flag == "--overlap-out") {
+            overlap_out = value;
+        } else if (flag == "--progress") {
+            if (value == "terminal") {
+                progress_format = ProgressFormat::Terminal;
+            } else if (value == "json") {
+                progress_format = ProgressFormat::JsonLines;
+            } else {
+                std::cerr << "Error: --progress takes terminal or json\n";
+                return 1;
+            }
+        } else if (flag == "--trace") {
+            // Events are kept in memory and written when the process exits
+            trace::start();
+            trace::write_at_exit(value);
+        } else if (flag == "--memory-budget") {
+            try {
+                if (!external) {
+                    external.emplace();
+                }
+                external->memory_budget = static_cast<size_t>(std::stod(value) * (1 << 20));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid memory budget\n";
+                return 1;
+            }
+        } else if (flag == "--scratch-dir") {
+            if (!external) {
+                external.emplace();
+            }
+            external->scratch_dir = value;
+        } else if (flag == "--threads") {
+            try {
+                dedup_options.threads = static_cast<unsigned>(std::stoul(value));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid number of threads\n";
+                return 1;
+            }
+        } else if (flag == "--tree-hash") {
+            try {
+                double megabytes = std::stod(value);
+                if (megabytes <= 0) {
+                    throw std::invalid_argument(value);
+                }
+                tree_hash::set_threshold(static_cast<uintmax_t>(megabytes * (1 << 20)));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid tree hash threshold\n";
+                return 1;
+            }
+        } else if (flag == "--timeout") {
+            try {
+                double seconds = std::stod(value);
+                if (seconds <= 0) {
+                    throw std::invalid_argument(value);
+                }
+                timeout = std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid timeout\n";
+                return 1;
+            }
+        } else if (flag == "--min-size" || flag == "--max-size") {
+            try {
+                (flag == "--min-size" ? options.filter.min_size : options.filter.max_size) =
+                    FileFilter::parse_size(value);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (flag == "--ext") {
+            for (size_t start = 0; start <= value.size();) {
+                size_t comma = std::min(value.find(',', start), value.size());
+                options.filter.add_extension(value.substr(start, comma - start));
+                start = comma + 1;
+            }
+        } else if (flag == "--modified-within" || flag == "--older-than") {
+            try {
+                // Ages count back from the moment the flags are read
+                auto cutoff = std::filesystem::file_time_type::clock::now() - FileFilter::parse_duration(value);
+                (flag == "--modified-within" ? options.filter.modified_after : options.filter.modified_before) = cutoff;
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (flag == "--path-regex") {
+            try {
+                options.filter.set_path_pattern(value);
+            } catch (const std::regex_error& e) {
+                std::cerr << "Error: Invalid --path-regex: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (flag == "--shard") {
+            shard_text = value;
+        } else if (flag == "--shard-by") {
+            if (value == "subtree") {
+                shard_key = ShardKey::Subtree;
+            } else if (value == "hash") {
+                shard_key = ShardKey::PathHash;
+            } else {
+                std::cerr << "Error: --shard-by takes subtree or hash\n";
+                return 1;
+            }
+        } else if (flag == "--partial-out") {
+            partial_out = value;
+        } else if (flag == "--manifest-dir") {
+            options.manifest_dir = value;
+        } else if (flag == "--socket") {
+            socket_path = value;
+        } else if (flag == "--debounce-ms") {
+            try {
+                debounce = std::chrono::milliseconds(std::stoi(value));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: Invalid debounce interval\n";
+                return 1;
+            }
+        } else {
+            std::cerr << "Error: Unknown option " << flag << "\n";
             return 1;
         }
-        dir_start_index = 4;
+        dir_start_index += 2;
+    }
+
+    // --threads also bounds the threads hashing any one large file
+    tree_hash::set_threads(dedup_options.threads);
+
+    if (repetitions < 1 || warmup < 0) {
+        std::cerr << "Error: repetitions must be positive and warmup runs non-negative\n";
+        return 1;
     }
 
     // Parse comparison mode
@@ -146,11 +1017,67 @@ int main(int argc, char* argv[]) {
         mode = ComparisonMode::OnlySame;
     } else if (mode_arg == "unique") {
         mode = ComparisonMode::OnlyUnique;
+    } else if (mode_arg == "watch" || mode_arg == "serve" || mode_arg == "dedup" || mode_arg == "overlap") {
+        mode = ComparisonMode::All;
     } else {
-        std::cerr << "Invalid mode. Choose: all, different, same, or unique.\n";
+        std::cerr << "Invalid mode. Choose: all, different, same, unique, watch, serve, dedup, or overlap.\n";
         return 1;
     }
 
+    // Each kind of run honours only some flags; one it would ignore is an
+    // error rather than silently dropped
+    std::string run_name = mode_arg;
+    std::vector<std::string_view> supported = {"--trace"};
+    auto allow = [&supported](std::initializer_list<std::string_view> flags) {
+        supported.insert(supported.end(), flags);
+    };
+    auto allow_filters = [&allow] {
+        allow({"--min-size", "--max-size", "--ext", "--modified-within", "--older-than", "--path-regex"});
+    };
+    if (merge) {
+        run_name = "--merge";
+        allow({"--merge"});
+    } else if (mode_arg == "dedup") {
+        allow({"--hardlink", "--dry-run", "--pipeline", "--adaptive", "--threads", "--tree-hash", "--timeout"});
+        allow_filters();
+    } else if (mode_arg == "overlap") {
+        allow({"--threads", "--adaptive", "--tree-hash", "--overlap-out"});
+        allow_filters();
+    } else if (mode_arg == "watch" || mode_arg == "serve") {
+        allow({"--debounce-ms", "--tree-hash"});
+        if (mode_arg == "serve") {
+            allow({"--socket"});
+        }
+    } else if (!shard_text.empty() || !partial_out.empty()) {
+        // A partial holds plain per-file digests: archives are not expanded
+        // and extents are not consulted
+        run_name = "--shard";
+        allow({"--shard", "--shard-by", "--partial-out", "--threads", "--tree-hash"});
+    } else if (external) {
+        run_name = "--memory-budget";
+        allow({"--memory-budget", "--scratch-dir", "--archives", "--threads", "--tree-hash"});
+    } else {
+        allow({"-r", "--warmup", "--cold-cache", "--bench-out", "--stats", "--perf", "--archives",
+               "--shared-extents", "--threads", "--tree-hash", "--timeout", "--progress", "--manifest-dir"});
+        allow_filters();
+    }
+    for (const auto& flag : given_flags) {
+        if (std::find(supported.begin(), supported.end(), flag) == supported.end()) {
+            std::cerr << "Error: " << flag << " cannot be combined with " << run_name << "\n";
+            return 1;
+        }
+    }
+
+    if (merge) {
+        try {
+            return run_merge(std::vector<std::filesystem::path>(argv + dir_start_index, argv + argc), mode);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
     // Collect directories
     std::vector<std::filesystem::path> directories;
     
@@ -167,54 +1094,177 @@ int main(int argc, char* argv[]) {
         directories.push_back(dir);
     }
 
+    if (directories.empty()) {
+        std::cerr << "Error: no directories given.\n";
+        return 1;
+    }
+
     // Exclude folders (optional)
     std::vector<std::string> exclude_folders = {".git"};
 
+    // The deadline is checked by the tree walk and the mapper, not the pipeline
+    if (timeout && use_pipeline) {
+        std::cerr << "Error: --timeout cannot be combined with --pipeline\n";
+        return 1;
+    }
+
+    // Each run gets the whole timeout, counted from its own start
+    CancellationToken deadline;
+    if (timeout) {
+        options.cancel = &deadline;
+    }
+
+    if (mode_arg == "dedup") {
+        try {
+            if (timeout) {
+                deadline.set_deadline(CancellationToken::Clock::now() + *timeout);
+            }
+            return run_dedup(directories, exclude_folders, dedup_options, options.filter, use_pipeline, adaptive,
+                             options.cancel);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (mode_arg == "overlap") {
+        try {
+            return run_overlap(directories, exclude_folders, dedup_options.threads, adaptive, options.filter,
+                               overlap_out);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (mode_arg == "watch" || mode_arg == "serve") {
+        try {
+            if (mode_arg == "serve") {
+                return run_server(directories, exclude_folders, debounce, socket_path);
+            }
+            return run_watch(directories, exclude_folders, debounce);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (!shard_text.empty() || !partial_out.empty()) {
+        if (shard_text.empty() || partial_out.empty()) {
+            std::cerr << "Error: --shard and --partial-out go together\n";
+            return 1;
+        }
+        try {
+            ShardSpec shard = ShardSpec::parse(shard_text, shard_key);
+            PartialSummary summary = write_partial(directories, exclude_folders, shard, partial_out);
+            std::cout << "Shard " << shard.index << "/" << shard.count << ": " << summary.files
+                      << " files, " << summary.bytes << " bytes -> " << partial_out.string() << "\n";
+            return 0;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (external) {
+        external->expand_archives = options.expand_archives;
+        try {
+            return run_external(directories, mode, exclude_folders, *external);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
     try {
         // Performance tracking
         PerformanceResult overall_results;
-        
-        // Run comparisons
-        for (int i = 0; i < repetitions; ++i) {
-            auto result = run_comparison_with_timing(directories, mode, exclude_folders);
-            
+        std::vector<PhaseTimes> phase_times;
+        PhaseCounters phase_counters;
+        size_t files_scanned = 0;
+        uintmax_t bytes_scanned = 0;
+
+        // Progress goes to stderr so it never mixes with the results
+        std::unique_ptr<ProgressReporter> reporter;
+        if (progress_format) {
+            reporter = std::make_unique<ProgressReporter>(
+                directories, exclude_folders, *progress_format, std::cerr,
+                std::chrono::milliseconds(1000), static_cast<size_t>(warmup + repetitions));
+            reporter->start();
+        }
+
+        // Warmup runs fill the caches and are not measured; with --cold-cache
+        // every run, warmup or not, starts from evicted file pages
+        for (int i = 0; i < warmup + repetitions; ++i) {
+            if (cold_cache) {
+                evict_page_cache(directories, exclude_folders);
+            }
+            // Operation stats cover the measured runs only
+            if (show_stats && i == warmup) {
+                instrumentation::reset_stats();
+                instrumentation::set_stats_enabled(true);
+            }
+            if (i == warmup) {
+                memory::reset_peaks();
+            }
+            if (show_perf && i == warmup) {
+                perf::set_profiling_enabled(true);
+            }
+            if (timeout) {
+                deadline.set_deadline(CancellationToken::Clock::now() + *timeout);
+            }
+            auto result = run_comparison_with_timing(directories, mode, exclude_folders, options);
+            if (i < warmup) {
+                continue;
+            }
+
             overall_results.total_time_ms += result.total_time_ms;
             overall_results.individual_times.push_back(result.total_time_ms);
+            phase_times.push_back(result.comparison.phase_times);
+            phase_counters += result.comparison.phase_counters;
+            files_scanned += result.comparison.files_scanned;
+            bytes_scanned += result.comparison.bytes_scanned;
+            overall_results.comparison = std::move(result.comparison);
         }
 
+        if (reporter) {
+            reporter->stop();
+        }
+
+        print_comparison_result(overall_results.comparison, directories);
+
         // Report performance
         if (repetitions > 1) {
-            // Calculate statistics
-            double mean = overall_results.total_time_ms / repetitions;
-            
-            // Calculate standard deviation
-            double sq_sum = std::accumulate(
-                overall_results.individual_times.begin(), 
-                overall_results.individual_times.end(), 
-                0.0, 
-                [mean](double acc, double value) {
-                    return acc + std::pow(value - mean, 2);
-                }
-            );
-            double stdev = std::sqrt(sq_sum / repetitions);
+            TimingSummary summary = summarize(overall_results.individual_times);
 
             // Print performance report
             std::cout << "\nPerformance Report:\n";
-            std::cout << "  Repetitions: " << repetitions << "\n";
-            std::cout << "  Mean Time:   " << std::fixed << std::setprecision(3) 
-                      << mean << " ms\n";
-            std::cout << "  Std Dev:     " << std::fixed << std::setprecision(3) 
-                      << stdev << " ms\n";
+            std::cout << "  Repetitions: " << repetitions;
+            if (warmup > 0) {
+                std::cout << " (after " << warmup << " warmup)";
+            }
+            if (cold_cache) {
+                std::cout << ", cold cache";
+            }
+            std::cout << "\n";
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "  Mean Time:   " << summary.mean << " ms\n";
+            std::cout << "  Std Dev:     " << summary.stdev << " ms\n";
+            std::cout << "  p50/p90/p99: " << summary.p50 << " / " << summary.p90
+                      << " / " << summary.p99 << " ms\n";
+            std::cout << "  Max:         " << summary.max << " ms\n";
 
             // Print individual times
             std::cout << "  Individual Times: ";
             for (double time : overall_results.individual_times) {
-                std::cout << std::fixed << std::setprecision(3) << time << " ";
+                std::cout << time << " ";
             }
             std::cout << " ms\n";
-
-            // Log times to file
-            log_times_to_file(repetitions, mean, stdev, directories, mode, overall_results.individual_times);
         }
         else {
             // If only one run, just print that time
@@ -222,6 +1272,42 @@ int main(int argc, char* argv[]) {
                       << std::fixed << std::setprecision(3) 
                       << overall_results.total_time_ms << " ms\n";
         }
+
+        // Per-phase means across the measured runs
+        std::cout << "  Phases (mean ms):";
+        for (size_t p = 0; p < phase_count; ++p) {
+            Phase phase = static_cast<Phase>(p);
+            double sum = 0.0;
+            for (const auto& times : phase_times) {
+                sum += times.milliseconds(phase);
+            }
+            std::cout << " " << phase_name(phase) << " " << sum / phase_times.size();
+        }
+        std::cout << "\n";
+
+        MemoryUsage memory_usage = memory::usage();
+        print_memory_usage(memory_usage);
+
+        if (show_stats) {
+            if (FSF_STATS) {
+                print_operation_stats(instrumentation::collect_stats());
+            } else {
+                std::cerr << "Warning: --stats has no effect; built with FSF_STATS=OFF\n";
+            }
+        }
+
+        if (show_perf) {
+            print_perf_counters(phase_counters, files_scanned, bytes_scanned);
+        }
+
+        if (!bench_out.empty()) {
+            write_benchmark_results(bench_out, directories, mode, warmup, cold_cache,
+                                    overall_results.individual_times, phase_times, memory_usage);
+        } else if (repetitions > 1) {
+            TimingSummary summary = summarize(overall_results.individual_times);
+            log_times_to_file(repetitions, summary.mean, summary.stdev, directories, mode,
+                              overall_results.individual_times);
+        }
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << '\n';
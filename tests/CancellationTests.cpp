@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include "../include/Cancellation.hpp"
+#include "../include/DirectoryComparer.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/Fingerprint.hpp"
+#include "../include/MerkleTree.hpp"
+#include "../include/Progress.hpp"
+#include "../include/TreeHash.hpp"
+
+namespace fs = std::filesystem;
+
+class CancellationTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("cancel_a");
+        fs::remove_all("cancel_b");
+        fs::create_directories("cancel_a/sub");
+        fs::create_directories("cancel_b/sub");
+    }
+
+    void TearDown() override {
+        tree_hash::set_threshold(0);
+        fs::remove_all("cancel_a");
+        fs::remove_all("cancel_b");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+        file.close();
+    }
+
+    void writeLargeFile(const std::string& path, size_t size) {
+        std::ofstream file(path, std::ios::binary);
+        std::string block(1 << 20, 'x');
+        for (size_t written = 0; written < size; written += block.size()) {
+            file << block;
+        }
+        file.close();
+    }
+};
+
+TEST_F(CancellationTests, TokenStopsOnCancelOrDeadline) {
+    CancellationToken token;
+    EXPECT_FALSE(token.stop_requested());
+    EXPECT_NO_THROW(throw_if_stopped(&token));
+    EXPECT_NO_THROW(throw_if_stopped(nullptr));
+    token.cancel();
+    EXPECT_TRUE(token.stop_requested());
+    EXPECT_THROW(throw_if_stopped(&token), OperationCancelled);
+
+    CancellationToken expired(std::chrono::milliseconds(0));
+    EXPECT_TRUE(expired.stop_requested());
+    CancellationToken later(std::chrono::hours(1));
+    EXPECT_FALSE(later.stop_requested());
+}
+
+TEST_F(CancellationTests, StoppedTokenReturnsEmptyIncompleteResults) {
+    writeTestFile("cancel_a/one.txt", "same");
+    writeTestFile("cancel_b/one.txt", "same");
+    CancellationToken token;
+    token.cancel();
+
+    TreeBuildOptions build_options;
+    build_options.cancel = &token;
+    MerkleTree tree = MerkleTree::build("cancel_a", {}, nullptr, build_options);
+    EXPECT_FALSE(tree.is_complete());
+    EXPECT_EQ(tree.root().file_count, 0u);
+
+    ComparisonOptions options;
+    options.cancel = &token;
+    ComparisonResult result = DirectoryComparer::compare_directories(
+        {"cancel_a", "cancel_b"}, ComparisonMode::All, {}, options);
+    EXPECT_FALSE(result.complete);
+    for (const auto& entry : result.entries) {
+        EXPECT_TRUE(entry.incomplete) << entry.relative_path;
+    }
+
+    FileHashMapper mapper(false);
+    mapper.set_cancellation(&token);
+    mapper.process_directory("cancel_a");
+    EXPECT_FALSE(mapper.is_complete());
+    EXPECT_EQ(mapper.get_file_count(), 0u);
+}
+
+TEST_F(CancellationTests, HashingStopsBetweenChunks) {
+    writeLargeFile("cancel_a/big.bin", 16 << 20);
+    CancellationToken token;
+    token.cancel();
+    EXPECT_THROW(FileHashMapper::compute_md5("cancel_a/big.bin", &token), OperationCancelled);
+    EXPECT_THROW(tree_hash_file("cancel_a/big.bin", 2, &token), OperationCancelled);
+    EXPECT_THROW(Fingerprint64::of_samples("cancel_a/big.bin", 16 << 20, &token), OperationCancelled);
+
+    tree_hash::set_threshold(8 << 20);
+    EXPECT_THROW(FileHashMapper::compute_md5("cancel_a/big.bin", &token), OperationCancelled);
+    EXPECT_EQ(FileHashMapper::compute_md5("cancel_a/big.bin"), tree_hash_file("cancel_a/big.bin"));
+}
+
+TEST_F(CancellationTests, CancelFromAnotherThreadStopsPromptly) {
+    writeLargeFile("cancel_a/big.bin", 64 << 20);
+    CancellationToken token;
+    CancellationToken::Clock::time_point cancelled_at;
+    std::thread canceller([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        cancelled_at = CancellationToken::Clock::now();
+        token.cancel();
+    });
+
+    bool stopped = false;
+    for (int i = 0; i < 100 && !stopped; ++i) {
+        try {
+            FileHashMapper::compute_md5("cancel_a/big.bin", &token);
+        } catch (const OperationCancelled&) {
+            stopped = true;
+        }
+    }
+    auto returned_at = CancellationToken::Clock::now();
+    canceller.join();
+    ASSERT_TRUE(stopped);
+    EXPECT_LT(returned_at - cancelled_at, std::chrono::milliseconds(250));
+}
+
+TEST_F(CancellationTests, PartialComparisonMarksUnsettledEntries) {
+    writeTestFile("cancel_a/sub/same.txt", "same");
+    writeTestFile("cancel_a/only_a.txt", "a");
+    writeTestFile("cancel_b/sub/same.txt", "same");
+    writeLargeFile("cancel_b/big.bin", 128 << 20);
+
+    // Stop as soon as the first root is done, while the second is hashing
+    CancellationToken token;
+    uint64_t files_before = progress::snapshot().files;
+    std::thread canceller([&] {
+        while (progress::snapshot().files < files_before + 2) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        token.cancel();
+    });
+
+    ComparisonOptions options;
+    options.cancel = &token;
+    ComparisonResult result = DirectoryComparer::compare_directories(
+        {"cancel_a", "cancel_b"}, ComparisonMode::All, {}, options);
+    canceller.join();
+
+    EXPECT_FALSE(result.complete);
+    bool saw_only_a = false;
+    for (const auto& entry : result.entries) {
+        // A directory the second root did not finish is never settled whole
+        EXPECT_FALSE(entry.status == EntryStatus::Same && entry.is_directory && entry.incomplete);
+        if (entry.relative_path == "only_a.txt") {
+            saw_only_a = true;
+            EXPECT_EQ(entry.status, EntryStatus::Unique);
+            EXPECT_TRUE(entry.incomplete);
+        }
+        if (entry.relative_path == "sub/same.txt" && entry.present[1]) {
+            EXPECT_EQ(entry.status, EntryStatus::Same);
+            EXPECT_FALSE(entry.incomplete);
+        }
+    }
+    EXPECT_TRUE(saw_only_a);
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "../include/ConcurrencyController.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/ScanPipeline.hpp"
+
+namespace fs = std::filesystem;
+
+class ConcurrencyControllerTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("adaptive_dir");
+        fs::create_directory("adaptive_dir");
+    }
+
+    void TearDown() override {
+        fs::remove_all("adaptive_dir");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    // A device that scales linearly up to best_depth, then thrashes: each
+    // request beyond it costs throughput and adds latency
+    static IntervalSample simulate(unsigned limit, unsigned best_depth, double per_request) {
+        IntervalSample sample;
+        sample.peak_in_flight = limit;
+        sample.operations = 100;
+        if (limit <= best_depth) {
+            sample.bytes_per_second = per_request * limit;
+            sample.mean_latency_ms = 1.0;
+        } else {
+            unsigned excess = limit - best_depth;
+            sample.bytes_per_second = per_request * best_depth * std::max(0.2, 1.0 - 0.1 * excess);
+            sample.mean_latency_ms = 1.0 * limit / best_depth + excess;
+        }
+        return sample;
+    }
+
+    // Mean throughput over a long run, as a fraction of the best possible
+    static double efficiency(unsigned best_depth, ControllerOptions options = {}) {
+        AimdPolicy policy(options);
+        double total = 0;
+        const int intervals = 400;
+        for (int i = 0; i < intervals; ++i) {
+            std::string reason;
+            IntervalSample sample = simulate(policy.limit(), best_depth, 100.0);
+            total += sample.bytes_per_second;
+            policy.next_limit(sample, reason);
+        }
+        return total / intervals / (100.0 * best_depth);
+    }
+};
+
+TEST_F(ConcurrencyControllerTests, ConvergesNearBestDepth) {
+    // Roughly an HDD, a RAID set and an NVMe drive
+    for (unsigned best : {1u, 4u, 12u, 24u}) {
+        EXPECT_GT(efficiency(best), 0.85) << "best depth " << best;
+    }
+}
+
+TEST_F(ConcurrencyControllerTests, StaysWithinBounds) {
+    ControllerOptions options;
+    options.min_limit = 2;
+    options.max_limit = 6;
+    AimdPolicy policy(options);
+    for (int i = 0; i < 100; ++i) {
+        std::string reason;
+        unsigned limit = policy.next_limit(simulate(policy.limit(), 50, 100.0), reason);
+        EXPECT_GE(limit, 2u);
+        EXPECT_LE(limit, 6u);
+    }
+    EXPECT_EQ(policy.limit(), 6u);
+
+    for (int i = 0; i < 100; ++i) {
+        std::string reason;
+        IntervalSample sample = simulate(policy.limit(), 1, 100.0);
+        EXPECT_GE(policy.next_limit(sample, reason), 2u);
+    }
+}
+
+TEST_F(ConcurrencyControllerTests, HoldsWhenNotSaturated) {
+    AimdPolicy policy;
+    unsigned start = policy.limit();
+    IntervalSample idle;
+    idle.operations = 10;
+    idle.peak_in_flight = start - 1;
+    idle.bytes_per_second = 1e9;
+    idle.mean_latency_ms = 100;
+    std::string reason;
+    EXPECT_EQ(policy.next_limit(idle, reason), start);
+    EXPECT_TRUE(reason.empty());
+}
+
+TEST_F(ConcurrencyControllerTests, AdaptivePipelineLogsDecisions) {
+    for (int i = 0; i < 400; ++i) {
+        writeTestFile("adaptive_dir/f" + std::to_string(i), std::string(4096, static_cast<char>('a' + i % 26)));
+    }
+    std::ostringstream log;
+    PipelineOptions options;
+    options.adaptive = true;
+    options.controller.max_limit = 4;
+    options.controller.interval = std::chrono::milliseconds(0);
+    options.decision_log = &log;
+    ScanPipeline pipeline({"adaptive_dir"}, {}, options);
+    auto files = pipeline.run();
+
+    ASSERT_EQ(files.size(), 400u);
+    for (const auto& file : files) {
+        if (file.relative_path == "f0") {
+            EXPECT_EQ(file.digest, FileHashMapper::compute_md5("adaptive_dir/f0"));
+        }
+    }
+    const auto& decisions = pipeline.get_stats().decisions;
+    std::string text = log.str();
+    size_t lines = static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+    EXPECT_EQ(lines, decisions.size());
+    for (const auto& decision : decisions) {
+        EXPECT_NE(decision.old_limit, decision.new_limit);
+        EXPECT_LE(decision.new_limit, 4u);
+        EXPECT_FALSE(decision.reason.empty());
+    }
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <filesystem>
+#include <map>
+#include <set>
+#include "../include/CorpusGenerator.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/MerkleTree.hpp"
+
+namespace fs = std::filesystem;
+
+class CorpusGeneratorTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("corpus_a");
+        fs::remove_all("corpus_b");
+    }
+
+    void TearDown() override {
+        fs::remove_all("corpus_a");
+        fs::remove_all("corpus_b");
+    }
+};
+
+TEST_F(CorpusGeneratorTests, SameSeedGivesIdenticalTreesRegardlessOfThreads) {
+    CorpusSpec spec;
+    spec.file_count = 300;
+    spec.duplicate_ratio = 0.2;
+    spec.near_duplicate_ratio = 0.1;
+    spec.threads = 1;
+    CorpusGenerator(spec).generate("corpus_a");
+    spec.threads = 4;
+    CorpusGenerator(spec).generate("corpus_b");
+
+    EXPECT_EQ(MerkleTree::build("corpus_a").digest(), MerkleTree::build("corpus_b").digest());
+
+    fs::remove_all("corpus_b");
+    spec.seed = 2;
+    CorpusGenerator(spec).generate("corpus_b");
+    EXPECT_NE(MerkleTree::build("corpus_a").digest(), MerkleTree::build("corpus_b").digest());
+}
+
+TEST_F(CorpusGeneratorTests, ProducesRequestedMix) {
+    CorpusSpec spec;
+    spec.file_count = 2000;
+    spec.duplicate_ratio = 0.2;
+    spec.hardlink_ratio = 0.1;
+    spec.near_duplicate_ratio = 0.1;
+    spec.min_size = 1;
+    CorpusStats stats = CorpusGenerator(spec).generate("corpus_a");
+
+    EXPECT_EQ(stats.files, 2000u);
+    EXPECT_EQ(stats.unique + stats.duplicates + stats.near_duplicates + stats.hardlinks, stats.files);
+    EXPECT_NEAR(stats.duplicates, 400, 80);
+    EXPECT_NEAR(stats.hardlinks, 200, 60);
+    EXPECT_NEAR(stats.near_duplicates, 200, 60);
+
+    size_t found = 0;
+    for (const auto& entry : fs::recursive_directory_iterator("corpus_a")) {
+        found += entry.is_regular_file();
+    }
+    EXPECT_EQ(found, stats.files);
+}
+
+TEST_F(CorpusGeneratorTests, HardlinksShareInodesAndNearDuplicatesDiffer) {
+    CorpusSpec spec;
+    spec.file_count = 200;
+    spec.min_size = 16;
+    spec.duplicate_ratio = 0.0;
+    spec.hardlink_ratio = 0.3;
+    spec.near_duplicate_ratio = 0.3;
+    CorpusGenerator(spec).generate("corpus_a");
+
+    size_t linked = 0;
+    std::map<uintmax_t, std::set<std::string>> digests_by_size;
+    for (const auto& entry : fs::recursive_directory_iterator("corpus_a")) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        linked += entry.hard_link_count() > 1;
+        digests_by_size[entry.file_size()].insert(FileHashMapper::compute_md5(entry.path()));
+    }
+    EXPECT_GT(linked, 0u);
+
+    // Without exact duplicates, files of one size only share content through hardlinks
+    size_t distinct_sizes_with_variants = 0;
+    for (const auto& [size, digests] : digests_by_size) {
+        distinct_sizes_with_variants += digests.size() > 1;
+    }
+    EXPECT_GT(distinct_sizes_with_variants, 0u);
+}
+
+TEST_F(CorpusGeneratorTests, SparseFilesAreNotFullyWritten) {
+    CorpusSpec spec;
+    spec.file_count = 4;
+    spec.sparse_ratio = 1.0;
+    spec.duplicate_ratio = 0.0;
+    spec.huge_size = 64ull << 20;
+    CorpusStats stats = CorpusGenerator(spec).generate("corpus_a");
+
+    EXPECT_EQ(stats.sparse, 4u);
+    EXPECT_EQ(stats.logical_bytes, 4 * spec.huge_size);
+    EXPECT_EQ(stats.written_bytes, 4 * 3 * 4096u);
+
+    for (const auto& entry : fs::recursive_directory_iterator("corpus_a")) {
+        if (entry.is_regular_file()) {
+            EXPECT_EQ(entry.file_size(), spec.huge_size);
+        }
+    }
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+#include "../include/Deduplicator.hpp"
+
+namespace fs = std::filesystem;
+
+class DeduplicatorTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("dedup_a");
+        fs::create_directory("dedup_a");
+    }
+
+    void TearDown() override {
+        fs::remove_all("dedup_a");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    static std::string readFile(const fs::path& path) {
+        std::ifstream file(path);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    static ino_t inode(const fs::path& path) {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0 ? st.st_ino : 0;
+    }
+
+    // Nothing but the expected files may be left behind
+    static size_t entryCount(const fs::path& dir) {
+        return static_cast<size_t>(std::distance(fs::recursive_directory_iterator(dir), {}));
+    }
+};
+
+TEST_F(DeduplicatorTests, ComparesBytes) {
+    writeTestFile("dedup_a/one", std::string(200000, 'x'));
+    writeTestFile("dedup_a/two", std::string(200000, 'x'));
+    writeTestFile("dedup_a/three", std::string(199999, 'x') + "y");
+    EXPECT_TRUE(Deduplicator::same_content("dedup_a/one", "dedup_a/two"));
+    EXPECT_FALSE(Deduplicator::same_content("dedup_a/one", "dedup_a/three"));
+}
+
+TEST_F(DeduplicatorTests, HardlinksVerifiedCopies) {
+    writeTestFile("dedup_a/keep", "payload");
+    writeTestFile("dedup_a/sub/copy1", "payload");
+    writeTestFile("dedup_a/copy2", "payload");
+    writeTestFile("dedup_a/impostor", "PAYLOAD");
+
+    DedupOptions options;
+    options.method = DedupMethod::Hardlink;
+    options.threads = 2;
+    DedupReport report = Deduplicator(options).run({
+        {"dedup_a/keep", "dedup_a/sub/copy1", "dedup_a/copy2", "dedup_a/impostor"},
+    });
+
+    EXPECT_EQ(report.groups, 1u);
+    EXPECT_EQ(report.replaced, 2u);
+    EXPECT_EQ(report.mismatched, 1u);
+    EXPECT_EQ(report.failed, 0u);
+    EXPECT_EQ(report.bytes_reclaimed, 14u);
+    EXPECT_EQ(inode("dedup_a/sub/copy1"), inode("dedup_a/keep"));
+    EXPECT_EQ(inode("dedup_a/copy2"), inode("dedup_a/keep"));
+    EXPECT_NE(inode("dedup_a/impostor"), inode("dedup_a/keep"));
+    EXPECT_EQ(readFile("dedup_a/sub/copy1"), "payload");
+    EXPECT_EQ(entryCount("dedup_a"), 5u);
+
+    // A second pass finds nothing left to do
+    DedupReport again = Deduplicator(options).run({{"dedup_a/keep", "dedup_a/sub/copy1", "dedup_a/copy2"}});
+    EXPECT_EQ(again.replaced, 0u);
+    EXPECT_EQ(again.already_linked, 2u);
+}
+
+TEST_F(DeduplicatorTests, HardlinkRequiresMatchingMode) {
+    writeTestFile("dedup_a/keep", "payload");
+    writeTestFile("dedup_a/copy", "payload");
+    fs::permissions("dedup_a/copy", fs::perms::owner_read);
+
+    DedupOptions options;
+    options.method = DedupMethod::Hardlink;
+    DedupReport report = Deduplicator(options).run({{"dedup_a/keep", "dedup_a/copy"}});
+
+    EXPECT_EQ(report.failed, 1u);
+    ASSERT_EQ(report.errors.size(), 1u);
+    EXPECT_NE(inode("dedup_a/copy"), inode("dedup_a/keep"));
+}
+
+TEST_F(DeduplicatorTests, DryRunChangesNothing) {
+    writeTestFile("dedup_a/keep", "payload");
+    writeTestFile("dedup_a/copy", "payload");
+    ino_t before = inode("dedup_a/copy");
+
+    for (DedupMethod method : {DedupMethod::Reflink, DedupMethod::Hardlink}) {
+        DedupOptions options;
+        options.method = method;
+        options.dry_run = true;
+        DedupReport report = Deduplicator(options).run({{"dedup_a/keep", "dedup_a/copy"}});
+        EXPECT_EQ(report.replaced, 1u);
+        EXPECT_EQ(report.bytes_reclaimed, 7u);
+    }
+    EXPECT_EQ(inode("dedup_a/copy"), before);
+    EXPECT_EQ(entryCount("dedup_a"), 2u);
+}
+
+TEST_F(DeduplicatorTests, ReflinkKeepsMetadataOrLeavesCopyAlone) {
+    writeTestFile("dedup_a/keep", "payload");
+    writeTestFile("dedup_a/copy", "payload");
+    fs::permissions("dedup_a/copy", fs::perms::owner_read | fs::perms::owner_write | fs::perms::group_read);
+    auto mtime = fs::last_write_time("dedup_a/keep") - std::chrono::hours(24);
+    fs::last_write_time("dedup_a/copy", mtime);
+    ino_t before = inode("dedup_a/copy");
+
+    DedupReport report = Deduplicator().run({{"dedup_a/keep", "dedup_a/copy"}});
+
+    // Filesystems without reflinks fail the copy and leave it untouched
+    EXPECT_EQ(report.replaced + report.failed, 1u);
+    EXPECT_EQ(readFile("dedup_a/copy"), "payload");
+    EXPECT_EQ(fs::status("dedup_a/copy").permissions(),
+              fs::perms::owner_read | fs::perms::owner_write | fs::perms::group_read);
+    EXPECT_EQ(fs::last_write_time("dedup_a/copy"), mtime);
+    if (report.replaced) {
+        EXPECT_NE(inode("dedup_a/copy"), before);
+    } else {
+        EXPECT_EQ(inode("dedup_a/copy"), before);
+    }
+    EXPECT_EQ(entryCount("dedup_a"), 2u);
+}
+
+TEST_F(DeduplicatorTests, KeeperChangedAfterVerificationIsNotLinked) {
+    for (DedupMethod method : {DedupMethod::Hardlink, DedupMethod::Reflink}) {
+        writeTestFile("dedup_a/keep", "payload");
+        writeTestFile("dedup_a/copy", "payload");
+        struct stat keep_stat, copy_stat;
+        ASSERT_EQ(::lstat("dedup_a/keep", &keep_stat), 0);
+        ASSERT_EQ(::lstat("dedup_a/copy", &copy_stat), 0);
+        ino_t before = inode("dedup_a/copy");
+
+        // Rewritten in place, then replaced by another file under its name
+        writeTestFile("dedup_a/keep", "rewritten payload");
+        EXPECT_THROW(Deduplicator::replace_verified(method, "dedup_a/keep", keep_stat, "dedup_a/copy", copy_stat),
+                     std::runtime_error);
+        writeTestFile("dedup_a/other", "PAYLOAD");
+        fs::rename("dedup_a/other", "dedup_a/keep");
+        EXPECT_THROW(Deduplicator::replace_verified(method, "dedup_a/keep", keep_stat, "dedup_a/copy", copy_stat),
+                     std::runtime_error);
+
+        EXPECT_EQ(readFile("dedup_a/copy"), "payload");
+        EXPECT_EQ(inode("dedup_a/copy"), before);
+        EXPECT_EQ(entryCount("dedup_a"), 2u);
+    }
+}
+
+TEST_F(DeduplicatorTests, EmptyFilesAreNeverLinked) {
+    writeTestFile("dedup_a/one.lock", "");
+    writeTestFile("dedup_a/pkg/__init__.py", "");
+    ino_t before = inode("dedup_a/pkg/__init__.py");
+
+    DedupOptions options;
+    options.method = DedupMethod::Hardlink;
+    DedupReport report = Deduplicator(options).run({{"dedup_a/one.lock", "dedup_a/pkg/__init__.py"}});
+    EXPECT_EQ(report.groups, 0u);
+    EXPECT_EQ(report.replaced, 0u);
+    EXPECT_EQ(inode("dedup_a/pkg/__init__.py"), before);
+}
+
+TEST_F(DeduplicatorTests, SymlinksAreSkippedAndNeverKept) {
+    writeTestFile("dedup_a/m_copy", "payload");
+    writeTestFile("dedup_a/z_target", "payload");
+    fs::create_symlink("z_target", "dedup_a/a_link");
+
+    DedupOptions options;
+    options.method = DedupMethod::Hardlink;
+    DedupReport report = Deduplicator(options).run({{"dedup_a/a_link", "dedup_a/m_copy", "dedup_a/z_target"}});
+    EXPECT_EQ(report.groups, 1u);
+    EXPECT_EQ(report.replaced, 1u);
+    EXPECT_EQ(report.failed, 0u);
+    EXPECT_EQ(inode("dedup_a/z_target"), inode("dedup_a/m_copy"));
+    EXPECT_TRUE(fs::is_symlink("dedup_a/a_link"));
+    EXPECT_EQ(fs::read_symlink("dedup_a/a_link"), "z_target");
+}
+
+TEST_F(DeduplicatorTests, ReplacesCopiesWithNamesNearTheLimit) {
+    // The temporary built beside the copy must not grow with its name
+    std::string name(250, 'n');
+    writeTestFile("dedup_a/keep", "payload");
+    writeTestFile("dedup_a/" + name, "payload");
+
+    DedupOptions options;
+    options.method = DedupMethod::Hardlink;
+    DedupReport report = Deduplicator(options).run({{"dedup_a/keep", "dedup_a/" + name}});
+    EXPECT_EQ(report.replaced, 1u);
+    EXPECT_EQ(report.failed, 0u);
+    EXPECT_EQ(inode("dedup_a/" + name), inode("dedup_a/keep"));
+    EXPECT_EQ(entryCount("dedup_a"), 2u);
+}
@@ -145,3 +145,71 @@ TEST_F(DirectoryComparerTests, HandlesMultipleDirectories) {
     
     fs::remove_all("dir3");
 }
+
+TEST_F(DirectoryComparerTests, IdenticalTreesProduceSingleMatch) {
+    for (int i = 0; i < 50; ++i) {
+        fs::create_directories("dir1/sub" + std::to_string(i % 5));
+        fs::create_directories("dir2/sub" + std::to_string(i % 5));
+        std::string name = "/sub" + std::to_string(i % 5) + "/file" + std::to_string(i) + ".txt";
+        writeTestFile("dir1" + name, "content" + std::to_string(i));
+        writeTestFile("dir2" + name, "content" + std::to_string(i));
+    }
+
+    std::vector<fs::path> dirs = {"dir1", "dir2"};
+    auto result = DirectoryComparer::compare_directories(dirs, ComparisonMode::All, {});
+
+    ASSERT_EQ(result.entries.size(), 1u);
+    EXPECT_EQ(result.entries[0].status, EntryStatus::Same);
+    EXPECT_EQ(result.entries[0].relative_path, fs::path("."));
+    EXPECT_EQ(result.entries[0].file_count, 50u);
+    EXPECT_EQ(result.files_pruned, 50u);
+}
+
+TEST_F(DirectoryComparerTests, PrunesAtFirstEqualSubtree) {
+    fs::create_directories("dir1/same");
+    fs::create_directories("dir2/same");
+    writeTestFile("dir1/same/a.txt", "a");
+    writeTestFile("dir2/same/a.txt", "a");
+    writeTestFile("dir1/same/b.txt", "b");
+    writeTestFile("dir2/same/b.txt", "b");
+    writeTestFile("dir1/changed.txt", "old");
+    writeTestFile("dir2/changed.txt", "new");
+    writeTestFile("dir1/only1.txt", "1");
+
+    std::vector<fs::path> dirs = {"dir1", "dir2"};
+    auto result = DirectoryComparer::compare_directories(dirs, ComparisonMode::All, {});
+
+    ASSERT_EQ(result.entries.size(), 3u);
+    EXPECT_EQ(result.entries[0].relative_path, fs::path("changed.txt"));
+    EXPECT_EQ(result.entries[0].status, EntryStatus::Different);
+    EXPECT_EQ(result.entries[1].relative_path, fs::path("only1.txt"));
+    EXPECT_EQ(result.entries[1].status, EntryStatus::Unique);
+    EXPECT_EQ(result.entries[1].present, (std::vector<bool>{true, false}));
+    EXPECT_EQ(result.entries[2].relative_path, fs::path("same"));
+    EXPECT_TRUE(result.entries[2].is_directory);
+    EXPECT_EQ(result.entries[2].status, EntryStatus::Same);
+    EXPECT_EQ(result.files_pruned, 2u);
+
+    auto different = DirectoryComparer::compare_directories(dirs, ComparisonMode::OnlyDifferent, {});
+    ASSERT_EQ(different.entries.size(), 1u);
+    EXPECT_EQ(different.entries[0].relative_path, fs::path("changed.txt"));
+}
+
+TEST_F(DirectoryComparerTests, ManifestsSkipUnchangedFiles) {
+    writeTestFile("dir1/a.txt", "a");
+    writeTestFile("dir2/a.txt", "a");
+
+    std::vector<fs::path> dirs = {"dir1", "dir2"};
+    ComparisonOptions options;
+    options.manifest_dir = "dir_manifests";
+
+    auto first = DirectoryComparer::compare_directories(dirs, ComparisonMode::All, {}, options);
+    EXPECT_EQ(first.files_hashed, 2u);
+
+    auto second = DirectoryComparer::compare_directories(dirs, ComparisonMode::All, {}, options);
+    EXPECT_EQ(second.files_hashed, 0u);
+    ASSERT_EQ(second.entries.size(), 1u);
+    EXPECT_EQ(second.entries[0].status, EntryStatus::Same);
+
+    fs::remove_all("dir_manifests");
+}
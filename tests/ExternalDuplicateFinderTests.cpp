@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+#include "../include/ExternalDuplicateFinder.hpp"
+#include "../include/FileHashMapper.hpp"
+
+namespace fs = std::filesystem;
+
+class ExternalDuplicateFinderTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const auto& dir : {"external_a", "external_b", "external_scratch"}) {
+            fs::remove_all(dir);
+            fs::create_directory(dir);
+        }
+    }
+
+    void TearDown() override {
+        for (const auto& dir : {"external_a", "external_b", "external_scratch"}) {
+            fs::remove_all(dir);
+        }
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    // Content -> "root:path" of every member, as a set for order independence
+    static std::map<std::string, std::set<std::string>> collect(ExternalDuplicateFinder& finder, bool include_unique) {
+        std::map<std::string, std::set<std::string>> groups;
+        finder.run([&groups](const ExternalGroup& group) {
+            auto& members = groups[group.digest];
+            for (const auto& member : group.members) {
+                members.insert(std::to_string(member.root) + ":" + member.relative_path.string());
+            }
+        }, include_unique);
+        return groups;
+    }
+};
+
+TEST_F(ExternalDuplicateFinderTests, FindsDuplicatesWithinBudget) {
+    writeTestFile("external_a/one.txt", "same");
+    writeTestFile("external_a/sub/two.txt", "same");
+    writeTestFile("external_a/other.txt", "other");
+
+    ExternalDuplicateFinder finder({"external_a"}, {}, {1 << 20, "external_scratch"});
+    auto groups = collect(finder, false);
+
+    ASSERT_EQ(groups.size(), 1u);
+    EXPECT_EQ(groups.begin()->first, FileHashMapper::compute_md5("external_a/one.txt"));
+    EXPECT_EQ(groups.begin()->second, (std::set<std::string>{"0:one.txt", "0:sub/two.txt"}));
+    EXPECT_EQ(finder.get_stats().files, 3u);
+    EXPECT_EQ(finder.get_stats().runs, 0u);
+}
+
+TEST_F(ExternalDuplicateFinderTests, SpilledRunsGiveTheSameGroups) {
+    // 60 files in 12 contents, spread over both roots
+    for (int i = 0; i < 60; ++i) {
+        std::string root = i % 2 ? "external_b" : "external_a";
+        writeTestFile(root + "/d" + std::to_string(i % 5) + "/f" + std::to_string(i) + ".txt",
+                      "content " + std::to_string(i % 12));
+    }
+    writeTestFile("external_a/lonely.txt", "only here");
+
+    ExternalDuplicateFinder in_memory({"external_a", "external_b"}, {}, {1 << 20, "external_scratch"});
+    auto expected = collect(in_memory, true);
+
+    // Room for a handful of records forces many runs and intermediate merges
+    ExternalDuplicateFinder spilling({"external_a", "external_b"}, {}, {256, "external_scratch"});
+    auto groups = collect(spilling, true);
+
+    EXPECT_EQ(groups, expected);
+    EXPECT_EQ(groups.size(), 13u);
+    EXPECT_GT(spilling.get_stats().runs, 2u);
+    EXPECT_GT(spilling.get_stats().merge_passes, 0u);
+    EXPECT_GT(spilling.get_stats().spilled_bytes, 0u);
+}
+
+TEST_F(ExternalDuplicateFinderTests, ReportsCrossDirectoryMatches) {
+    writeTestFile("external_a/x.txt", "shared");
+    writeTestFile("external_b/y.txt", "shared");
+    writeTestFile("external_a/p.txt", "local");
+    writeTestFile("external_a/q.txt", "local");
+
+    ExternalDuplicateFinder finder({"external_a", "external_b"}, {}, {64, "external_scratch"});
+    std::vector<size_t> root_counts;
+    finder.run([&root_counts](const ExternalGroup& group) {
+        root_counts.push_back(group.root_count());
+    });
+
+    std::sort(root_counts.begin(), root_counts.end());
+    EXPECT_EQ(root_counts, (std::vector<size_t>{1, 2}));
+}
+
+TEST_F(ExternalDuplicateFinderTests, SkipsExcludedFoldersAndCleansUp) {
+    writeTestFile("external_a/.git/objects/x", "same");
+    writeTestFile("external_a/a.txt", "same");
+    writeTestFile("external_a/b.txt", "same");
+    {
+        ExternalDuplicateFinder finder({"external_a"}, {".git"}, {64, "external_scratch"});
+        auto groups = collect(finder, false);
+        ASSERT_EQ(groups.size(), 1u);
+        EXPECT_EQ(groups.begin()->second.size(), 2u);
+        EXPECT_FALSE(fs::is_empty("external_scratch"));
+    }
+    EXPECT_TRUE(fs::is_empty("external_scratch"));
+}
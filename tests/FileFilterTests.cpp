@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "../include/DirectoryComparer.hpp"
+#include "../include/FileFilter.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/Instrumentation.hpp"
+#include "../include/ScanPipeline.hpp"
+
+namespace fs = std::filesystem;
+
+class FileFilterTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("filter_a");
+        fs::remove_all("filter_b");
+        fs::create_directories("filter_a/photos");
+        fs::create_directories("filter_b/photos");
+    }
+
+    void TearDown() override {
+        fs::remove_all("filter_a");
+        fs::remove_all("filter_b");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+};
+
+TEST_F(FileFilterTests, ParsesSizesAndDurations) {
+    EXPECT_EQ(FileFilter::parse_size("1048576"), 1048576u);
+    EXPECT_EQ(FileFilter::parse_size("512K"), 512u << 10);
+    EXPECT_EQ(FileFilter::parse_size("1M"), 1u << 20);
+    EXPECT_EQ(FileFilter::parse_size("2.5g"), (5ull << 30) / 2);
+    EXPECT_THROW(FileFilter::parse_size("12Q"), std::runtime_error);
+    EXPECT_THROW(FileFilter::parse_size("big"), std::runtime_error);
+    EXPECT_EQ(FileFilter::parse_size("16777215T"), 16777215ull << 40);
+    EXPECT_THROW(FileFilter::parse_size("16777216T"), std::runtime_error);
+    EXPECT_THROW(FileFilter::parse_size("1e30T"), std::runtime_error);
+    EXPECT_THROW(FileFilter::parse_size("1e20"), std::runtime_error);
+
+    EXPECT_EQ(FileFilter::parse_duration("90s").count(), 90);
+    EXPECT_EQ(FileFilter::parse_duration("12h").count(), 12 * 3600);
+    EXPECT_EQ(FileFilter::parse_duration("7d").count(), 7 * 86400);
+    EXPECT_EQ(FileFilter::parse_duration("2w").count(), 14 * 86400);
+    EXPECT_THROW(FileFilter::parse_duration("7"), std::runtime_error);
+    EXPECT_THROW(FileFilter::parse_duration("1e30w"), std::runtime_error);
+}
+
+TEST_F(FileFilterTests, EveryConditionMustHold) {
+    FileFilter filter;
+    EXPECT_TRUE(filter.empty());
+    EXPECT_TRUE(filter.matches("anything", 0));
+
+    filter.min_size = 100;
+    filter.max_size = 1000;
+    filter.add_extension("JPG");
+    filter.add_extension(".mp4");
+    filter.set_path_pattern("^photos/");
+    EXPECT_FALSE(filter.empty());
+    EXPECT_FALSE(filter.needs_mtime());
+
+    EXPECT_TRUE(filter.matches("photos/a.jpg", 100));
+    EXPECT_TRUE(filter.matches("photos/2023/b.MP4", 1000));
+    EXPECT_FALSE(filter.matches("photos/a.jpg", 99));
+    EXPECT_FALSE(filter.matches("photos/a.jpg", 1001));
+    EXPECT_FALSE(filter.matches("photos/a.png", 500));
+    EXPECT_FALSE(filter.matches("docs/photos/a.jpg", 500));
+
+    auto now = FileFilter::Time::clock::now();
+    FileFilter recent;
+    recent.modified_after = now - std::chrono::hours(24);
+    recent.modified_before = now;
+    EXPECT_TRUE(recent.needs_mtime());
+    EXPECT_TRUE(recent.matches("x", 0, now - std::chrono::hours(1)));
+    EXPECT_FALSE(recent.matches("x", 0, now - std::chrono::hours(25)));
+    EXPECT_FALSE(recent.matches("x", 0, now));
+
+    EXPECT_THROW(FileFilter().set_path_pattern("(unclosed"), std::regex_error);
+}
+
+TEST_F(FileFilterTests, MapperNeverOpensRejectedFiles) {
+    if (!FSF_STATS) {
+        GTEST_SKIP() << "built with FSF_STATS=OFF";
+    }
+    writeTestFile("filter_a/photos/keep.jpg", std::string(2000, 'k'));
+    writeTestFile("filter_a/photos/small.jpg", "tiny");
+    writeTestFile("filter_a/notes.txt", std::string(2000, 'n'));
+
+    FileFilter filter;
+    filter.min_size = 1000;
+    filter.add_extension("jpg");
+    FileHashMapper mapper;
+    mapper.set_filter(filter);
+
+    instrumentation::reset_stats();
+    instrumentation::set_stats_enabled(true);
+    mapper.process_directory("filter_a");
+    instrumentation::set_stats_enabled(false);
+
+    auto hashes = mapper.get_file_hashes();
+    ASSERT_EQ(hashes.size(), 1u);
+    EXPECT_EQ(hashes.count((fs::path("photos") / "keep.jpg").string()), 1u);
+    EXPECT_EQ(mapper.get_filtered_count(), 2u);
+    EXPECT_EQ(instrumentation::collect_stats()[Operation::Open].count, 1u);
+}
+
+TEST_F(FileFilterTests, PipelineFiltersByModificationTime) {
+    writeTestFile("filter_a/new.bin", "fresh content");
+    writeTestFile("filter_a/old.bin", "stale content");
+    fs::last_write_time("filter_a/old.bin", fs::file_time_type::clock::now() - std::chrono::hours(24 * 30));
+
+    PipelineOptions options;
+    options.threads = 2;
+    options.file_filter.modified_after = fs::file_time_type::clock::now() - std::chrono::hours(24 * 7);
+    ScanPipeline pipeline({"filter_a"}, {}, options);
+    auto files = pipeline.run();
+    ASSERT_EQ(files.size(), 1u);
+    EXPECT_EQ(files[0].relative_path, "new.bin");
+    EXPECT_EQ(pipeline.get_stats().filtered, 1u);
+}
+
+TEST_F(FileFilterTests, ComparisonSkipsRejectedFiles) {
+    writeTestFile("filter_a/photos/same.jpg", "same picture");
+    writeTestFile("filter_b/photos/same.jpg", "same picture");
+    writeTestFile("filter_a/log.txt", "differs here");
+    writeTestFile("filter_b/log.txt", "and differs there");
+
+    ComparisonOptions options;
+    options.filter.set_path_pattern("\\.jpg$");
+    ComparisonResult result = DirectoryComparer::compare_directories(
+        {"filter_a", "filter_b"}, ComparisonMode::OnlyDifferent, {}, options);
+    EXPECT_TRUE(result.entries.empty());
+    EXPECT_EQ(result.files_filtered, 2u);
+    EXPECT_EQ(result.files_hashed, 2u);
+}
@@ -248,3 +248,33 @@ TEST_F(ExtendedFileTests, HandlesMixedFileTypes) {
     mapper.process_directory("test_dir1");
     EXPECT_GE(mapper.get_file_count(), 3);  // At least regular, binary, and empty
 }
+
+// The small-file path and the chunked path must agree with a one-shot digest
+TEST_F(ExtendedFileTests, ComputesMd5AcrossReadBoundaries) {
+    for (size_t size : {0, 1, 16383, 16384, 16385, 16386, 65536, 81921, 200000}) {
+        std::string content = generateRandomContent(size);
+        std::string path = "test_dir1/size_" + std::to_string(size);
+        writeFile(path, content);
+        EXPECT_EQ(FileHashMapper::compute_md5(path), FileHashMapper::compute_md5_of_buffer(content.data(), size))
+            << "size " << size;
+    }
+    EXPECT_EQ(FileHashMapper::compute_md5_of_buffer("", 0), "d41d8cd98f00b204e9800998ecf8427e");
+    EXPECT_THROW(FileHashMapper::compute_md5("test_dir1/missing"), std::runtime_error);
+}
+
+TEST_F(ExtendedFileTests, SkipsExcludedDirectoriesUnread) {
+    fs::create_directories("test_dir1/.git/objects");
+    fs::create_directories("test_dir1/src/.git");
+    writeFile("test_dir1/.git/objects/pack", generateRandomContent(4096));
+    writeFile("test_dir1/src/.git/HEAD", "ref");
+    writeFile("test_dir1/src/main.cpp", "int main() {}");
+    writeFile("test_dir1/readme", "hello");
+
+    FileHashMapper mapper(false, true);
+    mapper.process_directory("test_dir1", "", {".git"});
+    EXPECT_EQ(mapper.get_file_count(), 2u);
+    EXPECT_EQ(mapper.get_strong_hash_count(), 0u);
+    auto hashes = mapper.get_file_hashes();
+    EXPECT_TRUE(hashes.count("src/main.cpp"));
+    EXPECT_TRUE(hashes.count("readme"));
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "../include/FileHashMapper.hpp"
+#include "../include/Fingerprint.hpp"
+
+namespace fs = std::filesystem;
+
+class FingerprintTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("fingerprint_a");
+        fs::remove_all("fingerprint_b");
+        fs::create_directory("fingerprint_a");
+        fs::create_directory("fingerprint_b");
+    }
+
+    void TearDown() override {
+        fs::remove_all("fingerprint_a");
+        fs::remove_all("fingerprint_b");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+        file.close();
+    }
+};
+
+TEST_F(FingerprintTests, MatchesReferenceValues) {
+    EXPECT_EQ(Fingerprint64::of_buffer("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(Fingerprint64::of_buffer("abc", 3), 0x44BC2CF5AD770999ULL);
+}
+
+TEST_F(FingerprintTests, StreamingMatchesOneShot) {
+    std::string data;
+    for (int i = 0; i < 1000; ++i) {
+        data += static_cast<char>(i * 7 + 3);
+    }
+    uint64_t expected = Fingerprint64::of_buffer(data.data(), data.size());
+    for (size_t chunk : {1, 5, 31, 32, 33, 100, 999}) {
+        Fingerprint64 fingerprint;
+        for (size_t pos = 0; pos < data.size(); pos += chunk) {
+            fingerprint.update(data.data() + pos, std::min(chunk, data.size() - pos));
+        }
+        EXPECT_EQ(fingerprint.digest(), expected) << "chunk " << chunk;
+    }
+
+    writeTestFile("fingerprint_a/data", data);
+    EXPECT_EQ(Fingerprint64::of_file("fingerprint_a/data"), expected);
+    EXPECT_NE(Fingerprint64::of_buffer(data.data(), data.size() - 1), expected);
+}
+
+TEST_F(FingerprintTests, MapperConfirmsOnlyMatches) {
+    writeTestFile("fingerprint_a/unique1", "only here, in the first root");
+    writeTestFile("fingerprint_a/dup", "shared content in both roots");
+    writeTestFile("fingerprint_b/unique2", "only there, in the second root");
+    writeTestFile("fingerprint_b/dup", "shared content in both roots");
+    writeTestFile("fingerprint_b/dup2", "shared content in both roots");
+
+    FileHashMapper mapper(false, true);
+    mapper.process_directory("fingerprint_a", "a/");
+    mapper.process_directory("fingerprint_b", "b/");
+    auto hashes = mapper.get_file_hashes();
+
+    ASSERT_EQ(hashes.size(), 5u);
+    EXPECT_EQ(mapper.get_strong_hash_count(), 3u);
+    std::string md5 = FileHashMapper::compute_md5("fingerprint_a/dup");
+    EXPECT_EQ(hashes["a/dup"], md5);
+    EXPECT_EQ(hashes["b/dup"], md5);
+    EXPECT_EQ(hashes["b/dup2"], md5);
+    // Files with no match keep a fingerprint key that no MD5 can equal
+    EXPECT_NE(hashes["a/unique1"], FileHashMapper::compute_md5("fingerprint_a/unique1"));
+    EXPECT_NE(hashes["a/unique1"].find(':'), std::string::npos);
+    EXPECT_NE(hashes["a/unique1"], hashes["b/unique2"]);
+}
+
+TEST_F(FingerprintTests, TinyFilesAreKeyedByContent) {
+    writeTestFile("fingerprint_a/empty1", "");
+    writeTestFile("fingerprint_a/empty2", "");
+    writeTestFile("fingerprint_a/small", "x");
+    writeTestFile("fingerprint_a/small0", std::string("x\0", 2));
+    writeTestFile("fingerprint_a/sixteen", "0123456789abcdef");
+    writeTestFile("fingerprint_a/seventeen", "0123456789abcdefg");
+
+    FileHashMapper mapper(false, true);
+    mapper.process_directory("fingerprint_a");
+    auto hashes = mapper.get_file_hashes();
+    EXPECT_EQ(hashes["empty1"], "=");
+    EXPECT_EQ(hashes["empty1"], hashes["empty2"]);
+    EXPECT_EQ(hashes["small"], "=78");
+    EXPECT_EQ(hashes["small0"], "=7800");
+    EXPECT_EQ(hashes["sixteen"], "=30313233343536373839616263646566");
+    EXPECT_NE(hashes["seventeen"].find(':'), std::string::npos);
+    EXPECT_EQ(mapper.get_strong_hash_count(), 0u);
+}
+
+TEST_F(FingerprintTests, RejectsArchives) {
+    EXPECT_THROW(FileHashMapper(true, true), std::runtime_error);
+}
+
+TEST_F(FingerprintTests, SampleOffsetsDependOnlyOnSize) {
+    uintmax_t size = (5 << 20) + 123;
+    auto offsets = sample_offsets(size);
+    EXPECT_EQ(offsets, sample_offsets(size));
+    EXPECT_NE(offsets, sample_offsets(size + sample_block_size));
+    ASSERT_GE(offsets.size(), 3u);
+    EXPECT_LE(offsets.size(), sample_interior_blocks + 2);
+    EXPECT_EQ(offsets.front(), 0u);
+    EXPECT_EQ(offsets.back(), size - sample_block_size);
+    EXPECT_TRUE(std::is_sorted(offsets.begin(), offsets.end()));
+    for (size_t i = 1; i + 1 < offsets.size(); ++i) {
+        EXPECT_EQ(offsets[i] % sample_block_size, 0u);
+        EXPECT_LE(offsets[i] + sample_block_size, size - sample_block_size);
+    }
+}
+
+TEST_F(FingerprintTests, SamplingRejectsWithoutFullRead) {
+    size_t size = 5 << 20;
+    std::string base(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        base[i] = static_cast<char>(i * 31 + (i >> 16));
+    }
+    auto offsets = sample_offsets(size);
+    // A byte no sample covers, so only a full read can tell it apart
+    size_t hidden = sample_block_size;
+    while (std::any_of(offsets.begin(), offsets.end(), [&](uintmax_t offset) {
+        return hidden >= offset && hidden < offset + sample_block_size;
+    })) {
+        hidden += sample_block_size;
+    }
+    std::string tail_differs = base;
+    tail_differs.back() ^= 1;
+    std::string middle_differs = base;
+    middle_differs[hidden] ^= 1;
+    writeTestFile("fingerprint_a/base", base);
+    writeTestFile("fingerprint_a/copy", base);
+    writeTestFile("fingerprint_a/tail", tail_differs);
+    writeTestFile("fingerprint_a/middle", middle_differs);
+
+    FileHashMapper mapper(false, true);
+    mapper.process_directory("fingerprint_a");
+    auto hashes = mapper.get_file_hashes();
+    std::string md5 = FileHashMapper::compute_md5("fingerprint_a/base");
+    EXPECT_EQ(hashes["base"], md5);
+    EXPECT_EQ(hashes["copy"], md5);
+    EXPECT_EQ(hashes["middle"], FileHashMapper::compute_md5("fingerprint_a/middle"));
+    EXPECT_NE(hashes["middle"], md5);
+    EXPECT_NE(hashes["tail"].find(':'), std::string::npos);
+    EXPECT_EQ(mapper.get_strong_hash_count(), 3u);
+
+    SampleStats stats = mapper.get_sample_stats();
+    EXPECT_EQ(stats.files, 4u);
+    EXPECT_EQ(stats.bytes_sampled, 4 * offsets.size() * sample_block_size);
+    EXPECT_EQ(stats.unread, 1u);
+    EXPECT_EQ(stats.bytes_not_read, size - offsets.size() * sample_block_size);
+}
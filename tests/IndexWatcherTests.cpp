@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include "../include/DuplicateIndex.hpp"
+#include "../include/IndexWatcher.hpp"
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+TEST(DuplicateIndexTests, TracksGroupsIncrementally) {
+    DuplicateIndex index;
+    index.update("a/x", {"d1", 1, 1});
+    index.update("a/y", {"d1", 1, 1});
+    index.update("b/z", {"d2", 1, 1});
+    EXPECT_EQ(index.file_count(), 3u);
+    EXPECT_EQ(index.duplicate_group_count(), 1u);
+    EXPECT_EQ(index.paths_with_digest("d1"), (std::vector<std::string>{"a/x", "a/y"}));
+
+    // Changing content moves the path to another digest
+    index.update("a/y", {"d2", 1, 2});
+    EXPECT_EQ(index.paths_with_digest("d1"), (std::vector<std::string>{"a/x"}));
+    EXPECT_EQ(index.paths_with_digest("d2"), (std::vector<std::string>{"a/y", "b/z"}));
+    EXPECT_EQ(index.duplicate_group_count(), 1u);
+
+    EXPECT_EQ(index.remove_under("a"), 2u);
+    EXPECT_EQ(index.file_count(), 1u);
+    EXPECT_EQ(index.duplicate_group_count(), 0u);
+    EXPECT_FALSE(index.find("a/x").has_value());
+}
+
+TEST(DuplicateIndexTests, RemoveUnderDoesNotMatchSiblingPrefixes) {
+    DuplicateIndex index;
+    index.update("dir/file", {"d1", 1, 1});
+    index.update("dir2/file", {"d1", 1, 1});
+    index.update("dir-x/file", {"d1", 1, 1});
+
+    EXPECT_EQ(index.remove_under("dir"), 1u);
+    EXPECT_EQ(index.file_count(), 2u);
+}
+
+class IndexWatcherTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("watch_dir");
+        fs::create_directory("watch_dir");
+    }
+
+    void TearDown() override {
+        fs::remove_all("watch_dir");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    bool waitFor(const std::function<bool()>& condition) {
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (condition()) {
+                return true;
+            }
+            std::this_thread::sleep_for(10ms);
+        }
+        return condition();
+    }
+};
+
+TEST_F(IndexWatcherTests, BuildsInitialIndex) {
+    writeTestFile("watch_dir/a.txt", "same");
+    writeTestFile("watch_dir/b.txt", "same");
+    writeTestFile("watch_dir/c.txt", "other");
+
+    IndexWatcher watcher({"watch_dir"}, {}, 20ms);
+    watcher.start();
+    EXPECT_EQ(watcher.index().file_count(), 3u);
+    EXPECT_EQ(watcher.index().duplicate_group_count(), 1u);
+    EXPECT_EQ(watcher.get_rehashed_file_count(), 3u);
+}
+
+TEST_F(IndexWatcherTests, RehashesOnlyChangedFiles) {
+    writeTestFile("watch_dir/a.txt", "one");
+    writeTestFile("watch_dir/b.txt", "two");
+
+    IndexWatcher watcher({"watch_dir"}, {}, 20ms);
+    watcher.start();
+    ASSERT_EQ(watcher.index().duplicate_group_count(), 0u);
+
+    writeTestFile("watch_dir/b.txt", "one");
+    EXPECT_TRUE(waitFor([&] { return watcher.index().duplicate_group_count() == 1; }));
+    EXPECT_EQ(watcher.get_rehashed_file_count(), 3u);
+
+    fs::remove("watch_dir/a.txt");
+    EXPECT_TRUE(waitFor([&] { return watcher.index().file_count() == 1; }));
+    EXPECT_EQ(watcher.index().duplicate_group_count(), 0u);
+}
+
+TEST_F(IndexWatcherTests, RehashesFilesStillOpenForWriting) {
+    writeTestFile("watch_dir/a.txt", "one");
+    writeTestFile("watch_dir/log.txt", "");
+
+    IndexWatcher watcher({"watch_dir"}, {}, 20ms);
+    watcher.start();
+    ASSERT_EQ(watcher.index().duplicate_group_count(), 0u);
+
+    // A log writer appends and flushes but never closes
+    std::ofstream log("watch_dir/log.txt", std::ios::app);
+    log << "one";
+    log.flush();
+    EXPECT_TRUE(waitFor([&] { return watcher.index().duplicate_group_count() == 1; }));
+}
+
+TEST_F(IndexWatcherTests, FollowsNewAndRemovedDirectories) {
+    IndexWatcher watcher({"watch_dir"}, {".git"}, 20ms);
+    watcher.start();
+
+    fs::create_directories("watch_dir/new/deeper");
+    writeTestFile("watch_dir/new/deeper/file.txt", "content");
+    EXPECT_TRUE(waitFor([&] { return watcher.index().file_count() == 1; }));
+
+    fs::create_directory("watch_dir/.git");
+    writeTestFile("watch_dir/.git/HEAD", "content");
+    fs::rename("watch_dir/new", "watch_dir/moved");
+    EXPECT_TRUE(waitFor([&] { return watcher.index().find("watch_dir/moved/deeper/file.txt").has_value(); }));
+    EXPECT_EQ(watcher.index().file_count(), 1u);
+
+    fs::remove_all("watch_dir/moved");
+    EXPECT_TRUE(waitFor([&] { return watcher.index().file_count() == 0; }));
+}
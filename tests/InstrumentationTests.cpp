@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include "../include/DirectoryComparer.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/Instrumentation.hpp"
+
+namespace fs = std::filesystem;
+
+class InstrumentationTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("phases_a");
+        fs::remove_all("phases_b");
+        fs::create_directory("phases_a");
+        fs::create_directory("phases_b");
+    }
+
+    void TearDown() override {
+        fs::remove_all("phases_a");
+        fs::remove_all("phases_b");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+};
+
+TEST_F(InstrumentationTests, ScopedPhaseAccumulatesOnCallingThread) {
+    PhaseTimes before = instrumentation::thread_phase_times();
+    {
+        ScopedPhase read(Phase::Read);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    PhaseTimes spent = instrumentation::thread_phase_times() - before;
+
+    EXPECT_GE(spent[Phase::Read], 2000000u);
+    EXPECT_EQ(spent[Phase::Hash], 0u);
+
+    // Another thread's phases are its own
+    std::thread([] {
+        ScopedPhase hash(Phase::Hash);
+    }).join();
+    EXPECT_EQ((instrumentation::thread_phase_times() - before)[Phase::Hash], 0u);
+}
+
+TEST_F(InstrumentationTests, ComparisonReportsPhaseBreakdown) {
+    writeTestFile("phases_a/x.txt", std::string(4096, 'x'));
+    writeTestFile("phases_a/sub/y.txt", "y");
+    writeTestFile("phases_b/x.txt", std::string(4096, 'z'));
+
+    ComparisonResult result = DirectoryComparer::compare_directories(
+        {"phases_a", "phases_b"}, ComparisonMode::All, {});
+
+    EXPECT_GT(result.phase_times[Phase::Stat], 0u);
+    EXPECT_GT(result.phase_times[Phase::Read], 0u);
+    EXPECT_GT(result.phase_times[Phase::Hash], 0u);
+    EXPECT_GT(result.phase_times[Phase::Join], 0u);
+}
+
+TEST_F(InstrumentationTests, OperationStatsCountEveryFile) {
+    if (!FSF_STATS) {
+        GTEST_SKIP() << "built with FSF_STATS=OFF";
+    }
+    writeTestFile("phases_a/x.txt", std::string(10000, 'x'));
+    writeTestFile("phases_a/sub/y.txt", "y");
+    writeTestFile("phases_b/x.txt", std::string(10000, 'z'));
+
+    instrumentation::reset_stats();
+    instrumentation::set_stats_enabled(true);
+    DirectoryComparer::compare_directories({"phases_a", "phases_b"}, ComparisonMode::All, {});
+    instrumentation::set_stats_enabled(false);
+    ScanStats stats = instrumentation::collect_stats();
+
+    EXPECT_EQ(stats[Operation::Open].count, 3u);
+    EXPECT_EQ(stats[Operation::Stat].count, 3u);
+    EXPECT_EQ(stats[Operation::Read].count, 3u);
+    EXPECT_EQ(stats[Operation::Read].bytes, 20001u);
+    EXPECT_EQ(stats[Operation::Hash].bytes, 20001u);
+    EXPECT_GT(stats[Operation::Hash].total_nanoseconds, 0u);
+
+    // Nothing is recorded while disabled
+    FileHashMapper::compute_md5("phases_a/x.txt");
+    EXPECT_EQ(instrumentation::collect_stats()[Operation::Open].count, 3u);
+}
+
+TEST_F(InstrumentationTests, StatsAggregateAcrossThreads) {
+    if (!FSF_STATS) {
+        GTEST_SKIP() << "built with FSF_STATS=OFF";
+    }
+    instrumentation::reset_stats();
+    instrumentation::set_stats_enabled(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (uint64_t i = 1; i <= 100; ++i) {
+                instrumentation::record(Operation::Read, i * 1000, 10);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    instrumentation::set_stats_enabled(false);
+
+    const OperationStats read = instrumentation::collect_stats()[Operation::Read];
+    EXPECT_EQ(read.count, 400u);
+    EXPECT_EQ(read.bytes, 4000u);
+    EXPECT_EQ(read.max_nanoseconds, 100000u);
+    // 50000 ns falls in the [32768, 65536) bucket
+    EXPECT_EQ(read.percentile_nanoseconds(50), 65535u);
+    EXPECT_EQ(read.percentile_nanoseconds(100), 100000u);
+}
+
+TEST_F(InstrumentationTests, PerfProfilingDegradesToMissingEvents) {
+    writeTestFile("phases_a/x.txt", std::string(10000, 'x'));
+    writeTestFile("phases_b/x.txt", std::string(10000, 'x'));
+
+    PerfSample sample;
+    EXPECT_FALSE(perf::read_thread_counters(sample));
+
+    perf::set_profiling_enabled(true);
+    ComparisonResult result = DirectoryComparer::compare_directories(
+        {"phases_a", "phases_b"}, ComparisonMode::All, {});
+    bool readable = perf::read_thread_counters(sample);
+    perf::set_profiling_enabled(false);
+
+    // Whatever the kernel allows, the scan completes and events that could
+    // not be opened read as zero with a reason given
+    EXPECT_EQ(result.files_scanned, 2u);
+    EXPECT_EQ(result.bytes_scanned, 20000u);
+    bool any_available = false;
+    for (size_t e = 0; e < perf_event_count; ++e) {
+        PerfEvent event = static_cast<PerfEvent>(e);
+        if (perf::event_available(event)) {
+            any_available = true;
+        } else {
+            EXPECT_EQ(result.phase_counters.total()[event], 0u);
+            EXPECT_FALSE(perf::unavailable_reason().empty());
+        }
+    }
+    EXPECT_EQ(readable, any_available);
+}
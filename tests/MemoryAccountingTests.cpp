@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "../include/FileHashMapper.hpp"
+#include "../include/MemoryAccounting.hpp"
+#include "../include/MerkleTree.hpp"
+
+namespace fs = std::filesystem;
+
+class MemoryAccountingTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("memory_a");
+        fs::create_directory("memory_a");
+    }
+
+    void TearDown() override {
+        fs::remove_all("memory_a");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+};
+
+TEST_F(MemoryAccountingTests, AllocatorBooksAgainstCategory) {
+    MemoryUsage before = memory::usage();
+    {
+        std::vector<uint64_t, CountingAllocator<uint64_t, MemoryCategory::Buffers>> buffer(1000);
+        MemoryUsage during = memory::usage();
+        EXPECT_EQ(during[MemoryCategory::Buffers].live_bytes - before[MemoryCategory::Buffers].live_bytes, 8000u);
+        EXPECT_GE(during[MemoryCategory::Buffers].peak_bytes, during[MemoryCategory::Buffers].live_bytes);
+    }
+    MemoryUsage after = memory::usage();
+    EXPECT_EQ(after[MemoryCategory::Buffers].live_bytes, before[MemoryCategory::Buffers].live_bytes);
+    EXPECT_EQ(after[MemoryCategory::Buffers].allocations - before[MemoryCategory::Buffers].allocations, 1u);
+    EXPECT_EQ(after[MemoryCategory::Buffers].deallocations - before[MemoryCategory::Buffers].deallocations, 1u);
+}
+
+TEST_F(MemoryAccountingTests, TreeMemoryIsReturnedWhenDestroyed) {
+    // Names longer than the small-string buffer are heap allocated
+    writeTestFile("memory_a/a_rather_long_file_name_0.txt", "0");
+    writeTestFile("memory_a/sub/a_rather_long_file_name_1.txt", "1");
+
+    MemoryUsage before = memory::usage();
+    memory::reset_peaks();
+    {
+        MerkleTree tree = MerkleTree::build("memory_a");
+        MemoryUsage built = memory::usage();
+        EXPECT_GT(built[MemoryCategory::Paths].live_bytes, before[MemoryCategory::Paths].live_bytes);
+        EXPECT_GT(built[MemoryCategory::Digests].live_bytes, before[MemoryCategory::Digests].live_bytes);
+        EXPECT_GT(built[MemoryCategory::Index].live_bytes, before[MemoryCategory::Index].live_bytes);
+    }
+    MemoryUsage after = memory::usage();
+    for (size_t c = 0; c < memory_category_count; ++c) {
+        EXPECT_EQ(after.categories[c].live_bytes, before.categories[c].live_bytes)
+            << memory_category_name(static_cast<MemoryCategory>(c));
+    }
+    EXPECT_GT(after[MemoryCategory::Index].peak_bytes, after[MemoryCategory::Index].live_bytes);
+    EXPECT_GT(after.peak_rss_bytes, 0u);
+}
+
+TEST_F(MemoryAccountingTests, HashMapperCountsPathsAndDigests) {
+    writeTestFile("memory_a/another_long_file_name.txt", "x");
+
+    MemoryUsage before = memory::usage();
+    FileHashMapper mapper;
+    mapper.process_directory("memory_a");
+    MemoryUsage after = memory::usage();
+
+    EXPECT_GT(after[MemoryCategory::Paths].live_bytes, before[MemoryCategory::Paths].live_bytes);
+    EXPECT_GT(after[MemoryCategory::Digests].live_bytes, before[MemoryCategory::Digests].live_bytes);
+    EXPECT_EQ(mapper.get_file_hashes().count("another_long_file_name.txt"), 1u);
+}
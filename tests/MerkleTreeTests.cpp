@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include "../include/MerkleTree.hpp"
+
+namespace fs = std::filesystem;
+
+class MerkleTreeTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("merkle_a");
+        fs::remove_all("merkle_b");
+        fs::create_directory("merkle_a");
+        fs::create_directory("merkle_b");
+    }
+
+    void TearDown() override {
+        fs::remove_all("merkle_a");
+        fs::remove_all("merkle_b");
+        fs::remove("merkle.manifest");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+};
+
+TEST_F(MerkleTreeTests, IdenticalTreesShareRootDigest) {
+    for (const char* root : {"merkle_a", "merkle_b"}) {
+        writeTestFile(std::string(root) + "/x.txt", "x");
+        writeTestFile(std::string(root) + "/sub/y.txt", "y");
+    }
+
+    MerkleTree a = MerkleTree::build("merkle_a");
+    MerkleTree b = MerkleTree::build("merkle_b");
+    EXPECT_EQ(a.digest(), b.digest());
+    EXPECT_EQ(a.root().file_count, 2u);
+    EXPECT_EQ(a.root().size, 2u);
+}
+
+TEST_F(MerkleTreeTests, RenameChangesDirectoryDigest) {
+    writeTestFile("merkle_a/x.txt", "x");
+    writeTestFile("merkle_b/y.txt", "x");
+
+    EXPECT_NE(MerkleTree::build("merkle_a").digest(), MerkleTree::build("merkle_b").digest());
+}
+
+TEST_F(MerkleTreeTests, FileAndDirectoryWithSameNameDiffer) {
+    // An empty file and an empty directory have the same raw MD5
+    writeTestFile("merkle_a/entry", "");
+    fs::create_directory("merkle_b/entry");
+
+    EXPECT_NE(MerkleTree::build("merkle_a").digest(), MerkleTree::build("merkle_b").digest());
+}
+
+TEST_F(MerkleTreeTests, ExcludedFoldersDoNotContribute) {
+    writeTestFile("merkle_a/x.txt", "x");
+    writeTestFile("merkle_b/x.txt", "x");
+    writeTestFile("merkle_b/.git/HEAD", "ref");
+
+    EXPECT_EQ(MerkleTree::build("merkle_a").digest(), MerkleTree::build("merkle_b", {".git"}).digest());
+}
+
+TEST_F(MerkleTreeTests, ManifestRoundTrip) {
+    writeTestFile("merkle_a/x.txt", "x");
+    writeTestFile("merkle_a/tab\tand\nnewline/y.txt", "y");
+
+    MerkleTree built = MerkleTree::build("merkle_a");
+    built.save_manifest("merkle.manifest");
+    MerkleTree loaded = MerkleTree::load_manifest("merkle.manifest");
+
+    EXPECT_EQ(loaded.digest(), built.digest());
+    EXPECT_EQ(loaded.root().file_count, built.root().file_count);
+    EXPECT_EQ(loaded.root_path(), built.root_path());
+    ASSERT_NE(loaded.root().find_child("tab\tand\nnewline"), nullptr);
+}
+
+TEST_F(MerkleTreeTests, ManifestDigestsAreReusedForUnchangedFiles) {
+    writeTestFile("merkle_a/x.txt", "x");
+    writeTestFile("merkle_a/y.txt", "y");
+    MerkleTree first = MerkleTree::build("merkle_a");
+    EXPECT_EQ(first.get_hashed_file_count(), 2u);
+
+    MerkleTree second = MerkleTree::build("merkle_a", {}, &first);
+    EXPECT_EQ(second.get_hashed_file_count(), 0u);
+    EXPECT_EQ(second.digest(), first.digest());
+
+    writeTestFile("merkle_a/y.txt", "changed");
+    MerkleTree third = MerkleTree::build("merkle_a", {}, &second);
+    EXPECT_EQ(third.get_hashed_file_count(), 1u);
+    EXPECT_NE(third.digest(), first.digest());
+}
+
+TEST_F(MerkleTreeTests, ReportsOutermostDuplicateDirectories) {
+    writeTestFile("merkle_a/photos/2020/a.jpg", "a");
+    writeTestFile("merkle_a/photos/2021/b.jpg", "b");
+    writeTestFile("merkle_a/notes.txt", "notes");
+    writeTestFile("merkle_b/backup/photos/2020/a.jpg", "a");
+    writeTestFile("merkle_b/backup/photos/2021/b.jpg", "b");
+    writeTestFile("merkle_b/other.txt", "other");
+
+    MerkleTree a = MerkleTree::build("merkle_a");
+    MerkleTree b = MerkleTree::build("merkle_b");
+    auto groups = MerkleTree::find_duplicate_directories({&a, &b});
+
+    ASSERT_EQ(groups.size(), 1u);
+    EXPECT_EQ(groups[0].file_count, 2u);
+    ASSERT_EQ(groups[0].directories.size(), 2u);
+    EXPECT_EQ(groups[0].directories[0], fs::path("merkle_a/photos"));
+    EXPECT_EQ(groups[0].directories[1], fs::path("merkle_b/backup/photos"));
+}
+
+TEST_F(MerkleTreeTests, ReportsNestedDuplicatesAcrossParentGroups) {
+    // A matches C and B matches D, but only the x folders match across them
+    writeTestFile("merkle_a/A/x/f.txt", "x");
+    writeTestFile("merkle_a/A/one.txt", "1");
+    writeTestFile("merkle_a/C/x/f.txt", "x");
+    writeTestFile("merkle_a/C/one.txt", "1");
+    writeTestFile("merkle_b/B/x/f.txt", "x");
+    writeTestFile("merkle_b/B/two.txt", "2");
+    writeTestFile("merkle_b/D/x/f.txt", "x");
+    writeTestFile("merkle_b/D/two.txt", "2");
+
+    MerkleTree a = MerkleTree::build("merkle_a");
+    MerkleTree b = MerkleTree::build("merkle_b");
+    auto groups = MerkleTree::find_duplicate_directories({&a, &b});
+
+    ASSERT_EQ(groups.size(), 3u);
+    auto x = std::find_if(groups.begin(), groups.end(), [](const auto& group) { return group.file_count == 1; });
+    ASSERT_NE(x, groups.end());
+    EXPECT_EQ(x->directories, (std::vector<fs::path>{"merkle_a/A/x", "merkle_a/C/x", "merkle_b/B/x", "merkle_b/D/x"}));
+}
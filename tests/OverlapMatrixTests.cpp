@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "../include/OverlapMatrix.hpp"
+
+namespace fs = std::filesystem;
+
+class OverlapMatrixTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("overlap_dir");
+        for (const char* root : {"overlap_dir/a", "overlap_dir/b", "overlap_dir/c"}) {
+            fs::create_directories(root);
+        }
+    }
+
+    void TearDown() override {
+        fs::remove_all("overlap_dir");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    static ScannedFile file(size_t root, const std::string& name, uintmax_t size, const std::string& digest) {
+        return {root, name, size, digest};
+    }
+};
+
+TEST_F(OverlapMatrixTests, CountsFilesBytesAndContentsPerPair) {
+    std::vector<ScannedFile> files = {
+        file(0, "x", 10, "dx"), file(0, "x2", 10, "dx"), file(0, "y", 20, "dy"), file(0, "z", 30, "dz"),
+        file(1, "x", 10, "dx"), file(1, "w", 40, "dw"),
+        file(2, "y", 20, "dy"), file(2, "x", 10, "dx"), file(2, "z", 30, "dz"),
+    };
+    OverlapMatrix matrix({"a", "b", "c"}, files);
+    ASSERT_EQ(matrix.root_count(), 3u);
+
+    EXPECT_EQ(matrix.cell(0, 0).files, 4u);
+    EXPECT_EQ(matrix.cell(0, 0).bytes, 70u);
+    EXPECT_EQ(matrix.cell(0, 0).contents, 3u);
+    // Both copies of x in a are found in b, but b holds only one of a's contents
+    EXPECT_EQ(matrix.cell(0, 1).files, 2u);
+    EXPECT_EQ(matrix.cell(0, 1).bytes, 20u);
+    EXPECT_EQ(matrix.cell(0, 1).contents, 1u);
+    EXPECT_EQ(matrix.cell(1, 0).files, 1u);
+    EXPECT_EQ(matrix.cell(1, 0).bytes, 10u);
+    EXPECT_EQ(matrix.cell(0, 2).files, 4u);
+    EXPECT_EQ(matrix.cell(2, 0).files, 3u);
+    EXPECT_EQ(matrix.cell(2, 0).bytes, 60u);
+    EXPECT_EQ(matrix.cell(1, 2).files, 1u);
+    EXPECT_EQ(matrix.cell(1, 1).bytes, 50u);
+}
+
+TEST_F(OverlapMatrixTests, SpansManyBitsetWords) {
+    // 300 contents, so every bitset runs over several words; root 1 holds
+    // every third content of root 0
+    std::vector<ScannedFile> files;
+    for (int i = 0; i < 300; ++i) {
+        files.push_back(file(0, "f" + std::to_string(i), 1, "d" + std::to_string(i)));
+        if (i % 3 == 0) {
+            files.push_back(file(1, "f" + std::to_string(i), 1, "d" + std::to_string(i)));
+        }
+    }
+    files.push_back(file(1, "own", 5, "only in b"));
+    OverlapMatrix matrix({"a", "b"}, files);
+    EXPECT_EQ(matrix.cell(0, 1).contents, 100u);
+    EXPECT_EQ(matrix.cell(0, 1).files, 100u);
+    EXPECT_EQ(matrix.cell(1, 0).contents, 100u);
+    EXPECT_EQ(matrix.cell(1, 1).contents, 101u);
+    EXPECT_EQ(matrix.cell(1, 1).bytes, 105u);
+}
+
+TEST_F(OverlapMatrixTests, WeighsEachSharedContentByItsOwnFiles) {
+    // Root 1 sees the contents in reverse and holds i copies of content i,
+    // so a weight read from the wrong holding changes the totals
+    std::vector<ScannedFile> files;
+    for (int i = 0; i < 200; ++i) {
+        files.push_back(file(0, "f" + std::to_string(i), i, "d" + std::to_string(i)));
+    }
+    uint64_t expected_files = 0;
+    uint64_t expected_bytes = 0;
+    for (int i = 199; i > 0; --i) {
+        if (i % 5 == 0) {
+            continue;
+        }
+        for (int copy = 0; copy < i; ++copy) {
+            files.push_back(file(1, "f" + std::to_string(i) + "_" + std::to_string(copy), i, "d" + std::to_string(i)));
+        }
+        expected_files += i;
+        expected_bytes += uint64_t(i) * i;
+    }
+    OverlapMatrix matrix({"a", "b"}, files);
+    EXPECT_EQ(matrix.cell(0, 1).contents, 160u);
+    EXPECT_EQ(matrix.cell(0, 1).files, 160u);
+    EXPECT_EQ(matrix.cell(1, 0).files, expected_files);
+    EXPECT_EQ(matrix.cell(1, 0).bytes, expected_bytes);
+    EXPECT_EQ(matrix.cell(1, 1).bytes, expected_bytes);
+}
+
+TEST_F(OverlapMatrixTests, ScansAndExports) {
+    writeTestFile("overlap_dir/a/one", "first shared content");
+    writeTestFile("overlap_dir/a/two", "only in a");
+    writeTestFile("overlap_dir/b/one", "first shared content");
+    writeTestFile("overlap_dir/c/other", "first shared content");
+    writeTestFile("overlap_dir/c/more", "only in c");
+
+    PipelineOptions options;
+    options.threads = 2;
+    OverlapMatrix matrix = OverlapMatrix::scan(
+        {"overlap_dir/a", "overlap_dir/b", "overlap_dir/c"}, {}, options);
+    EXPECT_EQ(matrix.cell(0, 1).files, 1u);
+    EXPECT_EQ(matrix.cell(0, 1).bytes, 20u);
+    EXPECT_EQ(matrix.cell(1, 0).files, 1u);
+    EXPECT_EQ(matrix.cell(2, 0).files, 1u);
+    EXPECT_EQ(matrix.cell(0, 0).files, 2u);
+
+    std::ostringstream csv;
+    matrix.write_csv(csv);
+    std::string text = csv.str();
+    EXPECT_EQ(text.rfind("from,to,files,bytes,contents\n", 0), 0u);
+    EXPECT_NE(text.find("overlap_dir/a,overlap_dir/b,1,20,1\n"), std::string::npos);
+    EXPECT_EQ(std::count(text.begin(), text.end(), '\n'), 10);
+
+    std::ostringstream json;
+    matrix.write_json(json);
+    EXPECT_EQ(json.str(),
+              "{\"roots\":[\"overlap_dir/a\",\"overlap_dir/b\",\"overlap_dir/c\"],"
+              "\"files\":[[2,1,1],[1,1,1],[1,1,2]],"
+              "\"bytes\":[[29,20,20],[20,20,20],[20,20,29]],"
+              "\"contents\":[[2,1,1],[1,1,1],[1,1,2]]}\n");
+}
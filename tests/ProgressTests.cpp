@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "../include/DirectoryComparer.hpp"
+#include "../include/Progress.hpp"
+
+namespace fs = std::filesystem;
+
+class ProgressTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("progress_a");
+        fs::create_directory("progress_a");
+    }
+
+    void TearDown() override {
+        fs::remove_all("progress_a");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+};
+
+TEST_F(ProgressTests, SnapshotSumsEveryThread) {
+    ProgressSnapshot before = progress::snapshot();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 1000; ++i) {
+                progress::add_file(3);
+            }
+            progress::add_directory();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ProgressSnapshot after = progress::snapshot();
+    EXPECT_EQ(after.files - before.files, 4000u);
+    EXPECT_EQ(after.bytes - before.bytes, 12000u);
+    EXPECT_EQ(after.directories - before.directories, 4u);
+}
+
+TEST_F(ProgressTests, JsonLinesReportScanAgainstEstimate) {
+    writeTestFile("progress_a/x.txt", "xxxx");
+    writeTestFile("progress_a/sub/y.txt", "yy");
+    writeTestFile("progress_a/.git/skipped", "not counted");
+
+    std::ostringstream out;
+    ProgressReporter reporter({"progress_a"}, {".git"}, ProgressFormat::JsonLines, out,
+                              std::chrono::milliseconds(5));
+    reporter.start();
+    DirectoryComparer::compare_directories({"progress_a"}, ComparisonMode::All, {".git"});
+    // Give the estimate walk time to finish so it is reported
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    reporter.stop();
+
+    std::string text = out.str();
+    ASSERT_FALSE(text.empty());
+    std::string last = text.substr(text.rfind('{'));
+    EXPECT_NE(last.find("\"files\":2,"), std::string::npos) << last;
+    EXPECT_NE(last.find("\"bytes\":6,"), std::string::npos) << last;
+    EXPECT_NE(last.find("\"directories\":2,"), std::string::npos) << last;
+    EXPECT_NE(last.find("\"estimated_files\":2,"), std::string::npos) << last;
+    EXPECT_NE(last.find("\"done\":true"), std::string::npos) << last;
+    // Periodic lines came before the final one
+    EXPECT_GT(std::count(text.begin(), text.end(), '\n'), 1);
+}
+
+TEST_F(ProgressTests, TerminalLineShowsCompletion) {
+    writeTestFile("progress_a/x.txt", "x");
+
+    std::ostringstream out;
+    ProgressReporter reporter({"progress_a"}, {}, ProgressFormat::Terminal, out,
+                              std::chrono::milliseconds(1000));
+    reporter.start();
+    DirectoryComparer::compare_directories({"progress_a"}, ComparisonMode::All, {});
+    reporter.stop();
+
+    // Not a terminal, so no carriage returns and no colour codes
+    std::string text = out.str();
+    EXPECT_EQ(text.find('\r'), std::string::npos);
+    EXPECT_NE(text.find("[100%] 1 files"), std::string::npos) << text;
+    EXPECT_NE(text.find("done in"), std::string::npos) << text;
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "../include/DuplicateIndex.hpp"
+#include "../include/QueryServer.hpp"
+
+class QueryServerTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        index.update("/data/a/x", {"d1", 10, 1});
+        index.update("/data/a/y", {"d2", 20, 1});
+        index.update("/data/b/x", {"d1", 10, 1});
+        index.update("/data/b/z", {"d3", 30, 1});
+    }
+
+    static int connectTo(const char* path) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, path);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Whether a response arrives on fd within timeout_ms
+    static bool answered(int fd, int timeout_ms) {
+        pollfd ready{fd, POLLIN, 0};
+        return poll(&ready, 1, timeout_ms) == 1;
+    }
+
+    DuplicateIndex index;
+};
+
+TEST_F(QueryServerTests, LooksUpByDigest) {
+    QueryServer server(index, "unused.sock");
+    EXPECT_EQ(server.handle_request(R"({"op":"lookup","digest":"d1"})"),
+              R"({"ok":true,"paths":["/data/a/x","/data/b/x"]})");
+    EXPECT_EQ(server.handle_request(R"({"op":"lookup","digest":"none"})"),
+              R"({"ok":true,"paths":[]})");
+}
+
+TEST_F(QueryServerTests, FindsDuplicatesOfPath) {
+    QueryServer server(index, "unused.sock");
+    EXPECT_EQ(server.handle_request(R"({"op": "duplicates", "path": "/data/a/./x"})"),
+              R"({"ok":true,"digest":"d1","paths":["/data/b/x"]})");
+    EXPECT_EQ(server.handle_request(R"({"op":"duplicates","path":"/data/missing"})"),
+              R"({"ok":false,"error":"not indexed: /data/missing"})");
+}
+
+TEST_F(QueryServerTests, ListsUniqueInRoot) {
+    QueryServer server(index, "unused.sock");
+    EXPECT_EQ(server.handle_request(R"({"op":"unique","root":"/data/a/"})"),
+              R"({"ok":true,"paths":["/data/a/y"]})");
+}
+
+TEST_F(QueryServerTests, ReportsStatsAndErrors) {
+    QueryServer server(index, "unused.sock");
+    EXPECT_EQ(server.handle_request(R"({"op":"stats"})"),
+              R"({"ok":true,"files":4,"bytes":70,"duplicate_groups":1,"requests":1})");
+    EXPECT_EQ(server.handle_request("not json"),
+              R"({"ok":false,"error":"malformed request: expected '{'"})");
+    EXPECT_EQ(server.handle_request(R"({"op":"drop"})"),
+              R"({"ok":false,"error":"unknown op: drop"})");
+}
+
+TEST_F(QueryServerTests, AnswersOverUnixSocket) {
+    QueryServer server(index, "fsf_query_test.sock");
+    server.start();
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, "fsf_query_test.sock");
+    ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+
+    std::string requests = "{\"op\":\"lookup\",\"digest\":\"d3\"}\n{\"op\":\"stats\"}\n";
+    ASSERT_EQ(write(fd, requests.data(), requests.size()), static_cast<ssize_t>(requests.size()));
+
+    std::string responses;
+    char buffer[1024];
+    while (std::count(responses.begin(), responses.end(), '\n') < 2) {
+        ssize_t received = read(fd, buffer, sizeof(buffer));
+        ASSERT_GT(received, 0);
+        responses.append(buffer, static_cast<size_t>(received));
+    }
+    EXPECT_EQ(responses,
+              "{\"ok\":true,\"paths\":[\"/data/b/z\"]}\n"
+              "{\"ok\":true,\"files\":4,\"bytes\":70,\"duplicate_groups\":1,\"requests\":2}\n");
+
+    // stop() must not hang on a client that is still connected
+    server.stop();
+    close(fd);
+    EXPECT_EQ(server.get_request_count(), 2u);
+}
+
+TEST_F(QueryServerTests, SocketIsPrivateAndConnectionsAreCapped) {
+    QueryServer server(index, "fsf_query_cap.sock", 1);
+    server.start();
+    struct stat st;
+    ASSERT_EQ(::stat("fsf_query_cap.sock", &st), 0);
+    EXPECT_EQ(st.st_mode & 0777, 0600u);
+
+    std::string request = "{\"op\":\"stats\"}\n";
+    int first = connectTo("fsf_query_cap.sock");
+    ASSERT_GE(first, 0);
+    ASSERT_EQ(write(first, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+    EXPECT_TRUE(answered(first, 5000));
+
+    // The second client waits in the backlog until the first one leaves
+    int second = connectTo("fsf_query_cap.sock");
+    ASSERT_GE(second, 0);
+    ASSERT_EQ(write(second, request.data(), request.size()), static_cast<ssize_t>(request.size()));
+    EXPECT_FALSE(answered(second, 200));
+    close(first);
+    EXPECT_TRUE(answered(second, 5000));
+
+    server.stop();
+    close(second);
+}
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "../include/Coroutine.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/ScanPipeline.hpp"
+
+namespace fs = std::filesystem;
+
+class ScanPipelineTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("pipeline_a");
+        fs::remove_all("pipeline_b");
+        fs::create_directory("pipeline_a");
+        fs::create_directory("pipeline_b");
+    }
+
+    void TearDown() override {
+        fs::remove_all("pipeline_a");
+        fs::remove_all("pipeline_b");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+};
+
+namespace {
+
+Task produce(Channel<int>& channel, int count, std::atomic<size_t>& peak) {
+    for (int i = 0; i < count; ++i) {
+        co_await channel.send(i);
+        peak = std::max(peak.load(), channel.depth());
+    }
+    channel.producer_done();
+}
+
+Task consume(Channel<int>& channel, std::vector<int>& received) {
+    while (auto value = co_await channel.receive()) {
+        received.push_back(*value);
+    }
+}
+
+struct BlockingCounts {
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    std::atomic<int> errors{0};
+};
+
+Task block(BlockingPool& pool, BlockingCounts& counts, bool fail) {
+    try {
+        co_await pool.run([&counts, fail] {
+            int now = ++counts.running;
+            int seen = counts.peak.load();
+            while (now > seen && !counts.peak.compare_exchange_weak(seen, now)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            --counts.running;
+            if (fail) {
+                throw std::runtime_error("read failed");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        ++counts.errors;
+    }
+}
+
+} // namespace
+
+TEST_F(ScanPipelineTests, BlockingPoolOverlapsCallsUpToItsLimit) {
+    // One executor thread, yet the calls overlap on the pool's own threads,
+    // never more of them than the pool may start
+    Executor executor(1);
+    BlockingPool pool(executor, 3);
+    BlockingCounts counts;
+    for (int i = 0; i < 12; ++i) {
+        executor.spawn(block(pool, counts, i % 4 == 0));
+    }
+    executor.run();
+
+    EXPECT_GT(counts.peak.load(), 1);
+    EXPECT_LE(counts.peak.load(), 3);
+    EXPECT_LE(pool.thread_count(), 3u);
+    EXPECT_EQ(counts.errors.load(), 3);
+}
+
+TEST_F(ScanPipelineTests, ChannelBoundsAndOrders) {
+    for (unsigned threads : {1u, 4u}) {
+        Executor executor(threads);
+        Channel<int> channel(executor, 4);
+        std::atomic<size_t> peak(0);
+        std::vector<int> received;
+        executor.spawn(produce(channel, 1000, peak));
+        executor.spawn(consume(channel, received));
+        executor.run();
+
+        ASSERT_EQ(received.size(), 1000u);
+        EXPECT_TRUE(std::is_sorted(received.begin(), received.end()));
+        EXPECT_LE(peak.load(), channel.capacity());
+    }
+}
+
+TEST_F(ScanPipelineTests, ChannelWithManyProducers) {
+    Executor executor(4);
+    Channel<int> channel(executor, 2, 8);
+    std::atomic<size_t> peak(0);
+    std::vector<int> received;
+    for (int p = 0; p < 8; ++p) {
+        executor.spawn(produce(channel, 200, peak));
+    }
+    executor.spawn(consume(channel, received));
+    executor.run();
+
+    EXPECT_EQ(received.size(), 1600u);
+    EXPECT_LE(peak.load(), channel.capacity());
+}
+
+TEST_F(ScanPipelineTests, MatchesFileHashMapper) {
+    writeTestFile("pipeline_a/one.txt", "first");
+    writeTestFile("pipeline_a/sub/two.txt", "second");
+    writeTestFile("pipeline_a/sub/deeper/big.bin", std::string(300000, 'b'));
+    writeTestFile("pipeline_a/.git/config", "excluded");
+    writeTestFile("pipeline_b/one.txt", "first");
+    writeTestFile("pipeline_b/empty", "");
+
+    PipelineOptions options;
+    options.threads = 3;
+    options.channel_capacity = 2;
+    options.prefetch_limit = 1000;   // big.bin goes through the streaming path
+    ScanPipeline pipeline({"pipeline_a", "pipeline_b"}, {".git"}, options);
+    auto files = pipeline.run();
+
+    std::map<std::string, std::string> found;
+    for (const auto& file : files) {
+        found[std::to_string(file.root) + "/" + file.relative_path.generic_string()] = file.digest;
+    }
+    std::map<std::string, std::string> expected = {
+        {"0/one.txt", FileHashMapper::compute_md5("pipeline_a/one.txt")},
+        {"0/sub/two.txt", FileHashMapper::compute_md5("pipeline_a/sub/two.txt")},
+        {"0/sub/deeper/big.bin", FileHashMapper::compute_md5("pipeline_a/sub/deeper/big.bin")},
+        {"1/one.txt", FileHashMapper::compute_md5("pipeline_b/one.txt")},
+        {"1/empty", FileHashMapper::compute_md5("pipeline_b/empty")},
+    };
+    EXPECT_EQ(found, expected);
+    EXPECT_EQ(pipeline.get_stats().files, 5u);
+    EXPECT_EQ(pipeline.get_stats().bytes, 300016u);
+}
+
+TEST_F(ScanPipelineTests, FilterDropsBeforeReading) {
+    for (int i = 0; i < 20; ++i) {
+        writeTestFile("pipeline_a/f" + std::to_string(i), std::string(static_cast<size_t>(i), 'x'));
+    }
+    PipelineOptions options;
+    options.filter = [](const fs::path&, uintmax_t size) { return size >= 10; };
+    ScanPipeline pipeline({"pipeline_a"}, {}, options);
+    auto files = pipeline.run();
+
+    EXPECT_EQ(files.size(), 10u);
+    EXPECT_EQ(pipeline.get_stats().filtered, 10u);
+    for (const auto& file : files) {
+        EXPECT_GE(file.size, 10u);
+    }
+}
+
+TEST_F(ScanPipelineTests, ErrorStopsEveryStage) {
+    for (int i = 0; i < 50; ++i) {
+        writeTestFile("pipeline_a/f" + std::to_string(i), "data");
+    }
+    PipelineOptions options;
+    options.threads = 2;
+    options.channel_capacity = 1;
+    options.filter = [](const fs::path& path, uintmax_t) {
+        if (path == "f25") {
+            throw std::runtime_error("filter failed");
+        }
+        return true;
+    };
+    ScanPipeline pipeline({"pipeline_a", "pipeline_missing"}, {}, options);
+    EXPECT_THROW(pipeline.run(), std::runtime_error);
+}
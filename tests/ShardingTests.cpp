@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/ExternalDuplicateFinder.hpp"
+#include "../include/Sharding.hpp"
+#include "../include/TreeHash.hpp"
+
+namespace fs = std::filesystem;
+
+class ShardingTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const auto& dir : {"shard_a", "shard_b", "shard_parts"}) {
+            fs::remove_all(dir);
+            fs::create_directory(dir);
+        }
+        // Ten top-level subtrees with files shared between and within roots
+        for (int i = 0; i < 40; ++i) {
+            std::string sub = "/top" + std::to_string(i % 10) + "/f" + std::to_string(i) + ".txt";
+            writeTestFile("shard_a" + sub, "content " + std::to_string(i % 7));
+            if (i % 3 != 0) {
+                writeTestFile("shard_b" + sub, "content " + std::to_string(i % 4 ? i % 7 : 99));
+            }
+        }
+        writeTestFile("shard_b/only_b.txt", "content 1");
+    }
+
+    void TearDown() override {
+        for (const auto& dir : {"shard_a", "shard_b", "shard_parts"}) {
+            fs::remove_all(dir);
+        }
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    std::vector<fs::path> writePartials(size_t count, ShardKey key) {
+        std::vector<fs::path> partials;
+        for (size_t i = 0; i < count; ++i) {
+            partials.push_back("shard_parts/part" + std::to_string(i));
+            write_partial({"shard_a", "shard_b"}, {}, ShardSpec{i, count, key}, partials.back());
+        }
+        return partials;
+    }
+
+    static std::map<std::string, std::set<std::string>> groupsOf(const PartialMerger& merger) {
+        std::map<std::string, std::set<std::string>> groups;
+        merger.merge_groups([&groups](const ExternalGroup& group) {
+            for (const auto& member : group.members) {
+                groups[group.digest].insert(std::to_string(member.root) + ":" + member.relative_path.generic_string());
+            }
+        });
+        return groups;
+    }
+
+    static std::map<std::string, EntryStatus> entriesOf(const PartialMerger& merger) {
+        std::map<std::string, EntryStatus> entries;
+        merger.merge_entries([&entries](const ComparisonEntry& entry) {
+            entries[entry.relative_path.generic_string()] = entry.status;
+        });
+        return entries;
+    }
+};
+
+TEST_F(ShardingTests, ParsesShardSpec) {
+    ShardSpec spec = ShardSpec::parse("2/8", ShardKey::PathHash);
+    EXPECT_EQ(spec.index, 2u);
+    EXPECT_EQ(spec.count, 8u);
+    EXPECT_EQ(spec.key, ShardKey::PathHash);
+    EXPECT_THROW(ShardSpec::parse("8/8"), std::runtime_error);
+    EXPECT_THROW(ShardSpec::parse("x"), std::runtime_error);
+}
+
+TEST_F(ShardingTests, EveryPathHasExactlyOneOwner) {
+    for (ShardKey key : {ShardKey::Subtree, ShardKey::PathHash}) {
+        for (const auto& path : {"top1/a.txt", "top1/deep/b.txt", "c.txt"}) {
+            int owners = 0;
+            for (size_t i = 0; i < 5; ++i) {
+                owners += ShardSpec{i, 5, key}.owns(path);
+            }
+            EXPECT_EQ(owners, 1) << path;
+        }
+    }
+    // Subtree sharding keeps a whole top-level directory together
+    ShardSpec spec{0, 5, ShardKey::Subtree};
+    EXPECT_EQ(spec.owns("top1/a.txt"), spec.owns("top1/deep/b.txt"));
+}
+
+TEST_F(ShardingTests, MergedPartialsMatchSingleScan) {
+    ExternalDuplicateFinder finder({"shard_a", "shard_b"}, {});
+    std::map<std::string, std::set<std::string>> expected_groups;
+    finder.run([&expected_groups](const ExternalGroup& group) {
+        for (const auto& member : group.members) {
+            expected_groups[group.digest].insert(std::to_string(member.root) + ":" + member.relative_path.generic_string());
+        }
+    });
+    auto single_entries = entriesOf(PartialMerger(writePartials(1, ShardKey::Subtree)));
+
+    for (ShardKey key : {ShardKey::Subtree, ShardKey::PathHash}) {
+        PartialMerger merger(writePartials(4, key));
+        EXPECT_EQ(groupsOf(merger), expected_groups);
+        EXPECT_EQ(entriesOf(merger), single_entries);
+    }
+
+    EXPECT_EQ(single_entries.at("top1/f1.txt"), EntryStatus::Same);
+    EXPECT_EQ(single_entries.at("top4/f4.txt"), EntryStatus::Different);
+    EXPECT_EQ(single_entries.at("top0/f0.txt"), EntryStatus::Unique);
+    EXPECT_EQ(single_entries.at("only_b.txt"), EntryStatus::Unique);
+}
+
+TEST_F(ShardingTests, ShardsRunAsSeparateProcesses) {
+    std::vector<fs::path> partials;
+    std::vector<pid_t> children;
+    for (size_t i = 0; i < 3; ++i) {
+        partials.push_back("shard_parts/process" + std::to_string(i));
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            write_partial({"shard_a", "shard_b"}, {}, ShardSpec{i, 3, ShardKey::PathHash}, partials.back());
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        ASSERT_EQ(waitpid(pid, &status, 0), pid);
+        ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    PartialMerger merger(partials);
+    EXPECT_EQ(merger.directories(), (std::vector<fs::path>{"shard_a", "shard_b"}));
+    EXPECT_EQ(entriesOf(merger).size(), 41u);
+}
+
+TEST_F(ShardingTests, RejectsIncompleteOrMixedPartials) {
+    auto partials = writePartials(3, ShardKey::Subtree);
+    EXPECT_THROW(PartialMerger({partials[0], partials[1]}), std::runtime_error);
+    EXPECT_THROW(PartialMerger({partials[0], partials[0], partials[1], partials[2]}), std::runtime_error);
+
+    write_partial({"shard_a"}, {}, ShardSpec{0, 3, ShardKey::Subtree}, "shard_parts/other");
+    EXPECT_THROW(PartialMerger({"shard_parts/other", partials[1], partials[2]}), std::runtime_error);
+
+    // Large files' digests depend on the tree hash threshold
+    tree_hash::set_threshold(1 << 20);
+    write_partial({"shard_a", "shard_b"}, {}, ShardSpec{0, 3, ShardKey::Subtree}, "shard_parts/tree_hashed");
+    tree_hash::set_threshold(0);
+    EXPECT_THROW(PartialMerger({"shard_parts/tree_hashed", partials[1], partials[2]}), std::runtime_error);
+}
+
+TEST_F(ShardingTests, RejectsCorruptShardFields) {
+    auto partials = writePartials(2, ShardKey::Subtree);
+    // index, count and key follow the 8-byte magic
+    auto corrupt = [&](std::streamoff offset, uint32_t value) {
+        fs::copy_file(partials[0], "shard_parts/corrupt", fs::copy_options::overwrite_existing);
+        std::fstream file("shard_parts/corrupt", std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        file.close();
+        try {
+            PartialMerger({"shard_parts/corrupt", partials[1]});
+            ADD_FAILURE() << "accepted a corrupt field at offset " << offset;
+        } catch (const std::runtime_error& e) {
+            EXPECT_NE(std::string(e.what()).find("Corrupt partial result file"), std::string::npos) << e.what();
+        }
+    };
+    corrupt(8, 2);     // index == count
+    corrupt(8, 7);     // index > count
+    corrupt(12, 0);    // count == 0
+    corrupt(16, 9);    // unknown key
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "../include/DirectoryComparer.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/SharedExtents.hpp"
+
+namespace fs = std::filesystem;
+
+class SharedExtentsTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("extents_a");
+        fs::remove_all("extents_b");
+        fs::create_directory("extents_a");
+        fs::create_directory("extents_b");
+    }
+
+    void TearDown() override {
+        fs::remove_all("extents_a");
+        fs::remove_all("extents_b");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    // FIEMAP is missing on some filesystems (tmpfs, overlay); nothing to test there
+    static bool extentsAvailable(const fs::path& path) {
+        ExtentMap map;
+        return read_extent_map(path, map) && !map.signature.empty();
+    }
+};
+
+TEST_F(SharedExtentsTests, HardLinksShareSignature) {
+    writeTestFile("extents_a/one", std::string(16384, 'x'));
+    writeTestFile("extents_a/copy", std::string(16384, 'x'));
+    fs::create_hard_link("extents_a/one", "extents_a/link");
+    if (!extentsAvailable("extents_a/one")) {
+        GTEST_SKIP() << "filesystem does not report extents";
+    }
+
+    ExtentMap one, link, copy;
+    ASSERT_TRUE(read_extent_map("extents_a/one", one));
+    ASSERT_TRUE(read_extent_map("extents_a/link", link));
+    ASSERT_TRUE(read_extent_map("extents_a/copy", copy));
+    EXPECT_EQ(one.signature, link.signature);
+    EXPECT_EQ(one.links, 2u);
+    EXPECT_NE(one.signature, copy.signature);
+    EXPECT_EQ(copy.links, 1u);
+}
+
+TEST_F(SharedExtentsTests, CacheReusesDigestOfSharedStorage) {
+    std::string content(16384, 'y');
+    writeTestFile("extents_a/one", content);
+    writeTestFile("extents_a/copy", content);
+    fs::create_hard_link("extents_a/one", "extents_a/link");
+    if (!extentsAvailable("extents_a/one")) {
+        GTEST_SKIP() << "filesystem does not report extents";
+    }
+
+    SharedExtentCache cache;
+    bool read = false;
+    std::string expected = FileHashMapper::compute_md5("extents_a/one");
+    EXPECT_EQ(cache.digest("extents_a/one", content.size(), read), expected);
+    EXPECT_TRUE(read);
+    EXPECT_EQ(cache.digest("extents_a/link", content.size(), read), expected);
+    EXPECT_FALSE(read);
+    // An ordinary copy has its own blocks and is read as usual
+    EXPECT_EQ(cache.digest("extents_a/copy", content.size(), read), expected);
+    EXPECT_TRUE(read);
+
+    SharedExtentStats stats = cache.stats();
+    EXPECT_EQ(stats.files_queried, 3u);
+    EXPECT_EQ(stats.files_shared, 1u);
+    EXPECT_EQ(stats.bytes_avoided, content.size());
+    ASSERT_EQ(cache.shared_groups().size(), 1u);
+    EXPECT_EQ(cache.shared_groups()[0],
+              (std::vector<fs::path>{"extents_a/one", "extents_a/link"}));
+}
+
+TEST_F(SharedExtentsTests, ComparisonSkipsLinkedFiles) {
+    writeTestFile("extents_a/data.bin", std::string(32768, 'z'));
+    writeTestFile("extents_a/other.txt", "only in a");
+    fs::create_hard_link("extents_a/data.bin", "extents_b/data.bin");
+    if (!extentsAvailable("extents_a/data.bin")) {
+        GTEST_SKIP() << "filesystem does not report extents";
+    }
+
+    ComparisonOptions options;
+    options.detect_shared_extents = true;
+    auto result = DirectoryComparer::compare_directories({"extents_a", "extents_b"}, ComparisonMode::All, {},
+                                                         options);
+
+    EXPECT_EQ(result.files_hashed, 2u);
+    EXPECT_EQ(result.shared_extents.files_shared, 1u);
+    EXPECT_EQ(result.shared_extents.bytes_avoided, 32768u);
+    ASSERT_EQ(result.already_deduplicated.size(), 1u);
+    ASSERT_EQ(result.entries.size(), 2u);
+    EXPECT_EQ(result.entries[0].relative_path, fs::path("data.bin"));
+    EXPECT_EQ(result.entries[0].status, EntryStatus::Same);
+}
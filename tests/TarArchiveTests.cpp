@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "../include/Cancellation.hpp"
+#include "../include/DirectoryComparer.hpp"
+#include "../include/ExternalDuplicateFinder.hpp"
+#include "../include/FileHashMapper.hpp"
+#include "../include/TarArchive.hpp"
+
+#if FSF_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+class TarArchiveTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const auto& dir : {"tar_a", "tar_b"}) {
+            fs::remove_all(dir);
+            fs::create_directory(dir);
+        }
+    }
+
+    void TearDown() override {
+        for (const auto& dir : {"tar_a", "tar_b"}) {
+            fs::remove_all(dir);
+        }
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+        file.close();
+    }
+
+    // One ustar header block followed by the padded data. magic is the 8
+    // bytes at offset 257: POSIX "ustar\0" "00" or old GNU "ustar  \0".
+    static std::string tarEntry(const std::string& name, const std::string& data, char type = '0',
+                                const std::string& prefix = "", const char* magic = "ustar\0" "00") {
+        char header[512] = {};
+        std::memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+        std::snprintf(header + 100, 8, "%07o", 0644);
+        std::snprintf(header + 124, 12, "%011o", static_cast<unsigned>(data.size()));
+        std::snprintf(header + 136, 12, "%011o", 1700000000u);
+        header[156] = type;
+        std::memcpy(header + 257, magic, 8);
+        std::memcpy(header + 345, prefix.data(), std::min<size_t>(prefix.size(), 155));
+        std::memset(header + 148, ' ', 8);
+        unsigned sum = 0;
+        for (unsigned char c : header) {
+            sum += c;
+        }
+        std::snprintf(header + 148, 8, "%06o", sum);
+        std::string entry(header, sizeof(header));
+        entry += data;
+        entry.append((512 - data.size() % 512) % 512, '\0');
+        return entry;
+    }
+
+    static std::string paxRecord(const std::string& key, const std::string& value) {
+        // The length counts itself, so settle it by trying
+        std::string body = " " + key + "=" + value + "\n";
+        size_t length = body.size() + 1;
+        while (std::to_string(length).size() + body.size() != length) {
+            ++length;
+        }
+        return std::to_string(length) + body;
+    }
+
+    static std::string tarEnd() {
+        return std::string(1024, '\0');
+    }
+
+    static std::map<std::string, std::string> members(const fs::path& archive) {
+        std::map<std::string, std::string> result;
+        for_each_tar_member(archive, [&result](const TarMember& member) {
+            result[member.path] = member.digest;
+        });
+        return result;
+    }
+
+    static std::string md5(const std::string& data) {
+        return FileHashMapper::compute_md5_of_buffer(data.data(), data.size());
+    }
+};
+
+TEST_F(TarArchiveTests, RecognizesArchiveNames) {
+    EXPECT_TRUE(is_tar_archive("backup.tar"));
+    EXPECT_TRUE(is_tar_archive("dir/BACKUP.TAR"));
+    EXPECT_FALSE(is_tar_archive("backup.tar.bak"));
+    EXPECT_EQ(is_tar_archive("backup.tar.gz"), FSF_HAVE_ZLIB != 0);
+    EXPECT_EQ(archive_member_path("sub/backup.tar", "dir/file").generic_string(), "sub/backup.tar!/dir/file");
+}
+
+TEST_F(TarArchiveTests, HashesRegularMembersOnly) {
+    writeTestFile("tar_a/backup.tar",
+                  tarEntry("dir/", "", '5') +
+                  tarEntry("./dir/one.txt", "first file") +
+                  tarEntry("two.txt", "second", '0', "deep/prefix") +
+                  tarEntry("link.txt", "", '1') +
+                  tarEntry("empty.txt", "") +
+                  tarEnd());
+
+    auto result = members("tar_a/backup.tar");
+    EXPECT_EQ(result, (std::map<std::string, std::string>{
+        {"dir/one.txt", md5("first file")},
+        {"deep/prefix/two.txt", md5("second")},
+        {"empty.txt", md5("")},
+    }));
+}
+
+TEST_F(TarArchiveTests, PaxHeadersOverrideNameAndSize) {
+    std::string long_name = std::string(120, 'n') + "/file.txt";
+    std::string data(1500, 'x');
+    writeTestFile("tar_a/pax.tar",
+                  tarEntry("PaxHeaders/file", paxRecord("path", long_name) + paxRecord("mtime", "1700000001.5"), 'x') +
+                  tarEntry("truncated-name", data) +
+                  tarEntry("././@LongLink", std::string(130, 'g') + '\0', 'L') +
+                  tarEntry("short", "gnu") +
+                  tarEnd());
+
+    std::vector<TarMember> found;
+    for_each_tar_member("tar_a/pax.tar", [&found](const TarMember& member) { found.push_back(member); });
+    ASSERT_EQ(found.size(), 2u);
+    EXPECT_EQ(found[0].path, long_name);
+    EXPECT_EQ(found[0].size, 1500u);
+    EXPECT_EQ(found[0].mtime, 1700000001);
+    EXPECT_EQ(found[0].digest, md5(data));
+    EXPECT_EQ(found[1].path, std::string(130, 'g'));
+    EXPECT_EQ(found[1].mtime, 1700000000);
+}
+
+TEST_F(TarArchiveTests, OldGnuHeadersHaveNoPrefix) {
+    // Old GNU headers keep atime where POSIX keeps the name prefix
+    writeTestFile("tar_a/gnu.tar", tarEntry("file.txt", "gnu", '0', "14712345670", "ustar  \0") + tarEnd());
+    EXPECT_EQ(members("tar_a/gnu.tar"), (std::map<std::string, std::string>{{"file.txt", md5("gnu")}}));
+}
+
+TEST_F(TarArchiveTests, ExpiredDeadlineStopsInsideLargeMember) {
+    writeTestFile("tar_a/big.tar", tarEntry("big.bin", std::string(32 << 20, 'b')) + tarEnd());
+    CancellationToken expired(std::chrono::milliseconds(0));
+
+    size_t delivered = 0;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_THROW(for_each_tar_member("tar_a/big.tar", [&](const TarMember&) { ++delivered; }, &expired),
+                 OperationCancelled);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    EXPECT_EQ(delivered, 0u);
+
+    // Archives expanded into a tree stop the same way
+    TreeBuildOptions options;
+    options.expand_archives = true;
+    options.cancel = &expired;
+    EXPECT_FALSE(MerkleTree::build("tar_a", {}, nullptr, options).is_complete());
+}
+
+TEST_F(TarArchiveTests, RejectsCorruptHeader) {
+    std::string archive = tarEntry("file.txt", "data") + tarEnd();
+    archive[10] ^= 1;
+    writeTestFile("tar_a/bad.tar", archive);
+    EXPECT_THROW(members("tar_a/bad.tar"), std::runtime_error);
+}
+
+TEST_F(TarArchiveTests, UnreadableArchivesAreHashedAsPlainFiles) {
+    writeTestFile("tar_a/notes.tar", "just some text, not an archive");
+    std::string archive = tarEntry("first.txt", "whole") + tarEntry("cut.txt", std::string(2000, 'c')) + tarEnd();
+    writeTestFile("tar_a/cut.tar", archive.substr(0, 1536));
+    writeTestFile("tar_a/good.tar", tarEntry("inside.txt", "fine") + tarEnd());
+
+    FileHashMapper mapper(true);
+    mapper.process_directory("tar_a");
+    auto hashes = mapper.get_file_hashes();
+    EXPECT_EQ(hashes, (std::unordered_map<std::string, std::string>{
+        {"notes.tar", md5("just some text, not an archive")},
+        {"cut.tar", md5(archive.substr(0, 1536))},
+        {"good.tar!/inside.txt", md5("fine")},
+    }));
+    EXPECT_EQ(mapper.get_file_count(), 3u);
+    EXPECT_TRUE(mapper.is_complete());
+
+    TreeBuildOptions tree_options;
+    tree_options.expand_archives = true;
+    MerkleTree tree = MerkleTree::build("tar_a", {}, nullptr, tree_options);
+    EXPECT_TRUE(tree.is_complete());
+    EXPECT_EQ(tree.root().file_count, 3u);
+    const MerkleNode* notes = tree.root().find_child("notes.tar");
+    ASSERT_NE(notes, nullptr);
+    EXPECT_FALSE(notes->is_directory);
+    EXPECT_EQ(notes->digest, DigestString(md5("just some text, not an archive")));
+    EXPECT_EQ(tree.root().find_child("cut.tar!"), nullptr);
+
+    ExternalOptions external_options;
+    external_options.expand_archives = true;
+    ExternalDuplicateFinder finder({"tar_a"}, {}, external_options);
+    EXPECT_NO_THROW(finder.run([](const ExternalGroup&) {}));
+}
+
+#if FSF_HAVE_ZLIB
+TEST_F(TarArchiveTests, ReadsGzipCompressedArchives) {
+    std::string archive = tarEntry("inner/file.txt", "compressed member") + tarEnd();
+    gzFile out = gzopen("tar_a/backup.tgz", "wb");
+    ASSERT_NE(out, nullptr);
+    gzwrite(out, archive.data(), static_cast<unsigned>(archive.size()));
+    gzclose(out);
+
+    EXPECT_EQ(members("tar_a/backup.tgz"),
+              (std::map<std::string, std::string>{{"inner/file.txt", md5("compressed member")}}));
+}
+#endif
+
+TEST_F(TarArchiveTests, MembersTakePartInComparison) {
+    writeTestFile("tar_a/backup.tar", tarEntry("dir/same.txt", "same") + tarEntry("dir/changed.txt", "old") + tarEnd());
+    writeTestFile("tar_b/backup.tar", tarEntry("dir/same.txt", "same") + tarEntry("dir/changed.txt", "new") + tarEnd());
+
+    ComparisonOptions options;
+    options.expand_archives = true;
+    ComparisonResult result = DirectoryComparer::compare_directories(
+        {"tar_a", "tar_b"}, ComparisonMode::All, {}, options);
+
+    std::map<std::string, EntryStatus> entries;
+    for (const auto& entry : result.entries) {
+        entries[entry.relative_path.generic_string()] = entry.status;
+    }
+    EXPECT_EQ(entries, (std::map<std::string, EntryStatus>{
+        {"backup.tar!/dir/changed.txt", EntryStatus::Different},
+        {"backup.tar!/dir/same.txt", EntryStatus::Same},
+    }));
+    EXPECT_EQ(result.files_scanned, 4u);
+}
+
+TEST_F(TarArchiveTests, MembersTakePartInDuplicateGrouping) {
+    writeTestFile("tar_a/backup.tar", tarEntry("kept.txt", "duplicate me") + tarEnd());
+    writeTestFile("tar_a/live/kept.txt", "duplicate me");
+
+    FileHashMapper mapper(true);
+    mapper.process_directory("tar_a");
+    auto hashes = mapper.get_file_hashes();
+    EXPECT_EQ(hashes.at("backup.tar!/kept.txt"), hashes.at("live/kept.txt"));
+    EXPECT_EQ(mapper.get_file_count(), 2u);
+
+    ExternalOptions options;
+    options.expand_archives = true;
+    ExternalDuplicateFinder finder({"tar_a"}, {}, options);
+    std::vector<std::string> paths;
+    finder.run([&paths](const ExternalGroup& group) {
+        for (const auto& member : group.members) {
+            paths.push_back(member.relative_path.generic_string());
+        }
+    });
+    std::sort(paths.begin(), paths.end());
+    EXPECT_EQ(paths, (std::vector<std::string>{"backup.tar!/kept.txt", "live/kept.txt"}));
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "../include/DirectoryComparer.hpp"
+#include "../include/Tracer.hpp"
+
+namespace fs = std::filesystem;
+
+class TracerTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("trace_a");
+        fs::create_directory("trace_a");
+        trace::clear();
+    }
+
+    void TearDown() override {
+        trace::stop();
+        trace::clear();
+        fs::remove_all("trace_a");
+        fs::remove("trace.json");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream file(path);
+        file << content;
+        file.close();
+    }
+
+    std::string readTrace() {
+        std::ifstream file("trace.json");
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+};
+
+TEST_F(TracerTests, ScanWritesChromeTraceEvents) {
+    writeTestFile("trace_a/x.txt", "x");
+    writeTestFile("trace_a/sub/y.txt", "y");
+
+    trace::start();
+    DirectoryComparer::compare_directories({"trace_a"}, ComparisonMode::All, {});
+    trace::stop();
+    size_t written = trace::write("trace.json");
+
+    std::string json = readTrace();
+    EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(json.find("\"name\":\"directory\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"open\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"read\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"hash\""), std::string::npos);
+    EXPECT_NE(json.find("\"path\":\"trace_a/sub/y.txt\""), std::string::npos);
+    EXPECT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"dropped_events\":0"), std::string::npos);
+    // Two directories and two files at least
+    EXPECT_GE(written, 4u);
+}
+
+TEST_F(TracerTests, NothingIsRecordedWhenStopped) {
+    writeTestFile("trace_a/x.txt", "x");
+    DirectoryComparer::compare_directories({"trace_a"}, ComparisonMode::All, {});
+    EXPECT_EQ(trace::write("trace.json"), 0u);
+}
+
+TEST_F(TracerTests, FullRingKeepsNewestEvents) {
+    // A fresh thread gets a buffer of the capacity in force when it starts
+    trace::start(8);
+    std::thread([] {
+        auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < 20; ++i) {
+            trace::record("tick", now, now);
+        }
+    }).join();
+    trace::stop();
+
+    EXPECT_EQ(trace::write("trace.json"), 8u);
+    EXPECT_NE(readTrace().find("\"dropped_events\":12"), std::string::npos);
+}
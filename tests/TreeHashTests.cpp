@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "../include/FileHashMapper.hpp"
+#include "../include/TreeHash.hpp"
+
+namespace fs = std::filesystem;
+
+class TreeHashTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all("tree_hash_dir");
+        fs::create_directory("tree_hash_dir");
+    }
+
+    void TearDown() override {
+        tree_hash::set_threshold(0);
+        fs::remove_all("tree_hash_dir");
+    }
+
+    void writeTestFile(const std::string& path, const std::string& content) {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+        file.close();
+    }
+
+    static std::string pattern(size_t size) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<char>((i * 131) ^ (i >> 12));
+        }
+        return data;
+    }
+
+    static std::string from_hex(const std::string& hex) {
+        std::string bytes;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            bytes += static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16));
+        }
+        return bytes;
+    }
+
+    static std::string le64(uint64_t value) {
+        std::string bytes;
+        for (int i = 0; i < 8; ++i) {
+            bytes += static_cast<char>(value >> (8 * i));
+        }
+        return bytes;
+    }
+};
+
+TEST_F(TreeHashTests, MatchesDocumentedConstruction) {
+    std::string data = pattern(2 * tree_hash_chunk_size + 12345);
+    writeTestFile("tree_hash_dir/big", data);
+
+    std::string message = std::string("fsf-tree-md5", 13) + le64(tree_hash_chunk_size) + le64(data.size());
+    for (size_t offset = 0; offset < data.size(); offset += tree_hash_chunk_size) {
+        size_t length = std::min(tree_hash_chunk_size, data.size() - offset);
+        message += from_hex(FileHashMapper::compute_md5_of_buffer(data.data() + offset, length));
+    }
+    std::string expected = FileHashMapper::compute_md5_of_buffer(message.data(), message.size());
+
+    EXPECT_EQ(tree_hash_file("tree_hash_dir/big", 1), expected);
+    EXPECT_NE(expected, FileHashMapper::compute_md5("tree_hash_dir/big"));
+}
+
+TEST_F(TreeHashTests, IndependentOfThreadsAndStreaming) {
+    std::string data = pattern(3 * tree_hash_chunk_size + 1);
+    writeTestFile("tree_hash_dir/big", data);
+    std::string expected = tree_hash_file("tree_hash_dir/big", 1);
+    for (unsigned threads : {2u, 3u, 8u, 0u}) {
+        EXPECT_EQ(tree_hash_file("tree_hash_dir/big", threads), expected) << threads << " threads";
+    }
+
+    TreeHasher hasher;
+    for (size_t offset = 0; offset < data.size(); offset += 100000) {
+        hasher.update(data.data() + offset, std::min<size_t>(100000, data.size() - offset));
+    }
+    EXPECT_EQ(hasher.finish(), expected);
+
+    // One byte changed in any chunk changes the root
+    data[2 * tree_hash_chunk_size + 7] ^= 1;
+    writeTestFile("tree_hash_dir/changed", data);
+    EXPECT_NE(tree_hash_file("tree_hash_dir/changed"), expected);
+}
+
+TEST_F(TreeHashTests, ThresholdSelectsFilesForComputeMd5) {
+    writeTestFile("tree_hash_dir/small", pattern(1000));
+    writeTestFile("tree_hash_dir/large", pattern((2 << 20) + 5));
+    std::string small_md5 = FileHashMapper::compute_md5("tree_hash_dir/small");
+    std::string large_md5 = FileHashMapper::compute_md5("tree_hash_dir/large");
+
+    tree_hash::set_threshold(1 << 20);
+    EXPECT_TRUE(tree_hash::applies(2 << 20));
+    EXPECT_FALSE(tree_hash::applies(1000));
+    EXPECT_EQ(FileHashMapper::compute_md5("tree_hash_dir/small"), small_md5);
+    std::string large = FileHashMapper::compute_md5("tree_hash_dir/large");
+    EXPECT_NE(large, large_md5);
+    EXPECT_EQ(large, tree_hash_file("tree_hash_dir/large"));
+
+    tree_hash::set_threshold(0);
+    EXPECT_EQ(FileHashMapper::compute_md5("tree_hash_dir/large"), large_md5);
+}